@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vector.h"
+#include "matrix.h"
+#include "mlp.h"
+#include "actf.h"
+#include "lossf.h"
+#include "rand.h"
+#include "static_mlp.h"
+#include "timer.h"
+
+/*
+ * 基准测试，不依赖数据集。
+ *
+ * 用法：
+ *   bench           运行全部
+ *   bench <name>    只运行一项
+ */
+
+#define STATIC_SAMPLE 1000  /* 编译期网络基准的样本数 */
+#define STATIC_ROUND 20     /* 编译期网络基准的轮数 */
+#define TRANSPOSE_WORK (1 << 24)  /* 转置基准每种形状累计搬运的元素数 */
+
+/* 与`example.c`相同的拓扑 */
+#define MNIST_NET(L, x)                      \
+	L(x, 0, 784, 16, sigmoid, d_sigmoid) \
+	L(x, 1, 16, 16, sigmoid, d_sigmoid)  \
+	L(x, 2, 16, 10, sigmoid, d_sigmoid)
+STATIC_MLP(mnist, MNIST_NET, 3, d_mse)
+
+/* 一项基准 */
+typedef struct {
+	char *name;        /* 名称 */
+	void (*run)(void); /* 运行 */
+} Bench;
+
+void bench_static(void);
+void bench_transpose(void);
+
+Bench bench_list[] = {
+	{"static", bench_static},
+	{"transpose", bench_transpose},
+};
+
+static volatile float sink;  /* 防止结果被优化掉 */
+
+int main(int argc, char **argv)
+{
+	size_t num = sizeof(bench_list) / sizeof(Bench);
+	bool found = false;
+#ifndef __OPTIMIZE__
+	printf("Warning: not optimized, configure with "
+	       "-DCMAKE_BUILD_TYPE=Release\n\n");
+#endif
+	for (size_t i = 0; i < num; i++) {
+		if (argc > 1 && strcmp(argv[1], bench_list[i].name) != 0)
+			continue;
+		found = true;
+		bench_list[i].run();
+	}
+	if (!found) {
+		printf("Usage: %s [name]\n", argv[0]);
+		printf("Benchmarks:");
+		for (size_t i = 0; i < num; i++)
+			printf(" %s", bench_list[i].name);
+		printf("\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* `STATIC_MLP`与`MLPNet`在同一权重、同一输入上的单样本前向与反向传播 */
+void bench_static(void)
+{
+	struct mnist_net *snet = (struct mnist_net*)malloc(sizeof(*snet));
+	struct mnist_grad *sgrad = (struct mnist_grad*)malloc(sizeof(*sgrad));
+	float *input = (float*)malloc(sizeof(float) * STATIC_SAMPLE * 784);
+	float *label = (float*)calloc(STATIC_SAMPLE * 10, sizeof(float));
+	Vector **vinput = (Vector**)malloc(sizeof(Vector*) * STATIC_SAMPLE);
+	Vector **vlabel = (Vector**)malloc(sizeof(Vector*) * STATIC_SAMPLE);
+	if (!snet || !sgrad || !input || !label || !vinput || !vlabel)
+		goto fail;
+
+	FCLayer *layer[3] = {
+		new_fc_layer(784, 16, NULL, NULL, sigmoid, d_sigmoid),
+		new_fc_layer(16, 16, NULL, NULL, sigmoid, d_sigmoid),
+		new_fc_layer(16, 10, NULL, NULL, sigmoid, d_sigmoid),
+	};
+	MLPNet *net = new_mlp_net(3, layer, mse_loss, d_mse_loss);
+	for (size_t i = 0; i < 3; i++)
+		layer[i]->free(layer[i]);
+	net->init(net, MLP_INIT_XAVIER_UNIFORM, 1);
+	MLPGrad *grad = new_mlp_grad(net);
+
+	/* 拷贝权重，`Matrix`按列存储，`STATIC_MLP`按行存储 */
+	float *w[3] = {&snet->w0[0][0], &snet->w1[0][0], &snet->w2[0][0]};
+	float *b[3] = {snet->b0, snet->b1, snet->b2};
+	for (size_t i = 0; i < 3; i++) {
+		FCLayer *fc = net->layer[i]->fc;
+		for (size_t r = 0; r < fc->next_size; r++) {
+			for (size_t c = 0; c < fc->size; c++)
+				w[i][r * fc->size + c] = fc->weight->val[c]->val[r];
+			b[i][r] = fc->bias->val[r];
+		}
+	}
+
+	rand_fill_uniform_at(input, STATIC_SAMPLE * 784, 1, 0, 0.0, 1.0);
+	for (size_t k = 0; k < STATIC_SAMPLE; k++) {
+		label[k * 10 + k % 10] = 1.0;
+		vinput[k] = new_vector_view(784, input + k * 784);
+		vlabel[k] = new_vector_view(10, label + k * 10);
+	}
+
+	/* 结果应一致 */
+	mnist_grad_clear(sgrad);
+	grad->clear(grad);
+	const float *out = mnist_forward(snet, input);
+	net->forward(net, vinput[0]);
+	mnist_grad(snet, label, sgrad);
+	net->grad(net, vlabel[0], grad);
+	float out_diff = 0.0;
+	for (size_t j = 0; j < 10; j++)
+		out_diff = fmaxf(out_diff, fabsf(out[j]
+		                                 - net->output(net)->val[j]));
+	float grad_diff = 0.0;
+	for (size_t r = 0; r < 16; r++)
+		for (size_t c = 0; c < 784; c++)
+			grad_diff = fmaxf(grad_diff, fabsf(sgrad->w0[r][c]
+			                  - grad->weight[0]->val[c]->val[r]));
+
+	size_t total = STATIC_SAMPLE * STATIC_ROUND;
+	double time[4];
+	double start = timer_now();
+	for (size_t t = 0; t < STATIC_ROUND; t++)
+		for (size_t k = 0; k < STATIC_SAMPLE; k++)
+			sink += mnist_forward(snet, input + k * 784)[0];
+	time[0] = timer_now() - start;
+	start = timer_now();
+	for (size_t t = 0; t < STATIC_ROUND; t++)
+		for (size_t k = 0; k < STATIC_SAMPLE; k++) {
+			net->forward(net, vinput[k]);
+			sink += net->output(net)->val[0];
+		}
+	time[1] = timer_now() - start;
+	start = timer_now();
+	for (size_t t = 0; t < STATIC_ROUND; t++)
+		for (size_t k = 0; k < STATIC_SAMPLE; k++) {
+			mnist_forward(snet, input + k * 784);
+			mnist_grad(snet, label + k * 10, sgrad);
+		}
+	time[2] = timer_now() - start;
+	start = timer_now();
+	for (size_t t = 0; t < STATIC_ROUND; t++)
+		for (size_t k = 0; k < STATIC_SAMPLE; k++) {
+			net->forward(net, vinput[k]);
+			net->grad(net, vlabel[k], grad);
+		}
+	time[3] = timer_now() - start;
+	sink += sgrad->b0[0];
+
+	printf("STATIC_MLP vs MLPNet, {784, 16, 16, 10}, %zu samples\n", total);
+	printf("  %-18s %12s %12s %9s\n", "", "STATIC_MLP", "MLPNet", "speedup");
+	printf("  %-18s %9.0f ns %9.0f ns %8.2fx\n", "forward",
+	       time[0] / total * 1e9, time[1] / total * 1e9, time[1] / time[0]);
+	printf("  %-18s %9.0f ns %9.0f ns %8.2fx\n", "forward + grad",
+	       time[2] / total * 1e9, time[3] / total * 1e9, time[3] / time[2]);
+	printf("  max |diff|: output %g, weight grad %g\n\n", out_diff,
+	       grad_diff);
+
+	for (size_t k = 0; k < STATIC_SAMPLE; k++) {
+		vinput[k]->free(vinput[k]);
+		vlabel[k]->free(vlabel[k]);
+	}
+	grad->free(grad);
+	net->free(net);
+	free(snet);
+	free(sgrad);
+	free(input);
+	free(label);
+	free(vinput);
+	free(vlabel);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/* 逐元素转置，作为对照 */
+static void naive_transpose_to(Matrix *m, Matrix *target)
+{
+	for (size_t i = 0; i < m->row; i++)
+		for (size_t j = 0; j < m->col; j++)
+			target->val[i]->val[j] = m->val[j]->val[i];
+}
+
+/* 逐元素转置、分块转置到目标、原地分块转置，覆盖网络中的权重形状与大方阵 */
+void bench_transpose(void)
+{
+	size_t shape[][2] = {
+		{784, 16}, {16, 784}, {256, 256}, {784, 784},
+		{1024, 1024}, {2048, 512}, {4096, 4096},
+	};
+	size_t num = sizeof(shape) / sizeof(shape[0]);
+
+#if defined(__AVX__)
+	printf("Matrix transpose, 8x8 kernel: AVX\n");
+#elif defined(__SSE__)
+	printf("Matrix transpose, 8x8 kernel: SSE\n");
+#else
+	printf("Matrix transpose, 8x8 kernel: scalar\n");
+#endif
+	printf("  %-11s %10s %10s %10s %8s\n", "shape", "naive", "tiled",
+	       "in-place", "speedup");
+	for (size_t s = 0; s < num; s++) {
+		size_t row = shape[s][0];
+		size_t col = shape[s][1];
+		size_t size = row * col;
+		size_t round = TRANSPOSE_WORK / size ? TRANSPOSE_WORK / size : 1;
+		Matrix *m = new_matrix(row, col, NULL);
+		Matrix *target = new_matrix(col, row, NULL);
+		if (!m || !target)
+			goto fail;
+		for (size_t j = 0; j < col; j++)
+			rand_fill_uniform_at(m->val[j]->val, row, 1, j * row,
+			                     -1.0, 1.0);
+
+		/* 结果应一致 */
+		Matrix *expect = new_matrix(col, row, NULL);
+		if (!expect)
+			goto fail;
+		naive_transpose_to(m, expect);
+		m->transpose_to(m, target);
+		size_t wrong = 0;
+		for (size_t i = 0; i < row; i++)
+			wrong += memcmp(expect->val[i]->val, target->val[i]->val,
+			                sizeof(float) * col) != 0;
+
+		double time[3] = {0.0, 0.0, 0.0};
+		double start = timer_now();
+		for (size_t t = 0; t < round; t++) {
+			naive_transpose_to(m, target);
+			sink += target->val[0]->val[t % col];
+		}
+		time[0] = timer_now() - start;
+		start = timer_now();
+		for (size_t t = 0; t < round; t++) {
+			m->transpose_to(m, target);
+			sink += target->val[0]->val[t % col];
+		}
+		time[1] = timer_now() - start;
+		if (row == col) {
+			start = timer_now();
+			for (size_t t = 0; t < round; t++) {
+				m->transpose(m);
+				sink += m->val[0]->val[t % row];
+			}
+			time[2] = timer_now() - start;
+		}
+
+		char name[16];
+		snprintf(name, sizeof(name), "%zux%zu", row, col);
+		double scale = 1e9 / ((double)round * size);
+		printf("  %-11s %7.2f ns %7.2f ns ", name, time[0] * scale,
+		       time[1] * scale);
+		if (row == col)
+			printf("%7.2f ns ", time[2] * scale);
+		else
+			printf("%10s ", "-");
+		printf("%7.2fx%s\n", time[0] / time[1], wrong ? "  WRONG" : "");
+
+		m->free(m);
+		target->free(target);
+		expect->free(expect);
+	}
+	printf("  (time per element)\n\n");
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
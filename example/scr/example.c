@@ -2,10 +2,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
+#include <math.h>
 #include "vector.h"
 #include "mlp.h"
 #include "actf.h"
 #include "lossf.h"
+#include "rand.h"
+#include "trainer.h"
+#include "eval.h"
+#include "sparse.h"
+#include "snapshot.h"
+#include "pool.h"
+#include "timer.h"
 
 Vector **read_image_file(char *path);
 Vector **read_label_file(char *path);
@@ -13,92 +21,94 @@ uint32_t read_uint32(FILE *file);
 uint8_t read_uint8(FILE *file);
 Vector *read_image(FILE *file, size_t size);
 Vector *read_label(FILE *file);
-size_t *rand_queue();
-size_t res(Vector *out);
+MLPNet *new_net(void);
+void compare_sparse(MLPNet *dense, SparseNet *sparse, Dataset *data);
+void compare_hogwild(Dataset *train, Dataset *val);
 
 #define TRAIN_SIZE 60000
+#define VAL_SIZE 5000
+#define EPOCH_NUM 10
 #define BATCH_SIZE 100
-#define BATCH_NUM TRAIN_SIZE / BATCH_SIZE - 1
 #define LEARNING_RATE 5
+#define PATIENCE 2
 #define TEST_SIZE 10000
+#define MODEL_PATH "mnist.snap"
+#define SPARSE_ROUND 5  /* 稀疏推理计时的轮数，取最快的一轮 */
+#define HOGWILD_EPOCH 2  /* Hogwild! 与同步训练对比的轮数 */
+#define HOGWILD_SEED 1   /* 对比时各网络相同的初始化种子 */
 
 #define NET_SIZE 4
 size_t layer_size[NET_SIZE] = {784, 16, 16, 10};
 
 int main()
 {
-	srand(time(NULL));
+	rand_seed(time(NULL));
 	Vector **train_image = read_image_file("../mnist/train-images.idx3-ubyte");
 	Vector **train_label = read_label_file("../mnist/train-labels.idx1-ubyte");
+	Dataset *train = new_dataset(TRAIN_SIZE - VAL_SIZE, train_image,
+	                             train_label);
+	Dataset *val = new_dataset(VAL_SIZE, train_image + TRAIN_SIZE - VAL_SIZE,
+	                           train_label + TRAIN_SIZE - VAL_SIZE);
 
-	FCLayer *hidden_layer_1 = new_fc_layer(layer_size[0], layer_size[1],
-	                                       NULL, NULL, sigmoid, d_sigmoid);
-	FCLayer *hidden_layer_2 = new_fc_layer(layer_size[1], layer_size[2],
-	                                       NULL, NULL, sigmoid, d_sigmoid);
-	FCLayer *output_layer = new_fc_layer(layer_size[2], layer_size[3],
-	                                     NULL, NULL, sigmoid, d_sigmoid);
-	FCLayer *layer[3] = {hidden_layer_1, hidden_layer_2, output_layer};
-	MLPNet *net = new_mlp_net(NET_SIZE - 1, layer,
-	                          mse_loss, d_mse_loss);
-	hidden_layer_1->free(hidden_layer_1);
-	hidden_layer_2->free(hidden_layer_2);
-	output_layer->free(output_layer);
-	MLPGrad *grad_tmp = new_mlp_grad(net);
-	MLPGrad *grad = new_mlp_grad(net);
+	MLPNet *net = new_net();
 	net->init_xavier(net);
 
+	Trainer *trainer = new_trainer(net, EPOCH_NUM, BATCH_SIZE, LEARNING_RATE);
+	trainer->val = val;
+	trainer->patience = PATIENCE;
 	printf("Training start.\n");
 	printf("Batch size: %d\n", BATCH_SIZE);
-	printf("number of batch(es): %d(drop last)\n\n", BATCH_NUM);
-	size_t *queue = rand_queue();
-	for (size_t i = 0; i < BATCH_NUM; i++) {
-		for (size_t j = 0; j < BATCH_SIZE; j++) {
-			size_t index = queue[i * BATCH_SIZE + j];
-			Vector *input = train_image[index];
-			Vector *label = train_label[index];
-			net->forward(net, input);
-			net->grad(net, label, grad_tmp);
-			grad->add(grad, grad_tmp);
-		}
-		grad->scale(grad, 1.0 / BATCH_SIZE * LEARNING_RATE);
-		net->update(net, grad);
-		grad->clear(grad);
-
-		net->forward(net, train_image[0]);
-		Vector *out = net->layer[net->size - 1]->out;
-		float loss = net->lossf(out, train_label[0]);
-		printf("[%d / %d] loss: %lf\n", (int)i + 1, BATCH_NUM, loss);
-	}
+	printf("Max epoch(s): %d\n\n", EPOCH_NUM);
+	trainer->train(trainer, train);
+	trainer->restore_best(trainer);
+	printf("Done. Best val accuracy: %.2f%% (epoch %zu)\n\n",
+	       trainer->best_acc * 100, trainer->best_epoch);
+	Snapshot *snapshot = new_snapshot(net, MODEL_PATH);
+	snapshot->take(snapshot, trainer->step);
+	snapshot->free(snapshot);
+	printf("Model saved: %s\n\n", MODEL_PATH);
+	trainer->free(trainer);
+
+	printf("Hogwild! comparison start.\n");
+	compare_hogwild(train, val);
 	printf("Done.\n\n");
+	train->free(train);
+	val->free(val);
 	for (size_t i = 0; i < TRAIN_SIZE; i++) {
 		train_image[i]->free(train_image[i]);
 		train_label[i]->free(train_label[i]);
 	}
 	free(train_image);
 	free(train_label);
-	grad_tmp->free(grad_tmp);
-	grad->free(grad);
-	free(queue);
 
 	Vector **test_image = read_image_file("../mnist/t10k-images.idx3-ubyte");
 	Vector **test_label = read_label_file("../mnist/t10k-labels.idx1-ubyte");
-	int correct = 0;
+	Dataset *test = new_dataset(TEST_SIZE, test_image, test_label);
 	printf("Testing start.\n");
-	for (size_t i = 0; i < TEST_SIZE; i++) {
-		Vector *input = test_image[i];
-		Vector *label = test_label[i];
-		net->forward(net, input);
-		if (label->val[res(net->layer[net->size - 1]->out)] == 1.0)
-			correct += 1;
-	}
+	Metrics *metrics = evaluate(net, test, 3);
 	printf("Done.\n");
-	printf("Accuracy: %%%.2lf (%d / %d)\n", (float)correct / TEST_SIZE * 100, correct, TEST_SIZE);
+	metrics->print(metrics);
+	metrics->free(metrics);
+
+	printf("\nPruning start.\n");
+	float sparsity[3] = {0.5, 0.8, 0.95};
+	for (size_t i = 0; i < 3; i++) {
+		MLPNet *pruned = net->fold(net);
+		float zero = mlp_prune(pruned, sparsity[i], SPARSE_BSR_8X1);
+		SparseNet *sparse = new_sparse_net(pruned, SPARSE_BSR_8X1);
+		printf("Sparsity: %5.2f%%\n", zero * 100);
+		compare_sparse(pruned, sparse, test);
+		sparse->free(sparse);
+		pruned->free(pruned);
+	}
+	test->free(test);
 	for (size_t i = 0; i < TEST_SIZE; i++) {
 		test_image[i]->free(test_image[i]);
 		test_label[i]->free(test_label[i]);
 	}
 	free(test_image);
 	free(test_label);
+	net->free(net);
 
 	printf("\n----- end of program -----\n");
 	return 0;
@@ -189,28 +199,127 @@ Vector *read_label(FILE *file)
 	return ret;
 }
 
-size_t *rand_queue() {
-	size_t *ret = (size_t*)calloc(TRAIN_SIZE, sizeof(size_t));
-	for (size_t i = 0; i != TRAIN_SIZE; i++)
-		ret[i] = i;
-	for (size_t i = TRAIN_SIZE; i-- > 0; ) {
-		size_t j = rand() % (i + 1);
-		size_t tmp = ret[i];
-		ret[i] = ret[j];
-		ret[j] = tmp;
-	}
-	return ret;
+/* 按`layer_size`创建未初始化的网络 */
+MLPNet *new_net(void)
+{
+	FCLayer *hidden_layer_1 = new_fc_layer(layer_size[0], layer_size[1],
+	                                       NULL, NULL, sigmoid, d_sigmoid);
+	FCLayer *hidden_layer_2 = new_fc_layer(layer_size[1], layer_size[2],
+	                                       NULL, NULL, sigmoid, d_sigmoid);
+	FCLayer *output_layer = new_fc_layer(layer_size[2], layer_size[3],
+	                                     NULL, NULL, sigmoid, d_sigmoid);
+	FCLayer *layer[3] = {hidden_layer_1, hidden_layer_2, output_layer};
+	MLPNet *net = new_mlp_net(NET_SIZE - 1, layer,
+	                          mse_loss, d_mse_loss);
+	hidden_layer_1->free(hidden_layer_1);
+	hidden_layer_2->free(hidden_layer_2);
+	output_layer->free(output_layer);
+	return net;
 }
 
-size_t res(Vector *out)
+/*
+ * 从相同的初始参数出发，比较同步的分批训练与 Hogwild! 训练每轮的吞吐量
+ * 与验证准确率。Hogwild! 逐样本更新，学习率取`LEARNING_RATE / BATCH_SIZE`，
+ * 使每个样本对参数的影响与分批时相当；单线程一项用于区分并发带来的加速。
+ */
+void compare_hogwild(Dataset *train, Dataset *val)
 {
-	float max = -100.0;
-	size_t max_index = 0;
-	for (size_t i = 0; i < out->size; i++) {
-		if (out->val[i] > max) {
-			max = out->val[i];
-			max_index = i;
+	size_t thread = pool_global()->size + 1;  /* 调用线程也参与 */
+	size_t hogwild[3] = {0, 1, thread};
+	char name[3][32];
+	snprintf(name[0], sizeof(name[0]), "sync, batch %d", BATCH_SIZE);
+	snprintf(name[1], sizeof(name[1]), "hogwild x1");
+	snprintf(name[2], sizeof(name[2]), "hogwild x%zu", thread);
+	size_t mode_num = thread > 1 ? 3 : 2;
+
+	printf("%d epoch(s), %zu samples per epoch\n", HOGWILD_EPOCH,
+	       train->size);
+	printf("  %-16s %5s %12s %10s %10s\n", "mode", "epoch", "samples/s",
+	       "loss", "val acc");
+	for (size_t m = 0; m < mode_num; m++) {
+		MLPNet *net = new_net();
+		net->init(net, MLP_INIT_XAVIER_UNIFORM, HOGWILD_SEED);
+		float rate = hogwild[m] ? (float)LEARNING_RATE / BATCH_SIZE
+		                        : LEARNING_RATE;
+		Trainer *trainer = new_trainer(net, 1, BATCH_SIZE, rate);
+		trainer->hogwild = hogwild[m];
+		trainer->report_interval = 0.0;
+		for (size_t e = 1; e <= HOGWILD_EPOCH; e++) {
+			double start = timer_now();
+			trainer->train(trainer, train);
+			double time = timer_now() - start;
+			Metrics *metrics = evaluate(net, val, 1);
+			printf("  %-16s %5zu %12.0f %10f %9.2f%%\n", name[m], e,
+			       train->size / time, trainer->loss,
+			       metrics->accuracy * 100);
+			metrics->free(metrics);
 		}
+		trainer->free(trainer);
+		net->free(net);
+	}
+}
+
+/* 在同一数据集上比较剪枝后的稠密网络与`SparseNet`的结果、延迟与内存 */
+void compare_sparse(MLPNet *dense, SparseNet *sparse, Dataset *data)
+{
+	size_t num = data->size;
+	size_t out_size = data->label[0]->size;
+	size_t *res[2] = {
+		(size_t*)malloc(sizeof(size_t) * num),
+		(size_t*)malloc(sizeof(size_t) * num),
+	};
+	Vector **prob[2] = {
+		(Vector**)malloc(sizeof(Vector*) * num),
+		(Vector**)malloc(sizeof(Vector*) * num),
+	};
+	if (!res[0] || !res[1] || !prob[0] || !prob[1])
+		goto fail;
+	for (size_t k = 0; k < num; k++) {
+		prob[0][k] = new_vector(out_size, NULL);
+		prob[1][k] = new_vector(out_size, NULL);
+	}
+
+	double time[2] = {INFINITY, INFINITY};
+	for (size_t t = 0; t < SPARSE_ROUND; t++) {
+		double start = timer_now();
+		dense->predict_batch(dense, data->input, num, res[0], prob[0]);
+		time[0] = fmin(time[0], timer_now() - start);
+		start = timer_now();
+		sparse->predict_batch(sparse, data->input, num, res[1], prob[1]);
+		time[1] = fmin(time[1], timer_now() - start);
+	}
+
+	size_t correct[2] = {0, 0};
+	size_t agree = 0;
+	float max_diff = 0.0;
+	for (size_t k = 0; k < num; k++) {
+		Vector *label = data->label[k];
+		for (size_t m = 0; m < 2; m++)
+			correct[m] += label->val[res[m][k]] == 1.0;
+		agree += res[0][k] == res[1][k];
+		for (size_t j = 0; j < out_size; j++)
+			max_diff = fmaxf(max_diff, fabsf(prob[0][k]->val[j]
+			                                 - prob[1][k]->val[j]));
+	}
+	printf("  Accuracy: dense %5.2f%%, sparse %5.2f%%, "
+	       "argmax agreement %6.2f%%, max |diff| %.2g\n",
+	       100.0 * correct[0] / num, 100.0 * correct[1] / num,
+	       100.0 * agree / num, max_diff);
+	printf("  Latency:  dense %.3f us, sparse %.3f us per sample (%.2fx)\n",
+	       time[0] / num * 1e6, time[1] / num * 1e6, time[0] / time[1]);
+	printf("  Weights:  dense %zu bytes, sparse %zu bytes\n",
+	       sizeof(float) * dense->param_size, sparse->bytes(sparse));
+
+	for (size_t k = 0; k < num; k++) {
+		prob[0][k]->free(prob[0][k]);
+		prob[1][k]->free(prob[1][k]);
 	}
-	return max_index;
+	free(res[0]);
+	free(res[1]);
+	free(prob[0]);
+	free(prob[1]);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
 }
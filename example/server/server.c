@@ -0,0 +1,636 @@
+#define _POSIX_C_SOURCE 200809L  /* MSG_NOSIGNAL */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <threads.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "vector.h"
+#include "mlp.h"
+#include "lossf.h"
+#include "rand.h"
+#include "batcher.h"
+#include "snapshot.h"
+#include "handle.h"
+#include "cache.h"
+#include "timer.h"
+
+/*
+ * 推理服务：载入一次由`snapshot.h`保存的模型，经 Unix 域套接字接受请求。
+ * 各连接的请求由`Batcher`合并为批，再由`MLPNet::predict_batch`多线程推理。
+ *
+ * 用法：
+ *   server <model> <socket> [cache]                  启动服务，Ctrl-C 停止，
+ *                                                    SIGHUP 时重新载入模型；
+ *                                                    `cache`为缓存的条目数，默认不缓存
+ *   server -c <socket> [requests] [connections] [distinct]
+ *                                                    本地客户端，压测并打印延迟；
+ *                                                    `distinct`为不同输入的个数，
+ *                                                    默认每个请求都不同
+ *
+ * 报文均按本机字节序，请求为`Header`后跟`size`个`float`；
+ * 推理的应答为`Reply`后跟`size`个`float`（输出层），统计的应答为`Stats`。
+ */
+
+#define MAX_BATCH 64       /* 最大批大小 */
+#define MAX_WAIT 200       /* 最长等待时间（微秒） */
+#define MAX_CONN 256       /* 最大连接数 */
+#define REPORT_INTERVAL 5  /* 两次统计报告的最短间隔（秒） */
+#define CACHE_SHARD 16     /* 缓存的分片数 */
+
+#define HIST_SUB 8                /* 每倍频程的桶数 */
+#define HIST_SIZE (HIST_SUB * 32)  /* 桶数，上限约 4000 秒 */
+
+/* 请求种类 */
+enum {
+	REQUEST_PREDICT,  /* 推理 */
+	REQUEST_STATS,    /* 统计 */
+};
+
+/* 应答状态 */
+enum {
+	STATUS_OK,        /* 成功 */
+	STATUS_BAD_SIZE,  /* 输入大小与模型不符 */
+	STATUS_BAD_KIND,  /* 未知的请求 */
+};
+
+/* 请求头 */
+typedef struct {
+	uint32_t kind;  /* 种类 */
+	uint32_t size;  /* 其后的`float`个数 */
+} Header;
+
+/* 推理的应答 */
+typedef struct {
+	uint32_t status;  /* 状态 */
+	uint32_t res;     /* 最大输出下标 */
+	uint32_t size;    /* 其后的`float`个数 */
+} Reply;
+
+/* 统计的应答，时间单位为微秒 */
+typedef struct {
+	uint32_t status;       /* 状态 */
+	uint32_t input_size;   /* 模型输入大小 */
+	uint32_t output_size;  /* 模型输出大小 */
+	uint32_t conn_num;     /* 当前连接数 */
+	uint64_t version;      /* 当前模型的版本号 */
+	uint64_t count;        /* 已处理的推理请求数 */
+	double qps;            /* 自首个请求起的平均每秒请求数 */
+	double p50;            /* 延迟的中位数 */
+	double p99;            /* 延迟的 99 分位数 */
+	double max;            /* 最大延迟 */
+	uint64_t cache_hit;    /* 缓存命中次数 */
+	uint64_t cache_miss;   /* 缓存未命中次数，未启用缓存时与命中次数均为`0` */
+} Stats;
+
+/* 延迟直方图，桶`i`覆盖`[2^((i-1)/HIST_SUB), 2^(i/HIST_SUB))`微秒 */
+typedef struct {
+	uint64_t count[HIST_SIZE];  /* 各桶的计数 */
+	uint64_t total;             /* 总数 */
+	double max;                 /* 最大值 */
+} Histogram;
+
+/* 服务 */
+typedef struct {
+	ModelHandle *handle;  /* 可热替换的模型 */
+	Batcher *batcher;     /* 批量推理队列 */
+	Cache *cache;         /* 推理结果的缓存，可为`NULL` */
+	size_t input_size;    /* 输入大小 */
+	size_t output_size;   /* 输出大小 */
+	int conn[MAX_CONN];   /* 各连接，空位为`-1` */
+	size_t conn_num;      /* 当前连接数 */
+	Histogram hist;       /* 服务端延迟，自读完请求至写出应答前 */
+	double first;         /* 首个请求的时刻 */
+	double last;          /* 最近一个请求的时刻 */
+	mtx_t lock;           /* 连接与统计量的锁 */
+	cnd_t leave;          /* 一个连接关闭 */
+} Server;
+
+/* 连接线程的参数 */
+typedef struct {
+	Server *server;  /* 服务 */
+	size_t index;    /* 在`conn`中的下标 */
+	int fd;          /* 套接字 */
+} Conn;
+
+/* 客户端线程的参数 */
+typedef struct {
+	char *path;       /* 套接字路径 */
+	size_t num;       /* 请求数 */
+	size_t size;      /* 输入大小 */
+	uint64_t seed;    /* 随机输入的种子 */
+	size_t distinct;  /* 不同输入的个数，为`0`时每个请求都不同 */
+	Histogram hist;   /* 客户端延迟，含往返 */
+	size_t fail;      /* 失败的请求数 */
+} Client;
+
+int serve(char *model, char *path, size_t cache_size);
+int conn_main(void *arg);
+Stats server_stats(Server *server);
+int client(char *path, size_t num, size_t conn_num, size_t distinct);
+int client_main(void *arg);
+int connect_to(char *path);
+bool read_full(int fd, void *buf, size_t size);
+bool write_full(int fd, const void *buf, size_t size);
+void hist_add(Histogram *hist, double us);
+void hist_merge(Histogram *hist, Histogram *target);
+double hist_percentile(Histogram *hist, double p);
+void hist_print(Histogram *hist);
+void on_signal(int sig);
+void on_reload(int sig);
+
+static volatile sig_atomic_t stop = 0;
+static volatile sig_atomic_t reload = 0;
+
+int main(int argc, char **argv)
+{
+	signal(SIGPIPE, SIG_IGN);
+	if (argc >= 3 && strcmp(argv[1], "-c") == 0)
+		return client(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : 10000,
+		              argc > 4 ? strtoul(argv[4], NULL, 10) : 8,
+		              argc > 5 ? strtoul(argv[5], NULL, 10) : 0);
+	if (argc == 3 || argc == 4)
+		return serve(argv[1], argv[2],
+		             argc > 3 ? strtoul(argv[3], NULL, 10) : 0);
+	printf("Usage: %s <model> <socket> [cache]\n", argv[0]);
+	printf("       %s -c <socket> [requests] [connections] [distinct]\n",
+	       argv[0]);
+	return 1;
+}
+
+int serve(char *model, char *path, size_t cache_size)
+{
+	size_t step;
+	MLPNet *net = snapshot_load(model, mse_loss, d_mse_loss, &step);
+	if (!net) {
+		printf("Cannot load model: %s\n", model);
+		return 1;
+	}
+	Server *server = (Server*)calloc(1, sizeof(Server));
+	if (!server)
+		goto fail;
+	server->input_size = net->layer[0]->size;
+	server->output_size = net->layer[net->size - 1]->next_size;
+	server->handle = new_model_handle(net);
+	server->batcher = new_batcher_handle(server->handle, MAX_BATCH, MAX_WAIT);
+	if (cache_size) {
+		server->cache = new_cache(cache_size, CACHE_SHARD, server->input_size,
+		                          server->output_size);
+		server->batcher->cache = server->cache;
+	}
+	for (size_t i = 0; i < MAX_CONN; i++)
+		server->conn[i] = -1;
+	if (mtx_init(&server->lock, mtx_plain) != thrd_success
+	    || cnd_init(&server->leave) != thrd_success)
+		goto thrd_fail;
+	printf("Model: %s (step %zu, %zu -> %zu)\n", model, step,
+	       server->input_size, server->output_size);
+
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path too long: %s\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr))
+	    || listen(listener, 64)) {
+		printf("Cannot listen on: %s\n", path);
+		return 1;
+	}
+	/* `signal`在 POSIX 模式下为一次性的，改用`sigaction` */
+	struct sigaction action = {.sa_handler = on_signal};
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	action.sa_handler = on_reload;
+	sigaction(SIGHUP, &action, NULL);
+	printf("Listening: %s\n", path);
+
+	double last_report = timer_now();
+	uint64_t last_count = 0;
+	while (!stop) {
+		struct pollfd fd = {.fd = listener, .events = POLLIN};
+		if (poll(&fd, 1, 200) > 0) {
+			int client_fd = accept(listener, NULL, NULL);
+			if (client_fd >= 0) {
+				mtx_lock(&server->lock);
+				size_t index = 0;
+				while (index < MAX_CONN && server->conn[index] >= 0)
+					index++;
+				Conn *conn = index < MAX_CONN
+				             ? (Conn*)malloc(sizeof(Conn)) : NULL;
+				thrd_t thread;
+				if (conn) {
+					*conn = (Conn) {server, index, client_fd};
+					server->conn[index] = client_fd;
+					server->conn_num++;
+				}
+				if (conn && thrd_create(&thread, conn_main, conn)
+				            == thrd_success) {
+					thrd_detach(thread);
+				} else {
+					if (conn) {
+						server->conn[index] = -1;
+						server->conn_num--;
+						free(conn);
+					}
+					close(client_fd);
+				}
+				mtx_unlock(&server->lock);
+			}
+		}
+		if (reload) {
+			/* 载入期间推理照常进行 */
+			reload = 0;
+			size_t version = server->handle->reload(server->handle, model);
+			if (version)
+				printf("[server] reloaded %s as version %zu\n", model,
+				       version);
+			else
+				printf("[server] cannot reload %s, keeping old model\n",
+				       model);
+		}
+		/* 推理线程从不回收，旧模型在其最后一批完成后由这里销毁 */
+		server->handle->reclaim(server->handle);
+		if (timer_now() - last_report >= REPORT_INTERVAL) {
+			Stats stats = server_stats(server);
+			if (stats.count != last_count)
+				printf("[server] %llu requests, %zu conns, %.0f qps, "
+				       "p50 %.1f us, p99 %.1f us\n",
+				       (unsigned long long)stats.count,
+				       (size_t)stats.conn_num, stats.qps, stats.p50,
+				       stats.p99);
+			last_count = stats.count;
+			last_report = timer_now();
+		}
+	}
+
+	close(listener);
+	unlink(path);
+	mtx_lock(&server->lock);
+	for (size_t i = 0; i < MAX_CONN; i++)
+		if (server->conn[i] >= 0)
+			shutdown(server->conn[i], SHUT_RDWR);
+	while (server->conn_num)
+		cnd_wait(&server->leave, &server->lock);
+	mtx_unlock(&server->lock);
+
+	printf("\nServer latency:\n");
+	hist_print(&server->hist);
+	server->batcher->free(server->batcher);
+	if (server->cache) {
+		server->cache->print(server->cache);
+		server->cache->free(server->cache);
+	}
+	server->handle->free(server->handle);
+	mtx_destroy(&server->lock);
+	cnd_destroy(&server->leave);
+	free(server);
+	return 0;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+int conn_main(void *arg)
+{
+	Conn *conn = (Conn*)arg;
+	Server *server = conn->server;
+	Vector *input = new_vector(server->input_size, NULL);
+	Vector *prob = new_vector(server->output_size, NULL);
+	Header header;
+	while (read_full(conn->fd, &header, sizeof(Header))) {
+		if (header.kind == REQUEST_STATS) {
+			Stats stats = server_stats(server);
+			if (!write_full(conn->fd, &stats, sizeof(Stats)))
+				break;
+			continue;
+		}
+		Reply reply = {.status = STATUS_OK};
+		if (header.kind != REQUEST_PREDICT) {
+			reply.status = STATUS_BAD_KIND;
+		} else if (header.size != server->input_size) {
+			reply.status = STATUS_BAD_SIZE;
+		}
+		if (reply.status != STATUS_OK) {
+			/* 丢弃其后的数据以保持报文同步 */
+			float tmp;
+			bool ok = true;
+			for (size_t i = 0; ok && i < header.size; i++)
+				ok = read_full(conn->fd, &tmp, sizeof(float));
+			if (!ok || !write_full(conn->fd, &reply, sizeof(Reply)))
+				break;
+			continue;
+		}
+		if (!read_full(conn->fd, input->val, sizeof(float) * input->size))
+			break;
+		double start = timer_now();
+		reply.res = server->batcher->predict(server->batcher, input, prob);
+		reply.size = prob->size;
+		double end = timer_now();
+
+		mtx_lock(&server->lock);
+		hist_add(&server->hist, (end - start) * 1e6);
+		if (!server->first)
+			server->first = start;
+		server->last = end;
+		mtx_unlock(&server->lock);
+
+		if (!write_full(conn->fd, &reply, sizeof(Reply))
+		    || !write_full(conn->fd, prob->val, sizeof(float) * prob->size))
+			break;
+	}
+	input->free(input);
+	prob->free(prob);
+
+	mtx_lock(&server->lock);
+	close(conn->fd);
+	server->conn[conn->index] = -1;
+	server->conn_num--;
+	cnd_signal(&server->leave);
+	mtx_unlock(&server->lock);
+	free(conn);
+	return 0;
+}
+
+Stats server_stats(Server *server)
+{
+	size_t version = atomic_load(&server->handle->version);
+	CacheStats cache = {0};
+	if (server->cache)
+		cache = server->cache->stats(server->cache);
+	mtx_lock(&server->lock);
+	Histogram *hist = &server->hist;
+	double span = server->last - server->first;
+	Stats stats = {
+		.status = STATUS_OK,
+		.input_size = server->input_size,
+		.output_size = server->output_size,
+		.conn_num = server->conn_num,
+		.version = version,
+		.count = hist->total,
+		.qps = span > 0.0 ? hist->total / span : 0.0,
+		.p50 = hist_percentile(hist, 0.5),
+		.p99 = hist_percentile(hist, 0.99),
+		.max = hist->max,
+		.cache_hit = cache.hit,
+		.cache_miss = cache.miss,
+	};
+	mtx_unlock(&server->lock);
+	return stats;
+}
+
+int client(char *path, size_t num, size_t conn_num, size_t distinct)
+{
+	if (!conn_num)
+		conn_num = 1;
+	int fd = connect_to(path);
+	if (fd < 0) {
+		printf("Cannot connect to: %s\n", path);
+		return 1;
+	}
+	Header header = {.kind = REQUEST_STATS, .size = 0};
+	Stats stats;
+	if (!write_full(fd, &header, sizeof(Header))
+	    || !read_full(fd, &stats, sizeof(Stats))) {
+		printf("Cannot query server\n");
+		return 1;
+	}
+	printf("Model: %u -> %u\n", (unsigned)stats.input_size,
+	       (unsigned)stats.output_size);
+
+	Client *worker = (Client*)calloc(conn_num, sizeof(Client));
+	thrd_t *thread = (thrd_t*)calloc(conn_num, sizeof(thrd_t));
+	if (!worker || !thread)
+		goto fail;
+	double start = timer_now();
+	for (size_t i = 0; i < conn_num; i++) {
+		worker[i] = (Client) {
+			.path = path,
+			.num = num / conn_num + (i < num % conn_num),
+			.size = stats.input_size,
+			.seed = distinct ? 1 : i + 1,
+			.distinct = distinct,
+		};
+		if (thrd_create(thread + i, client_main, worker + i) != thrd_success)
+			goto thrd_fail;
+	}
+	Histogram hist = {0};
+	size_t fail_num = 0;
+	for (size_t i = 0; i < conn_num; i++) {
+		thrd_join(thread[i], NULL);
+		hist_merge(&hist, &worker[i].hist);
+		fail_num += worker[i].fail;
+	}
+	double time = timer_now() - start;
+
+	printf("%zu requests over %zu connections in %.3f s, %zu failed\n",
+	       (size_t)hist.total, conn_num, time, fail_num);
+	printf("QPS: %.0f\n", hist.total / time);
+	printf("Client latency (round trip):\n");
+	hist_print(&hist);
+
+	header.kind = REQUEST_STATS;
+	if (write_full(fd, &header, sizeof(Header))
+	    && read_full(fd, &stats, sizeof(Stats)))
+		printf("Server: model version %llu, %llu requests, %.0f qps, "
+		       "p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		       (unsigned long long)stats.version,
+		       (unsigned long long)stats.count, stats.qps, stats.p50,
+		       stats.p99, stats.max);
+	if (stats.cache_hit + stats.cache_miss)
+		printf("Server cache: %llu hits, %llu misses (%.1f%%)\n",
+		       (unsigned long long)stats.cache_hit,
+		       (unsigned long long)stats.cache_miss,
+		       100.0 * stats.cache_hit
+		       / (stats.cache_hit + stats.cache_miss));
+	close(fd);
+	free(worker);
+	free(thread);
+	return fail_num ? 1 : 0;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+int client_main(void *arg)
+{
+	Client *this = (Client*)arg;
+	int fd = connect_to(this->path);
+	if (fd < 0) {
+		this->fail = this->num;
+		return 0;
+	}
+	float *input = (float*)malloc(sizeof(float) * (this->size + 1));
+	float *output = NULL;
+	size_t output_size = 0;
+	if (!input)
+		goto fail;
+	for (size_t i = 0; i < this->num; i++) {
+		/* 第`i`个请求取计数器`[i * size, (i + 1) * size)`，各请求互不重叠 */
+		size_t index = this->distinct ? i % this->distinct : i;
+		rand_fill_uniform_at(input, this->size, this->seed,
+		                     index * this->size, 0.0, 1.0);
+		Header header = {.kind = REQUEST_PREDICT, .size = this->size};
+		Reply reply;
+		double start = timer_now();
+		if (!write_full(fd, &header, sizeof(Header))
+		    || !write_full(fd, input, sizeof(float) * this->size)
+		    || !read_full(fd, &reply, sizeof(Reply)))
+			break;
+		if (reply.size > output_size) {
+			free(output);
+			output_size = reply.size;
+			output = (float*)malloc(sizeof(float) * output_size);
+			if (!output)
+				goto fail;
+		}
+		if (!read_full(fd, output, sizeof(float) * reply.size))
+			break;
+		hist_add(&this->hist, (timer_now() - start) * 1e6);
+		if (reply.status != STATUS_OK)
+			this->fail++;
+	}
+	this->fail += this->num - this->hist.total;
+	close(fd);
+	free(input);
+	free(output);
+	return 0;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+int connect_to(char *path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool read_full(int fd, void *buf, size_t size)
+{
+	char *p = (char*)buf;
+	while (size) {
+		ssize_t n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool write_full(int fd, const void *buf, size_t size)
+{
+	const char *p = (const char*)buf;
+	while (size) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+void hist_add(Histogram *hist, double us)
+{
+	size_t index = 0;
+	if (us >= 1.0)
+		index = (size_t)(log2(us) * HIST_SUB) + 1;
+	if (index >= HIST_SIZE)
+		index = HIST_SIZE - 1;
+	hist->count[index]++;
+	hist->total++;
+	if (us > hist->max)
+		hist->max = us;
+}
+
+void hist_merge(Histogram *hist, Histogram *target)
+{
+	for (size_t i = 0; i < HIST_SIZE; i++)
+		hist->count[i] += target->count[i];
+	hist->total += target->total;
+	if (target->max > hist->max)
+		hist->max = target->max;
+}
+
+/* 取所在桶的上界，相对误差不超过`2^(1/HIST_SUB) - 1`，约 9% */
+double hist_percentile(Histogram *hist, double p)
+{
+	if (!hist->total)
+		return 0.0;
+	uint64_t rank = (uint64_t)ceil(p * hist->total);
+	uint64_t sum = 0;
+	for (size_t i = 0; i < HIST_SIZE; i++) {
+		sum += hist->count[i];
+		if (sum >= rank && sum) {
+			double upper = pow(2.0, (double)i / HIST_SUB);
+			return upper < hist->max ? upper : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+/* 按倍频程合并打印 */
+void hist_print(Histogram *hist)
+{
+	printf("  p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, "
+	       "max %.1f us\n", hist_percentile(hist, 0.5),
+	       hist_percentile(hist, 0.9), hist_percentile(hist, 0.99),
+	       hist_percentile(hist, 0.999), hist->max);
+	for (size_t octave = 0; octave * HIST_SUB < HIST_SIZE; octave++) {
+		uint64_t count = 0;
+		for (size_t i = octave * HIST_SUB; i < (octave + 1) * HIST_SUB; i++)
+			count += hist->count[i];
+		if (!count)
+			continue;
+		size_t width = (size_t)(50.0 * count / hist->total + 0.5);
+		printf("  < %8.0f us %10llu ", pow(2.0, octave + 1),
+		       (unsigned long long)count);
+		for (size_t i = 0; i < width; i++)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+void on_reload(int sig)
+{
+	(void)sig;
+	reload = 1;
+}
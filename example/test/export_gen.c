@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include "mlp.h"
+#include "export_net.h"
+
+/*
+ * 构建时将`export_net`导出为`<path>.c`/`<path>.h`，供`test_export`编译。
+ *
+ * 用法：
+ *   export_gen <path>
+ */
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		printf("Usage: %s <path>\n", argv[0]);
+		return 1;
+	}
+	MLPNet *net = export_net();
+	bool ok = net->export_c(net, argv[1], "exported");
+	net->free(net);
+	if (!ok) {
+		printf("Cannot export to: %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
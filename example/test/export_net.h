@@ -0,0 +1,41 @@
+#ifndef EXPORT_NET_H_
+#define EXPORT_NET_H_
+
+#include "vector.h"
+#include "mlp.h"
+#include "actf.h"
+#include "lossf.h"
+#include "rand.h"
+
+#define EXPORT_NET_SEED 7  /* 初始化网络的种子 */
+
+/**
+ * @brief  创建导出测试所用的网络，每次调用结果相同
+ *
+ * 三层分别使用 sigmoid、ReLU 与恒等函数，偏置非零。
+ *
+ * @return `[OWN]``MLPNet`指针
+ */
+static inline MLPNet *export_net(void)
+{
+	FCLayer *layer[3] = {
+		new_fc_layer(20, 12, NULL, NULL, sigmoid, d_sigmoid),
+		new_fc_layer(12, 8, NULL, NULL, relu, d_relu),
+		new_fc_layer(8, 5, NULL, NULL, id, d_id),
+	};
+	MLPNet *net = new_mlp_net(3, layer, mse_loss, d_mse_loss);
+	for (size_t i = 0; i < 3; i++)
+		layer[i]->free(layer[i]);
+	net->init(net, MLP_INIT_HE_NORMAL, EXPORT_NET_SEED);
+	/* 各层偏置依次取不重叠的下标 */
+	size_t offset = 0;
+	for (size_t i = 0; i < net->size; i++) {
+		Vector *bias = net->layer[i]->fc->bias;
+		rand_fill_uniform_at(bias->val, bias->size, EXPORT_NET_SEED, offset,
+		                     -0.5, 0.5);
+		offset += bias->size;
+	}
+	return net;
+}
+
+#endif  /* EXPORT_NET_H_ */
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "vector.h"
+#include "mlp.h"
+#include "trainer.h"
+#include "comm.h"
+#include "actf.h"
+#include "lossf.h"
+#include "rand.h"
+
+/*
+ * 以`fork`启动多个进程经 Unix 域套接字组成环，检查`Comm::allreduce`
+ * 所得恰为各进程梯度之和，以及设置了`comm`的`Trainer`训练后各进程参数逐位相同。
+ *
+ * 各进程将结果写入管道，由父进程汇总比较。
+ */
+
+#define RANK_NUM 3        /* 进程数 */
+#define SAMPLE_NUM 300    /* 训练集的样本数 */
+#define INPUT_SIZE 20     /* 输入大小 */
+#define CLASS_NUM 4       /* 类别数 */
+
+/* 一个进程的结果 */
+typedef struct {
+	int fail;             /* `allreduce`是否出错 */
+	float loss;           /* 本进程样本最后一轮的平均损失 */
+	uint64_t hash;        /* 训练后参数的散列 */
+} Result;
+
+static Vector *input[SAMPLE_NUM];
+static Vector *label[SAMPLE_NUM];
+
+static MLPNet *new_net(void)
+{
+	FCLayer *layer[2] = {
+		new_fc_layer(INPUT_SIZE, 32, NULL, NULL, relu, d_relu),
+		new_fc_layer(32, CLASS_NUM, NULL, NULL, sigmoid, d_sigmoid),
+	};
+	MLPNet *net = new_mlp_net(2, layer, mse_loss, d_mse_loss);
+	for (size_t i = 0; i < 2; i++)
+		layer[i]->free(layer[i]);
+	return net;
+}
+
+/* FNV-1a 散列 */
+static uint64_t hash(const void *data, size_t size)
+{
+	const unsigned char *byte = (const unsigned char*)data;
+	uint64_t result = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		result ^= byte[i];
+		result *= 0x100000001b3ULL;
+	}
+	return result;
+}
+
+/**
+ * @brief  一个进程的工作
+ * @param  path 套接字路径的前缀
+ * @param  rank 本进程的序号
+ * @return 本进程的结果
+ */
+static Result run_rank(char *path, size_t rank)
+{
+	Result result = {.fail = 1, .loss = 0.0, .hash = 0};
+	Transport *transport = new_socket_transport(path, rank, RANK_NUM);
+	if (!transport) {
+		printf("rank %zu: no transport\n", rank);
+		return result;
+	}
+	MLPNet *net = new_net();
+	/* 各进程初值不同，由`Trainer`开始时的广播统一 */
+	net->init(net, MLP_INIT_XAVIER_UNIFORM, 1 + rank);
+	Comm *comm = new_comm(net, transport);
+
+	/* 梯度取小整数，求和没有舍入，结果应与逐项相加完全相同 */
+	MLPGrad *grad = new_mlp_grad(net);
+	for (size_t i = 0; i < grad->param_size; i++)
+		grad->param[i] = (float)((rank + 1) * (i % 7));
+	grad->norm2 = -1.0;
+	comm->allreduce(comm, grad);
+	size_t wrong = 0;
+	for (size_t i = 0; i < grad->param_size; i++) {
+		float sum = 0.0;
+		for (size_t r = 0; r < RANK_NUM; r++)
+			sum += (float)((r + 1) * (i % 7));
+		wrong += grad->param[i] != sum;
+	}
+	if (wrong)
+		printf("rank %zu: allreduce differs from the sum at %zu/%zu\n",
+		       rank, wrong, grad->param_size);
+	grad->free(grad);
+
+	Dataset *data = new_dataset(SAMPLE_NUM, input, label);
+	Trainer *trainer = new_trainer(net, 2, 16, 0.5);
+	trainer->comm = comm;
+	trainer->report_interval = 0;
+	trainer->train(trainer, data);
+	result.fail = wrong != 0;
+	result.loss = trainer->loss;
+	result.hash = hash(net->param, sizeof(float) * net->param_size);
+
+	trainer->free(trainer);
+	data->free(data);
+	comm->free(comm);
+	net->free(net);
+	return result;
+}
+
+int main(void)
+{
+	/* 样本在创建进程前生成，各进程相同 */
+	rand_seed(7);
+	float center[CLASS_NUM][INPUT_SIZE];
+	for (size_t c = 0; c < CLASS_NUM; c++)
+		for (size_t d = 0; d < INPUT_SIZE; d++)
+			center[c][d] = rand_uniform(-1.0, 1.0);
+	for (size_t k = 0; k < SAMPLE_NUM; k++) {
+		size_t c = k % CLASS_NUM;
+		input[k] = new_vector(INPUT_SIZE, NULL);
+		label[k] = new_vector(CLASS_NUM, NULL);
+		for (size_t d = 0; d < INPUT_SIZE; d++)
+			input[k]->val[d] = center[c][d] + rand_uniform(-0.5, 0.5);
+		label[k]->val[c] = 1.0;
+	}
+
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/mlp_test_comm.%ld",
+	         (long)getpid());
+	int pipe_fd[2];
+	if (pipe(pipe_fd)) {
+		printf("FAIL: pipe\n");
+		return 1;
+	}
+	fflush(stdout);
+	pid_t pid[RANK_NUM];
+	for (size_t r = 0; r < RANK_NUM; r++) {
+		pid[r] = fork();
+		if (pid[r] == 0) {
+			close(pipe_fd[0]);
+			Result result = run_rank(path, r);
+			ssize_t n = write(pipe_fd[1], &result, sizeof(Result));
+			fflush(stdout);
+			_exit(n == (ssize_t)sizeof(Result) ? 0 : 1);
+		}
+		if (pid[r] < 0) {
+			printf("FAIL: fork\n");
+			return 1;
+		}
+	}
+	close(pipe_fd[1]);
+
+	int fail = 0;
+	Result result[RANK_NUM];
+	size_t num = 0;
+	while (num < RANK_NUM && read(pipe_fd[0], result + num, sizeof(Result))
+	                         == (ssize_t)sizeof(Result))
+		num++;
+	close(pipe_fd[0]);
+	for (size_t r = 0; r < RANK_NUM; r++) {
+		int status;
+		if (waitpid(pid[r], &status, 0) != pid[r] || !WIFEXITED(status)
+		    || WEXITSTATUS(status) != 0) {
+			printf("FAIL: rank process %zu exited abnormally\n", r);
+			fail = 1;
+		}
+	}
+	if (num != RANK_NUM) {
+		printf("FAIL: %zu of %d ranks reported\n", num, RANK_NUM);
+		fail = 1;
+	}
+	for (size_t r = 0; r < num; r++) {
+		printf("loss %.4f, params %016llx\n", result[r].loss,
+		       (unsigned long long)result[r].hash);
+		if (result[r].fail) {
+			printf("FAIL: allreduce is not the sum\n");
+			fail = 1;
+		}
+		if (result[r].hash != result[0].hash) {
+			printf("FAIL: params differ between ranks\n");
+			fail = 1;
+		}
+	}
+
+	for (size_t k = 0; k < SAMPLE_NUM; k++) {
+		input[k]->free(input[k]);
+		label[k]->free(label[k]);
+	}
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "vector.h"
+#include "mlp.h"
+#include "actf.h"
+#include "lossf.h"
+#include "rand.h"
+#include "export_net.h"
+#include "exported.h"
+
+/*
+ * 检查`MLPNet::export_c`生成的`exported_predict`与`MLPNet::forward`一致，
+ * 以及无法识别的激活函数不会被导出。
+ */
+
+#define SAMPLE_NUM 1000  /* 比较的输入数 */
+#define TOLERANCE 1e-5   /* 允许的最大绝对误差 */
+
+/* 与 ReLU 在原先用于识别的采样点上取值相同的自定义激活函数 */
+static float relu6(float x)
+{
+	return x < 0 ? 0 : x > 6 ? 6 : x;
+}
+
+static float d_relu6(float x)
+{
+	return x < 0 || x > 6 ? 0 : 1;
+}
+
+int main(void)
+{
+	int fail = 0;
+	MLPNet *net = export_net();
+	Vector *input = new_vector(exported_IN_SIZE, NULL);
+	float output[exported_OUT_SIZE];
+	float max_diff = 0.0;
+	for (size_t k = 0; k < SAMPLE_NUM; k++) {
+		rand_fill_uniform_at(input->val, input->size, 1, k * input->size,
+		                     -2.0, 2.0);
+		net->forward(net, input);
+		exported_predict(input->val, output);
+		Vector *ref = net->output(net);
+		for (size_t j = 0; j < exported_OUT_SIZE; j++)
+			max_diff = fmaxf(max_diff, fabsf(output[j] - ref->val[j]));
+	}
+	printf("export: %d inputs, max |diff| %g\n", SAMPLE_NUM, max_diff);
+	if (!(max_diff <= TOLERANCE)) {
+		printf("FAIL: exported predict differs from MLPNet::forward\n");
+		fail = 1;
+	}
+	input->free(input);
+	net->free(net);
+
+	if (actf_find(sigmoid) != 0 || actf_find(relu) != 1
+	    || actf_find(id) != 2 || actf_find(relu6) != -1) {
+		printf("FAIL: actf_find\n");
+		fail = 1;
+	}
+	FCLayer *layer = new_fc_layer(4, 2, NULL, NULL, relu6, d_relu6);
+	MLPNet *custom = new_mlp_net(1, &layer, mse_loss, d_mse_loss);
+	layer->free(layer);
+	if (custom->export_c(custom, "test_export_custom", "custom")) {
+		printf("FAIL: custom activation exported\n");
+		remove("test_export_custom.h");
+		remove("test_export_custom.c");
+		fail = 1;
+	}
+	custom->free(custom);
+
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
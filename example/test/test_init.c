@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "mlp.h"
+#include "actf.h"
+#include "lossf.h"
+
+/*
+ * 检查`MLPNet::init`：同一种子结果相同；不同种子（含相邻种子）以及同一网络的
+ * 不同层所得权重互不相关，也不是彼此按下标异或后的重排。
+ */
+
+#define WIDTH 128           /* 各层宽度 */
+#define LAYER_NUM 3         /* 层数 */
+#define MAX_CORR 0.05       /* 允许的最大相关系数，约为标准差的 6 倍 */
+#define XOR_RANGE 64        /* 检查的下标异或量`[0, XOR_RANGE)` */
+#define MAX_MATCH 4         /* 按下标异或后允许的相同值个数 */
+
+static MLPNet *new_net(MLPInit kind, uint64_t seed)
+{
+	FCLayer *layer[LAYER_NUM];
+	for (size_t i = 0; i < LAYER_NUM; i++)
+		layer[i] = new_fc_layer(WIDTH, WIDTH, NULL, NULL, relu, d_relu);
+	MLPNet *net = new_mlp_net(LAYER_NUM, layer, mse_loss, d_mse_loss);
+	for (size_t i = 0; i < LAYER_NUM; i++)
+		layer[i]->free(layer[i]);
+	net->init(net, kind, seed);
+	return net;
+}
+
+/* 按列存储的权重，`Matrix`各列的存储不一定连续，故逐个取出 */
+static void weights(MLPNet *net, size_t index, float *val)
+{
+	Matrix *weight = net->layer[index]->fc->weight;
+	for (size_t c = 0; c < weight->col; c++)
+		memcpy(val + c * weight->row, weight->val[c]->val,
+		       sizeof(float) * weight->row);
+}
+
+/**
+ * @brief  比较两组权重
+ * @param  name 名称
+ * @param  a    `[IN]`权重
+ * @param  b    `[IN]`权重
+ * @param  size 长度
+ * @return 互不相关时为`0`
+ */
+static int check(char *name, const float *a, const float *b, size_t size)
+{
+	double mean[2] = {0.0, 0.0};
+	for (size_t i = 0; i < size; i++) {
+		mean[0] += a[i];
+		mean[1] += b[i];
+	}
+	mean[0] /= size;
+	mean[1] /= size;
+	double ab = 0.0, aa = 0.0, bb = 0.0;
+	for (size_t i = 0; i < size; i++) {
+		ab += (a[i] - mean[0]) * (b[i] - mean[1]);
+		aa += (a[i] - mean[0]) * (a[i] - mean[0]);
+		bb += (b[i] - mean[1]) * (b[i] - mean[1]);
+	}
+	double corr = ab / sqrt(aa * bb);
+
+	size_t max_match = 0;
+	size_t max_xor = 0;
+	for (size_t d = 0; d < XOR_RANGE; d++) {
+		size_t match = 0;
+		for (size_t i = 0; i < size; i++)
+			match += (i ^ d) < size && a[i] == b[i ^ d];
+		if (match > max_match) {
+			max_match = match;
+			max_xor = d;
+		}
+	}
+	printf("%-26s corr %+.4f, most matches %zu (index ^ %zu)\n", name,
+	       corr, max_match, max_xor);
+	if (!(fabs(corr) <= MAX_CORR) || max_match > MAX_MATCH) {
+		printf("FAIL: %s are related\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int fail = 0;
+	size_t size = WIDTH * WIDTH;
+	float a[WIDTH * WIDTH];
+	float b[WIDTH * WIDTH];
+	MLPInit kind[2] = {MLP_INIT_XAVIER_UNIFORM, MLP_INIT_HE_NORMAL};
+	char *kind_name[2] = {"xavier uniform", "he normal"};
+	uint64_t seed[][2] = {
+		{1, 2}, {5, 6}, {0, 1}, {1, 3}, {7, 7 ^ (1 << 20)},
+	};
+	size_t seed_num = sizeof(seed) / sizeof(seed[0]);
+
+	for (size_t k = 0; k < 2; k++) {
+		char name[64];
+		MLPNet *net = new_net(kind[k], 1);
+		MLPNet *same = new_net(kind[k], 1);
+		if (memcmp(net->param, same->param,
+		           sizeof(float) * net->param_size) != 0) {
+			printf("FAIL: %s, same seed differs\n", kind_name[k]);
+			fail = 1;
+		}
+		same->free(same);
+		for (size_t i = 0; i + 1 < LAYER_NUM; i++) {
+			weights(net, i, a);
+			weights(net, i + 1, b);
+			snprintf(name, sizeof(name), "%s, layer %zu/%zu",
+			         kind_name[k], i, i + 1);
+			fail |= check(name, a, b, size);
+		}
+		net->free(net);
+
+		for (size_t s = 0; s < seed_num; s++) {
+			MLPNet *x = new_net(kind[k], seed[s][0]);
+			MLPNet *y = new_net(kind[k], seed[s][1]);
+			weights(x, 0, a);
+			weights(y, 0, b);
+			snprintf(name, sizeof(name), "%s, seed %llu/%llu",
+			         kind_name[k], (unsigned long long)seed[s][0],
+			         (unsigned long long)seed[s][1]);
+			fail |= check(name, a, b, size);
+			x->free(x);
+			y->free(y);
+		}
+	}
+
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
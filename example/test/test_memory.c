@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#ifdef __GLIBC__
+#include <malloc.h>  /* malloc_usable_size */
+#endif
+#include "vector.h"
+#include "mlp.h"
+#include "layer.h"
+#include "trainer.h"
+#include "actf.h"
+#include "lossf.h"
+#include "pool.h"
+
+/*
+ * 以链接器包装（`-Wl,--wrap=malloc`等）统计实际的分配，检查各`memory`
+ * 的合计与分配次数，以及释放后不残留分配。
+ *
+ * 统计与`mem_track`在 glibc 下的口径相同：每块计`malloc_usable_size`加
+ * 块头，两者应完全相等。非 glibc 平台`mem_track`按规则估计，跳过。
+ */
+
+#define SKIP 77           /* 跳过时的返回值，见`SKIP_RETURN_CODE` */
+#define SAMPLE_NUM 100    /* 数据集的样本数 */
+
+/* 某一时刻的实际分配 */
+typedef struct {
+	size_t bytes;  /* 占用的字节数，含块头 */
+	size_t num;    /* 分配数 */
+} Usage;
+
+static atomic_size_t live_bytes;
+static atomic_size_t live_num;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t align, size_t size);
+void __real_free(void *ptr);
+
+static size_t chunk(void *ptr)
+{
+#ifdef __GLIBC__
+	return malloc_usable_size(ptr) + sizeof(size_t);
+#else
+	(void)ptr;
+	return 0;
+#endif
+}
+
+static void *track(void *ptr)
+{
+	if (ptr) {
+		atomic_fetch_add(&live_bytes, chunk(ptr));
+		atomic_fetch_add(&live_num, 1);
+	}
+	return ptr;
+}
+
+static void untrack(void *ptr)
+{
+	if (ptr) {
+		atomic_fetch_sub(&live_bytes, chunk(ptr));
+		atomic_fetch_sub(&live_num, 1);
+	}
+}
+
+void *__wrap_malloc(size_t size)
+{
+	return track(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+	return track(__real_calloc(num, size));
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	untrack(ptr);
+	void *result = __real_realloc(ptr, size);
+	/* 失败时原块仍在 */
+	return track(result ? result : size ? ptr : NULL);
+}
+
+void *__wrap_aligned_alloc(size_t align, size_t size)
+{
+	return track(__real_aligned_alloc(align, size));
+}
+
+void __wrap_free(void *ptr)
+{
+	untrack(ptr);
+	__real_free(ptr);
+}
+
+static Usage usage(void)
+{
+	Usage now = {atomic_load(&live_bytes), atomic_load(&live_num)};
+	return now;
+}
+
+/**
+ * @brief  比较`memory`的结果与`start`以来的实际分配
+ * @param  name  名称
+ * @param  stat  `[IN]``memory`的结果
+ * @param  start `[IN]`创建前的实际分配
+ * @return 一致时为`0`
+ */
+static int check(char *name, MemStat *stat, Usage *start)
+{
+	Usage now = usage();
+	size_t bytes = now.bytes - start->bytes;
+	size_t num = now.num - start->num;
+	printf("%-12s reported %8zu B %4zu allocs, "
+	       "measured %8zu B %4zu allocs\n", name, mem_total(stat),
+	       stat->alloc_num, bytes, num);
+	if (mem_total(stat) != bytes || stat->alloc_num != num) {
+		printf("FAIL: %s memory differs from the allocator\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief  检查`start`以来的分配均已释放
+ * @param  name  名称
+ * @param  start `[IN]`创建前的实际分配
+ * @return 无残留时为`0`
+ */
+static int check_free(char *name, Usage *start)
+{
+	Usage now = usage();
+	if (now.bytes != start->bytes || now.num != start->num) {
+		printf("FAIL: %s leaks %zu B in %zu allocs\n", name,
+		       now.bytes - start->bytes, now.num - start->num);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+#ifndef __GLIBC__
+	printf("SKIPPED: needs glibc\n");
+	return SKIP;
+#endif
+	int fail = 0;
+	/* 线程池首次使用时才创建，先创建以免计入 */
+	pool_global();
+
+	/* 全连接网络，含滑动归一化、丢弃与检查点 */
+	FCLayer *layer[3] = {
+		new_fc_layer(784, 16, NULL, NULL, sigmoid, d_sigmoid),
+		new_fc_layer(16, 16, NULL, NULL, relu, d_relu),
+		new_fc_layer(16, 10, NULL, NULL, id, d_id),
+	};
+	layer[1]->runnorm(layer[1]);
+	layer[1]->dropout = 0.25;
+	Usage start = usage();
+	MLPNet *net = new_mlp_net(3, layer, mse_loss, d_mse_loss);
+	MemStat per[3];
+	MemStat stat = net->memory(net, per);
+	fail |= check("net", &stat, &start);
+	MemStat sum = {0};
+	for (size_t i = 0; i < 3; i++)
+		mem_add(&sum, &per[i]);
+	if (mem_total(&sum) > mem_total(&stat)) {
+		printf("FAIL: layers exceed the net\n");
+		fail = 1;
+	}
+	net->set_checkpoint(net, 2);
+	stat = net->memory(net, NULL);
+	fail |= check("checkpoint", &stat, &start);
+
+	Usage grad_start = usage();
+	MLPGrad *grad = new_mlp_grad(net);
+	stat = grad->memory(grad);
+	fail |= check("grad", &stat, &grad_start);
+	grad->free(grad);
+	fail |= check_free("grad", &grad_start);
+	net->free(net);
+	fail |= check_free("net", &start);
+	for (size_t i = 0; i < 3; i++)
+		layer[i]->free(layer[i]);
+
+	/* 异构网络，嵌入层的梯度记录行并按需增长 */
+	FCLayer *block = new_fc_layer(32, 32, NULL, NULL, relu, d_relu);
+	Layer *hetero[3] = {
+		new_embedding_layer(4, 1000, 8),
+		new_residual_layer(block),
+		new_softmax_layer(32),
+	};
+	start = usage();
+	net = new_mlp_net_layers(3, hetero, mse_loss, d_mse_loss);
+	stat = net->memory(net, NULL);
+	fail |= check("hetero net", &stat, &start);
+	net->init(net, MLP_INIT_XAVIER_UNIFORM, 1);
+	Vector *input = new_vector(4, NULL);
+	Vector *label = new_vector(32, NULL);
+	label->val[0] = 1.0;
+	grad_start = usage();
+	grad = new_mlp_grad(net);
+	for (size_t k = 0; k < 64; k++) {
+		for (size_t j = 0; j < 4; j++)
+			input->val[j] = (float)((k * 4 + j) * 37 % 1000);
+		net->forward(net, input);
+		net->grad(net, label, grad);
+	}
+	stat = grad->memory(grad);
+	fail |= check("hetero grad", &stat, &grad_start);
+	input->free(input);
+	label->free(label);
+	grad->free(grad);
+	net->free(net);
+	fail |= check_free("hetero net", &start);
+	for (size_t i = 0; i < 3; i++)
+		hetero[i]->free(hetero[i]);
+	block->free(block);
+
+	/* 数据集，含样本 */
+	start = usage();
+	Vector **x = (Vector**)malloc(sizeof(Vector*) * SAMPLE_NUM);
+	Vector **y = (Vector**)malloc(sizeof(Vector*) * SAMPLE_NUM);
+	Usage sample_start = usage();
+	for (size_t k = 0; k < SAMPLE_NUM; k++) {
+		x[k] = new_vector(784, NULL);
+		y[k] = new_vector(10, NULL);
+	}
+	Dataset *data = new_dataset(SAMPLE_NUM, x, y);
+	stat = data->memory(data, true);
+	fail |= check("dataset", &stat, &sample_start);
+	data->free(data);
+	for (size_t k = 0; k < SAMPLE_NUM; k++) {
+		x[k]->free(x[k]);
+		y[k]->free(y[k]);
+	}
+	free(x);
+	free(y);
+	fail |= check_free("dataset", &start);
+
+	printf(fail ? "FAILED\n" : "PASSED\n");
+	return fail;
+}
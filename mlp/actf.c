@@ -0,0 +1,9 @@
+#include "actf.h"
+
+/* `actf.h`中内联函数的外部定义 */
+extern inline float sigmoid(float x);
+extern inline float d_sigmoid(float x);
+extern inline float id(float x);
+extern inline float d_id(float x);
+extern inline float relu(float x);
+extern inline float d_relu(float x);
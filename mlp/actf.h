@@ -1,11 +1,20 @@
+#ifndef ACTF_H_
+#define ACTF_H_
+
+#include <stddef.h>
 #include <math.h>
 
+/*
+ * 激活函数为具有外部链接的内联函数，外部定义位于`actf.c`，
+ * 调用时可内联，而各编译单元取得的函数地址相同，可直接比较。
+ */
+
 /**
  * @brief  sigmoid 函数
  * @param  x 自变量
  * @return sigmoid(x)
  */
-static inline float sigmoid(float x)
+inline float sigmoid(float x)
 {
 	return 1.0 / (1.0 + expf(-x));
 }
@@ -15,7 +24,7 @@ static inline float sigmoid(float x)
  * @param  x 自变量
  * @return sigmoid'(x)
  */
-static inline float d_sigmoid(float x)
+inline float d_sigmoid(float x)
 {
 	float sx = sigmoid(x);
 	return sx * (1.0 - sx);
@@ -26,7 +35,7 @@ static inline float d_sigmoid(float x)
  * @param  x 自变量
  * @return id(x)
  */
-static inline float id(float x)
+inline float id(float x)
 {
 	return x;
 }
@@ -36,7 +45,7 @@ static inline float id(float x)
  * @param  x 自变量
  * @return id'(x)
  */
-static inline float d_id(float x)
+inline float d_id(float x)
 {
 	return 1.0;
 }
@@ -46,7 +55,7 @@ static inline float d_id(float x)
  * @param  x 自变量
  * @return ReLU(x)
  */
-static inline float relu(float x)
+inline float relu(float x)
 {
 	return x < 0 ? 0 : x;
 }
@@ -56,7 +65,46 @@ static inline float relu(float x)
  * @param  x 自变量
  * @return ReLU'(x)
  */
-static inline float d_relu(float x)
+inline float d_relu(float x)
 {
 	return x < 0 ? 0 : 1;
 }
+
+#define ACTF_NUM 3
+
+/**
+ * @brief 按序号获取本文件中的激活函数及其导函数
+ * @param index 序号：`0`为 sigmoid，`1`为 ReLU，`2`为恒等函数
+ * @param actf  `[OUT]`激活函数
+ * @param dactf `[OUT]`导函数，传入`NULL`以忽略
+ */
+static inline void actf_get(int index, float (**actf)(float),
+                            float (**dactf)(float))
+{
+	static float (*const func[ACTF_NUM][2])(float) = {
+		{sigmoid, d_sigmoid},
+		{relu, d_relu},
+		{id, d_id},
+	};
+	*actf = func[index][0];
+	if (dactf)
+		*dactf = func[index][1];
+}
+
+/**
+ * @brief  识别激活函数，按函数地址比较，自定义的函数不会被误认
+ * @param  actf 激活函数
+ * @return `actf_get`的序号，不是本文件中的函数时返回`-1`
+ */
+static inline int actf_find(float (*actf)(float))
+{
+	for (int i = 0; i < ACTF_NUM; i++) {
+		float (*known)(float);
+		actf_get(i, &known, NULL);
+		if (actf == known)
+			return i;
+	}
+	return -1;
+}
+
+#endif  /* ACTF_H_ */
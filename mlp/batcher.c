@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "vector.h"
+#include "mlp.h"
+#include "handle.h"
+#include "cache.h"
+#include "batcher.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Batcher *new_batcher(MLPNet *net, size_t max_batch, long max_wait);
+Batcher *new_batcher_handle(ModelHandle *handle, size_t max_batch,
+                            long max_wait);
+static void batcher_free(Batcher *this);
+static size_t batcher_predict(Batcher *this, Vector *input, Vector *prob);
+
+/*** 内部 ***/
+
+static Batcher *batcher_create(MLPNet *net, ModelHandle *handle,
+                               size_t max_batch, long max_wait);
+static int batcher_worker(void *arg);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Batcher *new_batcher(MLPNet *net, size_t max_batch, long max_wait)
+{
+	return batcher_create(net, NULL, max_batch, max_wait);
+}
+
+Batcher *new_batcher_handle(ModelHandle *handle, size_t max_batch,
+                            long max_wait)
+{
+	return batcher_create(NULL, handle, max_batch, max_wait);
+}
+
+static void batcher_free(Batcher *this)
+{
+	mtx_lock(&this->lock);
+	this->stop = true;
+	cnd_signal(&this->arrive);
+	mtx_unlock(&this->lock);
+	thrd_join(this->worker, NULL);
+
+	if (this->handle)
+		this->handle->leave(this->handle, this->reader);
+	mtx_destroy(&this->lock);
+	cnd_destroy(&this->arrive);
+	cnd_destroy(&this->finish);
+	free(this->input);
+	free(this->prob);
+	free(this->res);
+	free(this);
+}
+
+static size_t batcher_predict(Batcher *this, Vector *input, Vector *prob)
+{
+	BatchRequest req = {
+		.input = input,
+		.prob = prob,
+		.done = false,
+		.next = NULL,
+	};
+	if (this->cache) {
+		size_t version = this->handle
+		                 ? atomic_load(&this->handle->version) : 0;
+		if (this->cache->lookup(this->cache, input, version, &req.res, prob))
+			return req.res;
+	}
+	timespec_get(&req.arrival, TIME_UTC);
+
+	mtx_lock(&this->lock);
+	if (this->tail)
+		this->tail->next = &req;
+	else
+		this->head = &req;
+	this->tail = &req;
+	this->len++;
+	cnd_signal(&this->arrive);
+	while (!req.done)
+		cnd_wait(&this->finish, &this->lock);
+	mtx_unlock(&this->lock);
+	return req.res;
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  创建`Batcher`并启动工作线程
+ * @param  net       `[IN]`网络，使用`handle`时为`NULL`
+ * @param  handle    `[IN]`可热替换的模型，可为`NULL`
+ * @param  max_batch 最大批大小
+ * @param  max_wait  最长等待时间（微秒）
+ * @return `[OWN]``Batcher`指针
+ */
+static Batcher *batcher_create(MLPNet *net, ModelHandle *handle,
+                               size_t max_batch, long max_wait)
+{
+	Vector **this_input = (Vector**)calloc(max_batch, sizeof(Vector*));
+	Vector **this_prob = (Vector**)calloc(max_batch, sizeof(Vector*));
+	size_t *this_res = (size_t*)calloc(max_batch, sizeof(size_t));
+	if (!this_input || !this_prob || !this_res)
+		goto fail;
+
+	Batcher *this = (Batcher*)malloc(sizeof(Batcher));
+	if (!this)
+		goto fail;
+	*this = (Batcher) {
+		.net = net,
+		.handle = handle,
+		.reader = handle ? handle->join(handle) : NULL,
+		.cache = NULL,
+		.max_batch = max_batch,
+		.max_wait = max_wait,
+		.head = NULL,
+		.tail = NULL,
+		.len = 0,
+		.stop = false,
+		.input = this_input,
+		.prob = this_prob,
+		.res = this_res,
+
+		.free = batcher_free,
+		.predict = batcher_predict,
+	};
+	if (mtx_init(&this->lock, mtx_plain) != thrd_success
+	    || cnd_init(&this->arrive) != thrd_success
+	    || cnd_init(&this->finish) != thrd_success
+	    || thrd_create(&this->worker, batcher_worker, this) != thrd_success)
+		goto thrd_fail;
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+/**
+ * @brief  工作线程，收集请求并整批推理
+ * @param  arg `[INOUT]``Batcher`指针
+ * @return `0`
+ */
+static int batcher_worker(void *arg)
+{
+	Batcher *this = (Batcher*)arg;
+	BatchRequest *batch;
+
+	mtx_lock(&this->lock);
+	for (;;) {
+		while (!this->head && !this->stop)
+			cnd_wait(&this->arrive, &this->lock);
+		if (!this->head)
+			break;
+
+		/* 等待凑满一批或队首请求超时 */
+		struct timespec deadline = this->head->arrival;
+		deadline.tv_nsec += this->max_wait % 1000000 * 1000;
+		deadline.tv_sec += this->max_wait / 1000000
+		                   + deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		while (this->len < this->max_batch && !this->stop)
+			if (cnd_timedwait(&this->arrive, &this->lock, &deadline)
+			    == thrd_timedout)
+				break;
+
+		/* 取出一批 */
+		size_t num = 0;
+		batch = this->head;
+		BatchRequest *req = batch;
+		for (; num < this->max_batch && req; num++) {
+			this->input[num] = req->input;
+			this->prob[num] = req->prob;
+			req = req->next;
+		}
+		this->head = req;
+		if (!req)
+			this->tail = NULL;
+		this->len -= num;
+		mtx_unlock(&this->lock);
+
+		MLPNet *net = this->net;
+		if (this->handle)
+			net = this->handle->acquire(this->handle, this->reader);
+		net->predict_batch(net, this->input, num, this->res, this->prob);
+		size_t version = this->handle ? this->reader->version : 0;
+		if (this->handle)
+			this->handle->release(this->handle, this->reader);
+		if (this->cache)
+			for (size_t i = 0; i < num; i++)
+				this->cache->insert(this->cache, this->input[i], version,
+				                    this->res[i], this->prob[i]);
+
+		mtx_lock(&this->lock);
+		for (size_t i = 0; i < num; i++) {
+			BatchRequest *next = batch->next;
+			batch->res = this->res[i];
+			batch->version = version;
+			batch->done = true;
+			batch = next;
+		}
+		cnd_broadcast(&this->finish);
+	}
+	mtx_unlock(&this->lock);
+	return 0;
+}
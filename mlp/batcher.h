@@ -0,0 +1,90 @@
+#ifndef BATCHER_H_
+#define BATCHER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <threads.h>
+#include "vector.h"
+#include "mlp.h"
+#include "handle.h"
+#include "cache.h"
+
+typedef struct Batcher Batcher;
+typedef struct BatchRequest BatchRequest;
+
+/***** BatchRequest *****/
+
+struct BatchRequest {
+	Vector *input;       /* 输入 */
+	Vector *prob;        /* 输出层，可为`NULL` */
+	size_t res;          /* 最大输出下标 */
+	size_t version;      /* 所用模型的版本号，未使用`ModelHandle`时为`0` */
+	bool done;           /* 是否完成 */
+	struct timespec arrival;  /* 到达时间 */
+	BatchRequest *next;  /* 队列中的下一请求 */
+};
+
+/***** Batcher *****/
+
+struct Batcher {
+	MLPNet *net;          /* 网络，使用`handle`时为`NULL` */
+	ModelHandle *handle;  /* 可热替换的模型，为`NULL`时使用`net` */
+	ModelReader *reader;  /* 工作线程在`handle`中的读者 */
+	Cache *cache;         /* 推理结果的缓存，为`NULL`时不缓存，须在首次`predict`前设置 */
+	size_t max_batch;     /* 最大批大小 */
+	long max_wait;        /* 最长等待时间（微秒） */
+	BatchRequest *head;   /* 队首 */
+	BatchRequest *tail;   /* 队尾 */
+	size_t len;           /* 队列长度 */
+	bool stop;            /* 是否停止 */
+	mtx_t lock;           /* 队列锁 */
+	cnd_t arrive;         /* 新请求到达 */
+	cnd_t finish;         /* 一批请求完成 */
+	thrd_t worker;        /* 工作线程 */
+	Vector **input;       /* 当前批的输入 */
+	Vector **prob;        /* 当前批的输出层 */
+	size_t *res;          /* 当前批的结果 */
+
+	/**
+	 * @brief 停止工作线程并销毁`Batcher`，不销毁`net`与`cache`
+	 */
+	void (*free)(Batcher *this);
+
+	/**
+	 * @brief  提交单个请求并等待结果，可由多个线程并发调用
+	 *
+	 * 并发的请求会被合并为一批，由`MLPNet::predict_batch`处理。
+	 * 使用`handle`时每批在读区内取得当前模型，同一批的请求使用同一版本。
+	 * 设置了`cache`时先按最新的版本号查询，命中则不入队；推理结果按所用版本插入。
+	 *
+	 * @param  input `[IN]`输入
+	 * @param  prob  `[OUT]`输出层，传入`NULL`以忽略
+	 * @return 最大输出下标
+	 */
+	size_t (*predict)(Batcher *this, Vector *input, Vector *prob);
+};
+
+/**
+ * @brief  创建`Batcher`
+ *
+ * 队首请求等待满`max_wait`微秒或队列达到`max_batch`时，整批送入网络。
+ *
+ * @param  net       `[IN]`网络，须在`Batcher`销毁后再销毁
+ * @param  max_batch 最大批大小
+ * @param  max_wait  最长等待时间（微秒）
+ * @return `[OWN]``Batcher`指针
+ */
+Batcher *new_batcher(MLPNet *net, size_t max_batch, long max_wait);
+
+/**
+ * @brief  创建使用可热替换模型的`Batcher`，其余同`new_batcher`
+ * @param  handle    `[IN]`模型，须在`Batcher`销毁后再销毁
+ * @param  max_batch 最大批大小
+ * @param  max_wait  最长等待时间（微秒）
+ * @return `[OWN]``Batcher`指针
+ */
+Batcher *new_batcher_handle(ModelHandle *handle, size_t max_batch,
+                            long max_wait);
+
+#endif  /* BATCHER_H_ */
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+#include "vector.h"
+#include "cache.h"
+
+#define NONE SIZE_MAX  /* 空下标 */
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Cache *new_cache(size_t capacity, size_t shard_num, size_t input_size,
+                 size_t output_size);
+static void cache_free(Cache *this);
+static bool cache_lookup(Cache *this, Vector *input, size_t version,
+                         size_t *res, Vector *prob);
+static void cache_insert(Cache *this, Vector *input, size_t version,
+                         size_t res, Vector *prob);
+static void cache_clear(Cache *this);
+static CacheStats cache_stats(Cache *this);
+static void cache_print(Cache *this);
+
+/*** 内部 ***/
+
+static size_t round_pow2(size_t n);
+static uint64_t hash_input(const float *val, size_t size);
+static CacheShard *shard_of(Cache *this, uint64_t hash);
+static void shard_reset(CacheShard *shard);
+static void shard_renew(CacheShard *shard, size_t version);
+static size_t shard_find(Cache *this, CacheShard *shard, uint64_t hash,
+                         const float *val);
+static void shard_unlink(CacheShard *shard, size_t index);
+static void shard_push(CacheShard *shard, size_t index);
+static void shard_unchain(CacheShard *shard, size_t index);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Cache *new_cache(size_t capacity, size_t shard_num, size_t input_size,
+                 size_t output_size)
+{
+	shard_num = round_pow2(shard_num);
+	size_t per = (capacity + shard_num - 1) / shard_num;
+	if (!per)
+		per = 1;
+	size_t stride = input_size + output_size;
+
+	Cache *this = (Cache*)malloc(sizeof(Cache));
+	CacheShard *this_shard = (CacheShard*)calloc(shard_num,
+	                                             sizeof(CacheShard));
+	if (!this || !this_shard)
+		goto fail;
+	*this = (Cache) {
+		.shard_num = shard_num,
+		.input_size = input_size,
+		.output_size = output_size,
+		.shard = this_shard,
+
+		.free = cache_free,
+		.lookup = cache_lookup,
+		.insert = cache_insert,
+		.clear = cache_clear,
+		.stats = cache_stats,
+		.print = cache_print,
+	};
+	for (size_t i = 0; i < shard_num; i++) {
+		CacheShard *shard = this_shard + i;
+		shard->capacity = per;
+		shard->bucket_num = round_pow2(per);
+		shard->bucket = (size_t*)malloc(sizeof(size_t) * shard->bucket_num);
+		shard->hash = (uint64_t*)malloc(sizeof(uint64_t) * per);
+		shard->chain = (size_t*)malloc(sizeof(size_t) * per);
+		shard->prev = (size_t*)malloc(sizeof(size_t) * per);
+		shard->next = (size_t*)malloc(sizeof(size_t) * per);
+		shard->res = (size_t*)malloc(sizeof(size_t) * per);
+		shard->has_prob = (bool*)malloc(sizeof(bool) * per);
+		shard->data = (float*)malloc(sizeof(float) * stride * per + 1);
+		if (!shard->bucket || !shard->hash || !shard->chain || !shard->prev
+		    || !shard->next || !shard->res || !shard->has_prob
+		    || !shard->data)
+			goto fail;
+		shard_reset(shard);
+		if (mtx_init(&shard->lock, mtx_plain) != thrd_success)
+			goto thrd_fail;
+	}
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+static void cache_free(Cache *this)
+{
+	for (size_t i = 0; i < this->shard_num; i++) {
+		CacheShard *shard = this->shard + i;
+		free(shard->bucket);
+		free(shard->hash);
+		free(shard->chain);
+		free(shard->prev);
+		free(shard->next);
+		free(shard->res);
+		free(shard->has_prob);
+		free(shard->data);
+		mtx_destroy(&shard->lock);
+	}
+	free(this->shard);
+	free(this);
+}
+
+static bool cache_lookup(Cache *this, Vector *input, size_t version,
+                         size_t *res, Vector *prob)
+{
+	if (input->size != this->input_size)
+		return false;
+	uint64_t hash = hash_input(input->val, input->size);
+	CacheShard *shard = shard_of(this, hash);
+	size_t stride = this->input_size + this->output_size;
+	bool hit = false;
+
+	mtx_lock(&shard->lock);
+	if (version > shard->version)
+		shard_renew(shard, version);
+	if (version == shard->version) {
+		size_t index = shard_find(this, shard, hash, input->val);
+		if (index != NONE && (!prob || shard->has_prob[index])) {
+			hit = true;
+			*res = shard->res[index];
+			if (prob)
+				prob->set(prob, this->output_size, shard->data
+				          + index * stride + this->input_size);
+			shard_unlink(shard, index);
+			shard_push(shard, index);
+		}
+	}
+	if (hit)
+		shard->hit++;
+	else
+		shard->miss++;
+	mtx_unlock(&shard->lock);
+	return hit;
+}
+
+static void cache_insert(Cache *this, Vector *input, size_t version,
+                         size_t res, Vector *prob)
+{
+	if (input->size != this->input_size
+	    || (prob && prob->size != this->output_size))
+		return;
+	uint64_t hash = hash_input(input->val, input->size);
+	CacheShard *shard = shard_of(this, hash);
+	size_t stride = this->input_size + this->output_size;
+
+	mtx_lock(&shard->lock);
+	if (version > shard->version)
+		shard_renew(shard, version);
+	if (version < shard->version) {
+		mtx_unlock(&shard->lock);
+		return;
+	}
+	size_t index = shard_find(this, shard, hash, input->val);
+	if (index != NONE) {
+		shard_unlink(shard, index);
+	} else {
+		if (shard->free_head != NONE) {
+			index = shard->free_head;
+			shard->free_head = shard->next[index];
+			shard->len++;
+		} else {
+			index = shard->tail;
+			shard_unlink(shard, index);
+			shard_unchain(shard, index);
+			shard->evict++;
+		}
+		size_t *head = shard->bucket + (hash & (shard->bucket_num - 1));
+		shard->hash[index] = hash;
+		shard->chain[index] = *head;
+		*head = index;
+		shard->has_prob[index] = false;
+		memcpy(shard->data + index * stride, input->val,
+		       sizeof(float) * this->input_size);
+	}
+	shard->res[index] = res;
+	if (prob) {
+		shard->has_prob[index] = true;
+		memcpy(shard->data + index * stride + this->input_size, prob->val,
+		       sizeof(float) * this->output_size);
+	}
+	shard_push(shard, index);
+	shard->insert++;
+	mtx_unlock(&shard->lock);
+}
+
+static void cache_clear(Cache *this)
+{
+	for (size_t i = 0; i < this->shard_num; i++) {
+		CacheShard *shard = this->shard + i;
+		mtx_lock(&shard->lock);
+		shard_reset(shard);
+		mtx_unlock(&shard->lock);
+	}
+}
+
+static CacheStats cache_stats(Cache *this)
+{
+	CacheStats stats = {0};
+	for (size_t i = 0; i < this->shard_num; i++) {
+		CacheShard *shard = this->shard + i;
+		mtx_lock(&shard->lock);
+		stats.hit += shard->hit;
+		stats.miss += shard->miss;
+		stats.insert += shard->insert;
+		stats.evict += shard->evict;
+		stats.invalidate += shard->invalidate;
+		stats.len += shard->len;
+		mtx_unlock(&shard->lock);
+	}
+	return stats;
+}
+
+static void cache_print(Cache *this)
+{
+	CacheStats stats = cache_stats(this);
+	uint64_t total = stats.hit + stats.miss;
+	printf("cache: %zu / %zu entries, %llu hits, %llu misses (%.1f%%), "
+	       "%llu evictions, %llu invalidated\n", stats.len,
+	       this->shard_num * this->shard->capacity,
+	       (unsigned long long)stats.hit, (unsigned long long)stats.miss,
+	       total ? 100.0 * stats.hit / total : 0.0,
+	       (unsigned long long)stats.evict,
+	       (unsigned long long)stats.invalidate);
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  向上取为 2 的幂
+ * @param  n 数
+ * @return 不小于`n`的最小的 2 的幂，`n`为`0`时为`1`
+ */
+static size_t round_pow2(size_t n)
+{
+	size_t pow2 = 1;
+	while (pow2 < n)
+		pow2 <<= 1;
+	return pow2;
+}
+
+/**
+ * @brief  计算输入的哈希值
+ *
+ * 每次取两个`float`的字节拼成 64 位整数混入，最后以 MurmurHash3 的`fmix64`打散。
+ *
+ * @param  val  `[IN]`输入
+ * @param  size 输入大小
+ * @return 哈希值
+ */
+static uint64_t hash_input(const float *val, size_t size)
+{
+	uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+	size_t i = 0;
+	for (; i + 2 <= size; i += 2) {
+		uint64_t word;
+		memcpy(&word, val + i, sizeof(uint64_t));
+		hash ^= word * 0x87c37b91114253d5ULL;
+		hash = (hash << 31 | hash >> 33) * 0x4cf5ad432745937fULL;
+	}
+	if (i < size) {
+		uint32_t word;
+		memcpy(&word, val + i, sizeof(uint32_t));
+		hash ^= word * 0x87c37b91114253d5ULL;
+		hash = (hash << 31 | hash >> 33) * 0x4cf5ad432745937fULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/**
+ * @brief  取哈希值所在的分片，用高位，桶用低位
+ * @param  hash 哈希值
+ * @return 分片
+ */
+static CacheShard *shard_of(Cache *this, uint64_t hash)
+{
+	return this->shard + ((hash >> 40) & (this->shard_num - 1));
+}
+
+/**
+ * @brief 清空分片，不重置统计量与版本号，须持有`lock`
+ * @param shard `[INOUT]`分片
+ */
+static void shard_reset(CacheShard *shard)
+{
+	for (size_t i = 0; i < shard->bucket_num; i++)
+		shard->bucket[i] = NONE;
+	for (size_t i = 0; i < shard->capacity; i++)
+		shard->next[i] = i + 1 < shard->capacity ? i + 1 : NONE;
+	shard->free_head = 0;
+	shard->head = NONE;
+	shard->tail = NONE;
+	shard->len = 0;
+}
+
+/**
+ * @brief 换用更新的模型版本，清空旧版本的条目，须持有`lock`
+ * @param shard   `[INOUT]`分片
+ * @param version 新的版本号
+ */
+static void shard_renew(CacheShard *shard, size_t version)
+{
+	shard->invalidate += shard->len;
+	shard_reset(shard);
+	shard->version = version;
+}
+
+/**
+ * @brief  查找输入所在的条目，须持有`lock`
+ * @param  shard `[IN]`分片
+ * @param  hash  输入的哈希值
+ * @param  val   `[IN]`输入
+ * @return 条目的下标，不存在时为`NONE`
+ */
+static size_t shard_find(Cache *this, CacheShard *shard, uint64_t hash,
+                         const float *val)
+{
+	size_t stride = this->input_size + this->output_size;
+	size_t index = shard->bucket[hash & (shard->bucket_num - 1)];
+	for (; index != NONE; index = shard->chain[index])
+		if (shard->hash[index] == hash
+		    && !memcmp(shard->data + index * stride, val,
+		               sizeof(float) * this->input_size))
+			break;
+	return index;
+}
+
+/**
+ * @brief 自最近使用链表中取下条目，须持有`lock`
+ * @param shard `[INOUT]`分片
+ * @param index 条目的下标
+ */
+static void shard_unlink(CacheShard *shard, size_t index)
+{
+	size_t prev = shard->prev[index];
+	size_t next = shard->next[index];
+	if (prev != NONE)
+		shard->next[prev] = next;
+	else
+		shard->head = next;
+	if (next != NONE)
+		shard->prev[next] = prev;
+	else
+		shard->tail = prev;
+}
+
+/**
+ * @brief 将条目放到最近使用链表的表头，须持有`lock`
+ * @param shard `[INOUT]`分片
+ * @param index 条目的下标
+ */
+static void shard_push(CacheShard *shard, size_t index)
+{
+	shard->prev[index] = NONE;
+	shard->next[index] = shard->head;
+	if (shard->head != NONE)
+		shard->prev[shard->head] = index;
+	else
+		shard->tail = index;
+	shard->head = index;
+}
+
+/**
+ * @brief 自哈希桶中取下条目，须持有`lock`
+ * @param shard `[INOUT]`分片
+ * @param index 条目的下标
+ */
+static void shard_unchain(CacheShard *shard, size_t index)
+{
+	size_t *link = shard->bucket + (shard->hash[index]
+	                                & (shard->bucket_num - 1));
+	while (*link != index)
+		link = shard->chain + *link;
+	*link = shard->chain[index];
+}
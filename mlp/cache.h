@@ -0,0 +1,131 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <threads.h>
+#include "vector.h"
+
+typedef struct CacheShard CacheShard;
+typedef struct Cache Cache;
+
+/***** CacheShard *****/
+
+/*
+ * 缓存的一个分片，各自加锁。
+ *
+ * 条目预先分配，以下标相连：哈希桶内以`chain`成链，
+ * 全部条目按最近使用的顺序以`prev`/`next`成双向链表，空闲条目以`next`成链。
+ */
+struct CacheShard {
+	size_t capacity;   /* 条目数 */
+	size_t bucket_num; /* 哈希桶数，为 2 的幂 */
+	size_t *bucket;    /* 各桶首个条目的下标 */
+	uint64_t *hash;    /* 各条目的哈希值 */
+	size_t *chain;     /* 桶内的下一条目 */
+	size_t *prev;      /* 更近使用的条目 */
+	size_t *next;      /* 更久未用的条目，空闲时为下一空闲条目 */
+	size_t *res;       /* 各条目的最大输出下标 */
+	bool *has_prob;    /* 各条目是否存有输出层 */
+	float *data;       /* 各条目的输入与输出层，依次存放 */
+	size_t head;       /* 最近使用的条目 */
+	size_t tail;       /* 最久未用的条目 */
+	size_t free_head;  /* 首个空闲条目 */
+	size_t len;        /* 已用的条目数 */
+	size_t version;    /* 条目所属的模型版本号 */
+	mtx_t lock;        /* 分片锁 */
+
+	uint64_t hit;         /* 命中次数 */
+	uint64_t miss;        /* 未命中次数 */
+	uint64_t insert;      /* 插入次数 */
+	uint64_t evict;       /* 淘汰次数 */
+	uint64_t invalidate;  /* 因模型版本更新而清空的条目数 */
+};
+
+/***** Cache *****/
+
+/* 缓存的统计量 */
+typedef struct {
+	uint64_t hit;         /* 命中次数 */
+	uint64_t miss;        /* 未命中次数 */
+	uint64_t insert;      /* 插入次数 */
+	uint64_t evict;       /* 淘汰次数 */
+	uint64_t invalidate;  /* 因模型版本更新而清空的条目数 */
+	size_t len;           /* 已用的条目数 */
+} CacheStats;
+
+/*
+ * 推理结果的缓存，以输入的字节与模型版本号为键，按最近最少使用（LRU）淘汰。
+ *
+ * 条目按哈希值分到各分片，各分片独立加锁，并发的查询只在落入同一分片时互相等待。
+ * 哈希值相同时再逐字节比较输入，不会因冲突返回错误的结果。
+ *
+ * 各分片只保存一个版本的条目：以更新的版本号查询或插入时，先清空该分片，
+ * 因此模型替换后旧结果不会被返回，也无需显式地使缓存失效。
+ */
+struct Cache {
+	size_t shard_num;    /* 分片数，为 2 的幂 */
+	size_t input_size;   /* 输入大小 */
+	size_t output_size;  /* 输出大小 */
+	CacheShard *shard;   /* 各分片 */
+
+	/**
+	 * @brief 销毁`Cache`
+	 */
+	void (*free)(Cache *this);
+
+	/**
+	 * @brief  查询，可由多个线程并发调用
+	 * @param  input   `[IN]`输入
+	 * @param  version 当前的模型版本号
+	 * @param  res     `[OUT]`命中时为最大输出下标
+	 * @param  prob    `[OUT]`命中时为输出层，传入`NULL`以忽略；
+	 *                 不为`NULL`时，只有存有输出层的条目才算命中
+	 * @return 是否命中
+	 */
+	bool (*lookup)(Cache *this, Vector *input, size_t version, size_t *res,
+	               Vector *prob);
+
+	/**
+	 * @brief 插入，已存在时更新，分片已满时淘汰最久未用的条目，可由多个线程并发调用
+	 *
+	 * 版本号比分片当前的版本旧时不插入。
+	 *
+	 * @param input   `[IN]`输入
+	 * @param version 求出结果所用的模型版本号
+	 * @param res     最大输出下标
+	 * @param prob    `[IN]`输出层，可为`NULL`
+	 */
+	void (*insert)(Cache *this, Vector *input, size_t version, size_t res,
+	               Vector *prob);
+
+	/**
+	 * @brief 清空全部条目，不重置统计量
+	 */
+	void (*clear)(Cache *this);
+
+	/**
+	 * @brief  汇总各分片的统计量
+	 * @return 统计量
+	 */
+	CacheStats (*stats)(Cache *this);
+
+	/**
+	 * @brief 打印统计量
+	 */
+	void (*print)(Cache *this);
+};
+
+/**
+ * @brief  创建`Cache`
+ * @param  capacity    总条目数，平分到各分片，每个分片至少一个
+ * @param  shard_num   分片数，向上取为 2 的幂
+ * @param  input_size  输入大小
+ * @param  output_size 输出大小
+ * @return `[OWN]``Cache`指针
+ */
+Cache *new_cache(size_t capacity, size_t shard_num, size_t input_size,
+                 size_t output_size);
+
+#endif  /* CACHE_H_ */
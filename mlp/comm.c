@@ -0,0 +1,483 @@
+#ifdef __unix__
+#define _POSIX_C_SOURCE 200809L  /* MSG_NOSIGNAL */
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+#include "mlp.h"
+#include "comm.h"
+#include "timer.h"
+
+#define COMM_CONNECT_TIMEOUT 30.0  /* 建立连接的最长等待（秒） */
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Transport *new_socket_transport(char *path, size_t rank, size_t size);
+
+Comm *new_comm(MLPNet *net, Transport *transport);
+static void comm_free(Comm *this);
+static void comm_broadcast(Comm *this, void *buf, size_t bytes);
+static void comm_begin(Comm *this, MLPGrad *grad, MLPGrad *part);
+static void comm_wait(Comm *this);
+static void comm_allreduce(Comm *this, MLPGrad *grad);
+static void comm_print(Comm *this);
+
+/*** 内部 ***/
+
+#ifdef __unix__
+/* 套接字后端的私有状态 */
+typedef struct {
+	int prev;  /* 来自上一进程的连接，单进程时为`-1` */
+	int next;  /* 通往下一进程的连接，单进程时为`-1` */
+} SocketState;
+
+static void socket_free(Transport *this);
+static bool socket_exchange(Transport *this, const void *out,
+                            size_t send_bytes, void *in, size_t recv_bytes);
+static bool socket_connect(SocketState *state, char *path, size_t rank,
+                           size_t size);
+static bool socket_address(struct sockaddr_un *addr, char *path, size_t rank);
+#endif
+
+static int comm_worker(void *arg);
+static void comm_hook(void *arg, size_t index);
+static size_t reduce(Comm *this, float *val, size_t size);
+static size_t chunk(size_t size, size_t num, size_t index, size_t *len);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Transport *new_socket_transport(char *path, size_t rank, size_t size)
+{
+#ifdef __unix__
+	if (!size || rank >= size)
+		return NULL;
+	SocketState *this_state = (SocketState*)malloc(sizeof(SocketState));
+	if (!this_state)
+		goto fail;
+	*this_state = (SocketState) {.prev = -1, .next = -1};
+	if (size > 1 && !socket_connect(this_state, path, rank, size)) {
+		free(this_state);
+		return NULL;
+	}
+
+	Transport *this = (Transport*)malloc(sizeof(Transport));
+	if (!this)
+		goto fail;
+	*this = (Transport) {
+		.rank = rank,
+		.size = size,
+		.state = this_state,
+
+		.free = socket_free,
+		.exchange = socket_exchange,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+#else
+	(void)path;
+	(void)rank;
+	(void)size;
+	return NULL;
+#endif
+}
+
+Comm *new_comm(MLPNet *net, Transport *transport)
+{
+	size_t recv_size = 1;
+	for (size_t i = 0; i < net->size; i++) {
+		size_t len = (net->layer[i]->param_size + transport->size - 1)
+		             / transport->size;
+		if (len > recv_size)
+			recv_size = len;
+	}
+	float *this_recv = (float*)malloc(sizeof(float) * recv_size);
+	if (!this_recv)
+		goto fail;
+
+	Comm *this = (Comm*)malloc(sizeof(Comm));
+	if (!this)
+		goto fail;
+	*this = (Comm) {
+		.transport = transport,
+		.net = net,
+		.recv = this_recv,
+		.grad = NULL,
+		.part = NULL,
+		.ready = net->size,
+		.done = net->size,
+		.stop = false,
+
+		.step_num = 0,
+		.bytes = 0,
+		.comm_time = 0.0,
+		.wait_time = 0.0,
+		.last_bytes = 0,
+		.last_comm_time = 0.0,
+		.last_wait_time = 0.0,
+
+		.free = comm_free,
+		.broadcast = comm_broadcast,
+		.begin = comm_begin,
+		.wait = comm_wait,
+		.allreduce = comm_allreduce,
+		.print = comm_print,
+	};
+	if (mtx_init(&this->lock, mtx_plain) != thrd_success
+	    || cnd_init(&this->arrive) != thrd_success
+	    || cnd_init(&this->finish) != thrd_success
+	    || thrd_create(&this->worker, comm_worker, this) != thrd_success)
+		goto thrd_fail;
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+static void comm_free(Comm *this)
+{
+	mtx_lock(&this->lock);
+	this->stop = true;
+	cnd_signal(&this->arrive);
+	mtx_unlock(&this->lock);
+	thrd_join(this->worker, NULL);
+
+	if (this->net->grad_hook == comm_hook)
+		this->net->grad_hook = NULL;
+	mtx_destroy(&this->lock);
+	cnd_destroy(&this->arrive);
+	cnd_destroy(&this->finish);
+	this->transport->free(this->transport);
+	free(this->recv);
+	free(this);
+}
+
+static void comm_broadcast(Comm *this, void *buf, size_t bytes)
+{
+	Transport *t = this->transport;
+	if (t->size == 1)
+		return;
+	if (t->rank && !t->exchange(t, NULL, 0, buf, bytes))
+		goto comm_fail;
+	if (t->rank + 1 < t->size && !t->exchange(t, buf, bytes, NULL, 0))
+		goto comm_fail;
+	return;
+comm_fail:
+	printf("Transport failed!");
+	exit(1);
+}
+
+static void comm_begin(Comm *this, MLPGrad *grad, MLPGrad *part)
+{
+	mtx_lock(&this->lock);
+	this->grad = grad;
+	this->part = part;
+	this->ready = 0;
+	this->done = 0;
+	this->last_bytes = 0;
+	this->last_comm_time = 0.0;
+	mtx_unlock(&this->lock);
+	if (part) {
+		this->net->grad_hook = comm_hook;
+		this->net->grad_hook_arg = this;
+	}
+}
+
+static void comm_wait(Comm *this)
+{
+	double start = timer_now();
+	if (this->net->grad_hook == comm_hook)
+		this->net->grad_hook = NULL;
+	mtx_lock(&this->lock);
+	this->ready = this->net->size;
+	cnd_signal(&this->arrive);
+	while (this->done < this->net->size)
+		cnd_wait(&this->finish, &this->lock);
+	this->last_wait_time = timer_now() - start;
+	this->wait_time += this->last_wait_time;
+	this->step_num++;
+	this->grad->touch_all(this->grad);
+	mtx_unlock(&this->lock);
+}
+
+static void comm_allreduce(Comm *this, MLPGrad *grad)
+{
+	comm_begin(this, grad, NULL);
+	comm_wait(this);
+}
+
+static void comm_print(Comm *this)
+{
+	mtx_lock(&this->lock);
+	printf("Comm: %zu steps, %zu processes, %zu bytes sent\n",
+	       this->step_num, this->transport->size, this->bytes);
+	printf("Time: %.3f ms avg, %.3f ms exposed avg per step\n",
+	       this->step_num ? this->comm_time / this->step_num * 1e3 : 0.0,
+	       this->step_num ? this->wait_time / this->step_num * 1e3 : 0.0);
+	printf("Bandwidth: %.1f MB/s\n",
+	       this->comm_time > 0.0 ? this->bytes / this->comm_time / 1e6 : 0.0);
+	mtx_unlock(&this->lock);
+}
+
+/*** 内部 ***/
+
+#ifdef __unix__
+static void socket_free(Transport *this)
+{
+	SocketState *state = (SocketState*)this->state;
+	if (state->prev >= 0)
+		close(state->prev);
+	if (state->next >= 0)
+		close(state->next);
+	free(state);
+	free(this);
+}
+
+static bool socket_exchange(Transport *this, const void *out,
+                            size_t send_bytes, void *in, size_t recv_bytes)
+{
+	SocketState *state = (SocketState*)this->state;
+	size_t sent = 0, got = 0;
+	while (sent < send_bytes || got < recv_bytes) {
+		struct pollfd fd[2] = {
+			{.fd = sent < send_bytes ? state->next : -1, .events = POLLOUT},
+			{.fd = got < recv_bytes ? state->prev : -1, .events = POLLIN},
+		};
+		if (poll(fd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (fd[0].revents) {
+			ssize_t n = send(state->next, (const char*)out + sent,
+			                 send_bytes - sent, MSG_NOSIGNAL);
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+			    && errno != EINTR)
+				return false;
+			if (n > 0)
+				sent += n;
+		}
+		if (fd[1].revents) {
+			ssize_t n = recv(state->prev, (char*)in + got, recv_bytes - got,
+			                 0);
+			if (n == 0)
+				return false;
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+			    && errno != EINTR)
+				return false;
+			if (n > 0)
+				got += n;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief  建立与上下两个进程的连接
+ *
+ * 先监听自己的地址，再连接下一进程，最后接受上一进程的连接，
+ * 各进程以任意顺序启动都不会互相等待。
+ *
+ * @param  state `[OUT]`私有状态
+ * @param  path  套接字路径的前缀
+ * @param  rank  本进程的序号
+ * @param  size  进程数
+ * @return 成功返回`true`，失败时已关闭打开的连接
+ */
+static bool socket_connect(SocketState *state, char *path, size_t rank,
+                           size_t size)
+{
+	struct sockaddr_un self, next;
+	if (!socket_address(&self, path, rank)
+	    || !socket_address(&next, path, (rank + 1) % size))
+		return false;
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		return false;
+	unlink(self.sun_path);
+	if (bind(listener, (struct sockaddr*)&self, sizeof(self)) < 0
+	    || listen(listener, 1) < 0)
+		goto fail;
+
+	double start = timer_now();
+	for (;;) {
+		state->next = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (state->next < 0)
+			goto fail;
+		if (connect(state->next, (struct sockaddr*)&next, sizeof(next)) == 0)
+			break;
+		close(state->next);
+		state->next = -1;
+		if (timer_now() - start > COMM_CONNECT_TIMEOUT)
+			goto fail;
+		thrd_sleep(&(struct timespec) {.tv_nsec = 10000000}, NULL);
+	}
+
+	struct pollfd fd = {.fd = listener, .events = POLLIN};
+	int left = (int)((COMM_CONNECT_TIMEOUT - (timer_now() - start)) * 1e3);
+	if (poll(&fd, 1, left > 0 ? left : 0) <= 0)
+		goto fail;
+	state->prev = accept(listener, NULL, NULL);
+	if (state->prev < 0)
+		goto fail;
+	close(listener);
+	unlink(self.sun_path);
+	fcntl(state->prev, F_SETFL, fcntl(state->prev, F_GETFL) | O_NONBLOCK);
+	fcntl(state->next, F_SETFL, fcntl(state->next, F_GETFL) | O_NONBLOCK);
+	return true;
+fail:
+	close(listener);
+	unlink(self.sun_path);
+	if (state->next >= 0)
+		close(state->next);
+	state->next = -1;
+	return false;
+}
+
+/**
+ * @brief  生成第`rank`个进程的地址`path.rank`
+ * @param  addr `[OUT]`地址
+ * @param  path 套接字路径的前缀
+ * @param  rank 进程序号
+ * @return 成功返回`true`；路径过长时返回`false`
+ */
+static bool socket_address(struct sockaddr_un *addr, char *path, size_t rank)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	int len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s.%zu",
+	                   path, rank);
+	return len > 0 && (size_t)len < sizeof(addr->sun_path);
+}
+#endif
+
+/**
+ * @brief  同步线程，自输出层起依次同步可以同步的层
+ * @param  arg `[INOUT]``Comm`指针
+ * @return `0`
+ */
+static int comm_worker(void *arg)
+{
+	Comm *this = (Comm*)arg;
+	size_t size = this->net->size;
+
+	mtx_lock(&this->lock);
+	for (;;) {
+		while (this->done >= this->ready && !this->stop)
+			cnd_wait(&this->arrive, &this->lock);
+		if (this->done >= this->ready)
+			break;
+		Layer *layer = this->net->layer[size - 1 - this->done];
+		float *val = this->grad->param + layer->offset;
+		mtx_unlock(&this->lock);
+
+		double start = timer_now();
+		size_t bytes = reduce(this, val, layer->param_size);
+		double time = timer_now() - start;
+
+		mtx_lock(&this->lock);
+		this->done++;
+		this->bytes += bytes;
+		this->comm_time += time;
+		this->last_bytes += bytes;
+		this->last_comm_time += time;
+		if (this->done == size)
+			cnd_broadcast(&this->finish);
+	}
+	mtx_unlock(&this->lock);
+	return 0;
+}
+
+/**
+ * @brief 作为`MLPNet::grad_hook`，将一层的单样本梯度累加进批梯度并交给同步线程
+ * @param arg   `[INOUT]``Comm`指针
+ * @param index 层序号
+ */
+static void comm_hook(void *arg, size_t index)
+{
+	Comm *this = (Comm*)arg;
+	Layer *layer = this->net->layer[index];
+	float *dst = this->grad->param + layer->offset;
+	float *src = this->part->param + layer->offset;
+	for (size_t i = 0; i < layer->param_size; i++)
+		dst[i] += src[i];
+
+	mtx_lock(&this->lock);
+	this->ready = this->net->size - index;
+	cnd_signal(&this->arrive);
+	mtx_unlock(&this->lock);
+}
+
+/**
+ * @brief  环形全归约一块数据
+ *
+ * 数据分为进程数个分片。reduce-scatter 的每一步将一片发给下一进程，
+ * 并把从上一进程收到的一片加到本地，`size - 1`步后每个进程各持有一片的总和；
+ * all-gather 再沿环传递这些总和。每个进程共发送约`2 * (size - 1) / size`倍的数据。
+ *
+ * @param  this `[INOUT]``Comm`
+ * @param  val  `[INOUT]`数据，返回时为各进程之和
+ * @param  size 长度
+ * @return 发送的字节数
+ */
+static size_t reduce(Comm *this, float *val, size_t size)
+{
+	Transport *t = this->transport;
+	size_t num = t->size, rank = t->rank, bytes = 0;
+	if (num == 1 || !size)
+		return 0;
+	for (size_t s = 0; s + 1 < num; s++) {
+		size_t send_len, recv_len;
+		size_t send = chunk(size, num, (rank + num - s) % num, &send_len);
+		size_t recv = chunk(size, num, (rank + 2 * num - s - 1) % num,
+		                    &recv_len);
+		if (!t->exchange(t, val + send, sizeof(float) * send_len, this->recv,
+		                 sizeof(float) * recv_len))
+			goto comm_fail;
+		for (size_t i = 0; i < recv_len; i++)
+			val[recv + i] += this->recv[i];
+		bytes += sizeof(float) * send_len;
+	}
+	for (size_t s = 0; s + 1 < num; s++) {
+		size_t send_len, recv_len;
+		size_t send = chunk(size, num, (rank + 1 + num - s) % num, &send_len);
+		size_t recv = chunk(size, num, (rank + num - s) % num, &recv_len);
+		if (!t->exchange(t, val + send, sizeof(float) * send_len, val + recv,
+		                 sizeof(float) * recv_len))
+			goto comm_fail;
+		bytes += sizeof(float) * send_len;
+	}
+	return bytes;
+comm_fail:
+	printf("Transport failed!");
+	exit(1);
+}
+
+/**
+ * @brief  求一个分片的位置
+ * @param  size  数据长度
+ * @param  num   分片数
+ * @param  index 分片序号
+ * @param  len   `[OUT]`分片长度
+ * @return 分片起点
+ */
+static size_t chunk(size_t size, size_t num, size_t index, size_t *len)
+{
+	size_t begin = size * index / num;
+	*len = size * (index + 1) / num - begin;
+	return begin;
+}
@@ -0,0 +1,144 @@
+#ifndef COMM_H_
+#define COMM_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <threads.h>
+#include "mlp.h"
+
+typedef struct Transport Transport;
+typedef struct Comm Comm;
+
+/***** Transport *****/
+
+/*
+ * 进程间的环形传输。
+ *
+ * 各进程按序号排成环，每个进程只向下一进程发送、从上一进程接收。
+ * 后端只需实现`exchange`，私有状态存于`state`。
+ */
+struct Transport {
+	size_t rank;   /* 本进程的序号 */
+	size_t size;   /* 进程数 */
+	void *state;   /* 后端的私有状态 */
+
+	/**
+	 * @brief 断开连接并销毁`Transport`
+	 */
+	void (*free)(Transport *this);
+
+	/**
+	 * @brief  同时向下一进程发送并从上一进程接收，两者均收发完毕才返回
+	 *
+	 * 两个方向并发进行，双方同时发送大块数据也不会死锁。
+	 *
+	 * @param  send       `[IN]`待发送的数据
+	 * @param  send_bytes 发送的字节数，可为`0`
+	 * @param  recv       `[OUT]`接收缓冲区
+	 * @param  recv_bytes 接收的字节数，可为`0`
+	 * @return 成功返回`true`；连接断开或出错时返回`false`
+	 */
+	bool (*exchange)(Transport *this, const void *send, size_t send_bytes,
+	                 void *recv, size_t recv_bytes);
+};
+
+/**
+ * @brief  创建基于 Unix 域套接字的`Transport`
+ *
+ * 第`rank`个进程监听`path.rank`并连接`path.(rank + 1) % size`，
+ * 连接建立后即删除监听的文件。各进程须在约 30 秒内先后调用。
+ * 仅在 Unix 上可用。
+ *
+ * @param  path 套接字路径的前缀
+ * @param  rank 本进程的序号
+ * @param  size 进程数
+ * @return `[OWN]``Transport`指针；失败或不支持时返回`NULL`
+ */
+Transport *new_socket_transport(char *path, size_t rank, size_t size);
+
+/***** Comm *****/
+
+/*
+ * 数据并行训练的梯度同步。
+ *
+ * 以环形全归约（reduce-scatter 后 all-gather）将各进程的`MLPGrad`求和，
+ * 每层参数为一块，自输出层起逐块同步，各进程所得结果逐位相同。
+ *
+ * `begin`后由`MLPNet::grad_hook`得知一层的梯度已求出，
+ * 即将其累加进批梯度并交给后台线程同步，通信与其余各层的反向传播重叠。
+ *
+ * 各进程须以相同顺序调用`broadcast`与`begin`/`wait`。
+ */
+struct Comm {
+	Transport *transport;  /* 传输 */
+	MLPNet *net;           /* 网络 */
+	float *recv;           /* 接收缓冲区，长度为最大一块的分片 */
+	MLPGrad *grad;         /* 正在同步的批梯度 */
+	MLPGrad *part;         /* 逐层累加进`grad`的单样本梯度，可为`NULL` */
+	size_t ready;          /* 可以同步的层数，自输出层起计 */
+	size_t done;           /* 已同步的层数，自输出层起计 */
+	bool stop;             /* 是否停止 */
+	mtx_t lock;            /* 进度与统计量的锁 */
+	cnd_t arrive;          /* 一层可以同步 */
+	cnd_t finish;          /* 全部层同步完毕 */
+	thrd_t worker;         /* 同步线程 */
+
+	size_t step_num;       /* 同步次数 */
+	size_t bytes;          /* 累计发送的字节数 */
+	double comm_time;      /* 累计通信耗时（秒），含归约与等待其他进程 */
+	double wait_time;      /* 累计`wait`的阻塞时间（秒），即未被反向传播掩盖的部分 */
+	size_t last_bytes;     /* 最近一次同步发送的字节数 */
+	double last_comm_time; /* 最近一次同步的通信耗时（秒） */
+	double last_wait_time; /* 最近一次`wait`的阻塞时间（秒） */
+
+	/**
+	 * @brief 停止同步线程并销毁`Comm`与`transport`，不销毁`net`
+	 */
+	void (*free)(Comm *this);
+
+	/**
+	 * @brief 自第`0`个进程广播，须在`begin`与`wait`之外调用
+	 * @param buf   `[INOUT]`数据，第`0`个进程为发送方，其余为接收方
+	 * @param bytes 字节数
+	 */
+	void (*broadcast)(Comm *this, void *buf, size_t bytes);
+
+	/**
+	 * @brief 开始一次同步，此后`net`的`grad`每求出一层，
+	 *        即将`part`的该层累加进`grad`并开始同步该层
+	 * @param grad `[INOUT]`本进程的批梯度，不含最后一个样本
+	 * @param part `[IN]`最后一个样本的梯度容器，传入`NULL`表示本进程没有样本
+	 */
+	void (*begin)(Comm *this, MLPGrad *grad, MLPGrad *part);
+
+	/**
+	 * @brief 等待同步完成，之后`grad`为各进程批梯度之和
+	 *
+	 * `begin`后未调用`net`的`grad`时，直接同步`grad`。
+	 */
+	void (*wait)(Comm *this);
+
+	/**
+	 * @brief 同步梯度，即`begin(grad, NULL)`后`wait`
+	 * @param grad `[INOUT]`本进程的梯度，返回时为各进程梯度之和
+	 */
+	void (*allreduce)(Comm *this, MLPGrad *grad);
+
+	/**
+	 * @brief 打印统计量
+	 */
+	void (*print)(Comm *this);
+};
+
+/**
+ * @brief  创建`Comm`
+ *
+ * 传输出错时打印错误并退出进程，因为其他进程此时已无法继续。
+ *
+ * @param  net       `[INOUT]`网络，须在`Comm`销毁后再销毁
+ * @param  transport `[OWN]`传输
+ * @return `[OWN]``Comm`指针
+ */
+Comm *new_comm(MLPNet *net, Transport *transport);
+
+#endif  /* COMM_H_ */
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "vector.h"
+#include "mlp.h"
+#include "pool.h"
+#include "trainer.h"
+#include "eval.h"
+#include "timer.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Metrics *evaluate(MLPNet *net, Dataset *data, size_t top_k);
+static void metrics_free(Metrics *this);
+static void metrics_print(Metrics *this);
+
+/*** 内部 ***/
+
+/* 评估任务的参数 */
+typedef struct {
+	MLPNet *net;       /* 网络 */
+	Dataset *data;     /* 数据集 */
+	Metrics *metrics;  /* 结果 */
+	size_t top_k_hit;  /* top-k 命中数 */
+	mtx_t lock;        /* 合并结果的锁 */
+} EvalTask;
+
+static void eval_shards(void *arg, size_t begin, size_t end);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Metrics *evaluate(MLPNet *net, Dataset *data, size_t top_k)
+{
+	size_t class_num = net->layer[net->size - 1]->next_size;
+	size_t *this_confusion = (size_t*)calloc(class_num * class_num,
+	                                         sizeof(size_t));
+	float *this_precision = (float*)calloc(class_num, sizeof(float));
+	float *this_recall = (float*)calloc(class_num, sizeof(float));
+	if (!this_confusion || !this_precision || !this_recall)
+		goto fail;
+
+	Metrics *this = (Metrics*)malloc(sizeof(Metrics));
+	if (!this)
+		goto fail;
+	*this = (Metrics) {
+		.size = data->size,
+		.class_num = class_num,
+		.top_k = top_k,
+		.confusion = this_confusion,
+		.precision = this_precision,
+		.recall = this_recall,
+
+		.free = metrics_free,
+		.print = metrics_print,
+	};
+
+	EvalTask task = {
+		.net = net,
+		.data = data,
+		.metrics = this,
+		.top_k_hit = 0,
+	};
+	if (mtx_init(&task.lock, mtx_plain) != thrd_success)
+		goto fail;
+	double start = timer_now();
+	size_t shard_num = (data->size + MLP_BATCH_BLOCK - 1) / MLP_BATCH_BLOCK;
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, shard_num, 1, eval_shards, &task);
+	this->time = timer_now() - start;
+	mtx_destroy(&task.lock);
+
+	size_t correct = 0;
+	for (size_t i = 0; i < class_num; i++) {
+		size_t pred_num = 0;
+		size_t label_num = 0;
+		for (size_t j = 0; j < class_num; j++) {
+			pred_num += this_confusion[j * class_num + i];
+			label_num += this_confusion[i * class_num + j];
+		}
+		size_t hit = this_confusion[i * class_num + i];
+		correct += hit;
+		this->precision[i] = pred_num ? (float)hit / pred_num : 0.0;
+		this->recall[i] = label_num ? (float)hit / label_num : 0.0;
+	}
+	if (data->size) {
+		this->accuracy = (float)correct / data->size;
+		this->top_k_accuracy = (float)task.top_k_hit / data->size;
+	}
+	this->throughput = this->time > 0.0 ? data->size / this->time : 0.0;
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void metrics_free(Metrics *this)
+{
+	free(this->confusion);
+	free(this->precision);
+	free(this->recall);
+	free(this);
+}
+
+static void metrics_print(Metrics *this)
+{
+	printf("Samples: %zu (%.0f samples/s)\n", this->size, this->throughput);
+	printf("Accuracy: %.2f%%, top-%zu accuracy: %.2f%%\n",
+	       this->accuracy * 100, this->top_k, this->top_k_accuracy * 100);
+	printf("Class  Precision  Recall\n");
+	for (size_t i = 0; i < this->class_num; i++)
+		printf("%5zu  %8.2f%%  %5.2f%%\n", i, this->precision[i] * 100,
+		       this->recall[i] * 100);
+	printf("Confusion matrix (row: label, col: prediction):\n");
+	for (size_t i = 0; i < this->class_num; i++) {
+		for (size_t j = 0; j < this->class_num; j++)
+			printf("%6zu", this->confusion[i * this->class_num + j]);
+		printf("\n");
+	}
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief 评估第`[begin, end)`个分片
+ * @param arg   `[INOUT]``EvalTask`
+ * @param begin 起始分片
+ * @param end   终止分片（不含）
+ */
+static void eval_shards(void *arg, size_t begin, size_t end)
+{
+	EvalTask *task = (EvalTask*)arg;
+	Dataset *data = task->data;
+	size_t class_num = task->metrics->class_num;
+	size_t top_k = task->metrics->top_k;
+
+	/* 分片私有的上下文 */
+	Vector *prob[MLP_BATCH_BLOCK];
+	size_t res[MLP_BATCH_BLOCK];
+	for (size_t i = 0; i < MLP_BATCH_BLOCK; i++)
+		prob[i] = new_vector(class_num, NULL);
+	size_t *confusion = (size_t*)calloc(class_num * class_num,
+	                                    sizeof(size_t));
+	if (!confusion)
+		goto fail;
+	size_t top_k_hit = 0;
+
+	for (size_t s = begin; s < end; s++) {
+		size_t first = s * MLP_BATCH_BLOCK;
+		size_t num = data->size - first < MLP_BATCH_BLOCK
+		             ? data->size - first : MLP_BATCH_BLOCK;
+		task->net->predict_batch(task->net, data->input + first, num,
+		                         res, prob);
+		for (size_t k = 0; k < num; k++) {
+			Vector *label = data->label[first + k];
+			size_t truth = 0;
+			for (size_t j = 1; j < label->size; j++)
+				if (label->val[j] > label->val[truth])
+					truth = j;
+			confusion[truth * class_num + res[k]]++;
+
+			size_t rank = 0;  /* 比标签得分高的类别数 */
+			float score = prob[k]->val[truth];
+			for (size_t j = 0; j < class_num; j++)
+				if (prob[k]->val[j] > score)
+					rank++;
+			if (rank < top_k)
+				top_k_hit++;
+		}
+	}
+
+	mtx_lock(&task->lock);
+	for (size_t i = 0; i < class_num * class_num; i++)
+		task->metrics->confusion[i] += confusion[i];
+	task->top_k_hit += top_k_hit;
+	mtx_unlock(&task->lock);
+
+	free(confusion);
+	for (size_t i = 0; i < MLP_BATCH_BLOCK; i++)
+		prob[i]->free(prob[i]);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
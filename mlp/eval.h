@@ -0,0 +1,48 @@
+#ifndef EVAL_H_
+#define EVAL_H_
+
+#include <stddef.h>
+#include "mlp.h"
+#include "trainer.h"
+
+typedef struct Metrics Metrics;
+
+/***** Metrics *****/
+
+struct Metrics {
+	size_t size;           /* 样本数 */
+	size_t class_num;      /* 类别数 */
+	size_t top_k;          /* top-k 中的 k */
+	float accuracy;        /* 准确率 */
+	float top_k_accuracy;  /* top-k 准确率 */
+	size_t *confusion;     /* 混淆矩阵，第`i`行第`j`列为标签`i`预测为`j`的数量，按行存储 */
+	float *precision;      /* 各类精确率 */
+	float *recall;         /* 各类召回率 */
+	double time;           /* 耗时（秒） */
+	double throughput;     /* 吞吐量（样本/秒） */
+
+	/**
+	 * @brief 销毁`Metrics`
+	 */
+	void (*free)(Metrics *this);
+
+	/**
+	 * @brief 打印
+	 */
+	void (*print)(Metrics *this);
+};
+
+/**
+ * @brief  评估网络
+ *
+ * 数据集按`MLP_BATCH_BLOCK`分片，由线程池并行批量推理，
+ * 各分片使用独立的输出缓冲区与混淆矩阵，最后合并。
+ *
+ * @param  net   `[IN]`网络
+ * @param  data  `[IN]`数据集，标签为独热向量
+ * @param  top_k top-k 中的 k
+ * @return `[OWN]`评估结果
+ */
+Metrics *evaluate(MLPNet *net, Dataset *data, size_t top_k);
+
+#endif  /* EVAL_H_ */
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "mlp.h"
+#include "snapshot.h"
+#include "handle.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+ModelHandle *new_model_handle(MLPNet *net);
+static void model_handle_free(ModelHandle *this);
+static ModelReader *model_handle_join(ModelHandle *this);
+static void model_handle_leave(ModelHandle *this, ModelReader *reader);
+static MLPNet *model_handle_acquire(ModelHandle *this, ModelReader *reader);
+static void model_handle_release(ModelHandle *this, ModelReader *reader);
+static size_t model_handle_reclaim(ModelHandle *this);
+static size_t model_handle_publish(ModelHandle *this, MLPNet *net);
+static size_t model_handle_reload(ModelHandle *this, char *path);
+
+/*** 内部 ***/
+
+static ModelVersion *new_model_version(MLPNet *net, size_t version);
+static void reclaim(ModelHandle *this);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+ModelHandle *new_model_handle(MLPNet *net)
+{
+	ModelHandle *this = (ModelHandle*)malloc(sizeof(ModelHandle));
+	if (!this)
+		goto fail;
+	*this = (ModelHandle) {
+		.retired = NULL,
+		.reader = NULL,
+		.reclaim_num = 0,
+
+		.free = model_handle_free,
+		.join = model_handle_join,
+		.leave = model_handle_leave,
+		.acquire = model_handle_acquire,
+		.release = model_handle_release,
+		.reclaim = model_handle_reclaim,
+		.publish = model_handle_publish,
+		.reload = model_handle_reload,
+	};
+	atomic_init(&this->current, new_model_version(net, 1));
+	atomic_init(&this->epoch, 1);
+	atomic_init(&this->retired_num, 0);
+	atomic_init(&this->version, 1);
+	if (mtx_init(&this->lock, mtx_plain) != thrd_success)
+		goto thrd_fail;
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+static void model_handle_free(ModelHandle *this)
+{
+	ModelVersion *version = atomic_load(&this->current);
+	version->next = this->retired;
+	while (version) {
+		ModelVersion *next = version->next;
+		version->net->free(version->net);
+		free(version);
+		version = next;
+	}
+	ModelReader *reader = this->reader;
+	while (reader) {
+		ModelReader *next = reader->next;
+		free(reader);
+		reader = next;
+	}
+	mtx_destroy(&this->lock);
+	free(this);
+}
+
+static ModelReader *model_handle_join(ModelHandle *this)
+{
+	mtx_lock(&this->lock);
+	ModelReader *reader = this->reader;
+	while (reader && reader->used)
+		reader = reader->next;
+	if (!reader) {
+		reader = (ModelReader*)malloc(sizeof(ModelReader));
+		if (!reader)
+			goto fail;
+		atomic_init(&reader->epoch, 0);
+		reader->next = this->reader;
+		this->reader = reader;
+	}
+	reader->version = 0;
+	reader->used = true;
+	mtx_unlock(&this->lock);
+	return reader;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void model_handle_leave(ModelHandle *this, ModelReader *reader)
+{
+	mtx_lock(&this->lock);
+	reader->used = false;
+	mtx_unlock(&this->lock);
+}
+
+static MLPNet *model_handle_acquire(ModelHandle *this, ModelReader *reader)
+{
+	/*
+	 * 先公布纪元再读取`current`：写者先交换`current`再增加纪元，
+	 * 若写者检查时看到的是增加前的纪元或`0`，这里读到的必是交换后的模型。
+	 */
+	atomic_store(&reader->epoch, atomic_load(&this->epoch));
+	ModelVersion *version = atomic_load(&this->current);
+	reader->version = version->version;
+	return version->net;
+}
+
+static void model_handle_release(ModelHandle *this, ModelReader *reader)
+{
+	(void)this;
+	atomic_store(&reader->epoch, 0);
+}
+
+static size_t model_handle_reclaim(ModelHandle *this)
+{
+	if (!atomic_load(&this->retired_num))
+		return 0;
+	mtx_lock(&this->lock);
+	reclaim(this);
+	mtx_unlock(&this->lock);
+	return atomic_load(&this->retired_num);
+}
+
+static size_t model_handle_publish(ModelHandle *this, MLPNet *net)
+{
+	mtx_lock(&this->lock);
+	size_t version = atomic_load(&this->version) + 1;
+	ModelVersion *old = atomic_exchange(&this->current,
+	                                    new_model_version(net, version));
+	atomic_store(&this->version, version);
+	old->retire = atomic_fetch_add(&this->epoch, 1) + 1;
+	old->next = this->retired;
+	this->retired = old;
+	atomic_fetch_add(&this->retired_num, 1);
+	reclaim(this);
+	mtx_unlock(&this->lock);
+	return version;
+}
+
+static size_t model_handle_reload(ModelHandle *this, char *path)
+{
+	/* 只有写者会回收模型，持锁时读取当前模型是安全的 */
+	mtx_lock(&this->lock);
+	MLPNet *cur = atomic_load(&this->current)->net;
+	float (*lossf)(Vector*, Vector*) = cur->lossf;
+	Vector *(*dlossf)(Vector*, Vector*) = cur->dlossf;
+	size_t input_size = cur->layer[0]->size;
+	size_t output_size = cur->layer[cur->size - 1]->next_size;
+	mtx_unlock(&this->lock);
+
+	MLPNet *net = snapshot_load(path, lossf, dlossf, NULL);
+	if (!net)
+		return 0;
+	if (net->layer[0]->size != input_size
+	    || net->layer[net->size - 1]->next_size != output_size) {
+		net->free(net);
+		return 0;
+	}
+	return model_handle_publish(this, net);
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  创建`ModelVersion`
+ * @param  net     `[OWN]`网络
+ * @param  version 版本号
+ * @return `[OWN]``ModelVersion`指针
+ */
+static ModelVersion *new_model_version(MLPNet *net, size_t version)
+{
+	ModelVersion *this = (ModelVersion*)malloc(sizeof(ModelVersion));
+	if (!this)
+		goto fail;
+	*this = (ModelVersion) {
+		.net = net,
+		.version = version,
+		.retire = 0,
+		.next = NULL,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 销毁不再被读取的模型，须持有`lock`
+ *
+ * 模型在纪元`retire`时被替换，进入读区时纪元不小于`retire`的读者读到的必是之后的模型，
+ * 因此当仍在读区的读者的纪元均不小于`retire`时即可销毁。
+ *
+ * @param this `[INOUT]``ModelHandle`
+ */
+static void reclaim(ModelHandle *this)
+{
+	uint64_t min = UINT64_MAX;
+	for (ModelReader *reader = this->reader; reader; reader = reader->next) {
+		uint64_t epoch = atomic_load(&reader->epoch);
+		if (epoch && epoch < min)
+			min = epoch;
+	}
+	ModelVersion **link = &this->retired;
+	while (*link) {
+		ModelVersion *version = *link;
+		if (version->retire > min) {
+			link = &version->next;
+			continue;
+		}
+		*link = version->next;
+		version->net->free(version->net);
+		free(version);
+		this->reclaim_num++;
+		atomic_fetch_sub(&this->retired_num, 1);
+	}
+}
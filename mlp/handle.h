@@ -0,0 +1,129 @@
+#ifndef HANDLE_H_
+#define HANDLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "mlp.h"
+
+typedef struct ModelVersion ModelVersion;
+typedef struct ModelReader ModelReader;
+typedef struct ModelHandle ModelHandle;
+
+/***** ModelVersion *****/
+
+/* 一个已发布的模型 */
+struct ModelVersion {
+	MLPNet *net;         /* 网络 */
+	size_t version;      /* 版本号，自`1`起递增 */
+	uint64_t retire;     /* 被替换时的纪元 */
+	ModelVersion *next;  /* 待回收链表中的下一个 */
+};
+
+/***** ModelReader *****/
+
+/*
+ * 读者，每个推理线程领取一个。
+ *
+ * `epoch`为进入读区时的全局纪元，不在读区时为`0`，
+ * 写者据此判断被替换的模型是否仍可能被读取。
+ */
+struct ModelReader {
+	atomic_uint_fast64_t epoch;  /* 进入读区时的纪元，不在读区时为`0` */
+	size_t version;      /* 最近一次`acquire`取得的版本号 */
+	bool used;           /* 是否已被领取 */
+	ModelReader *next;   /* 读者链表中的下一个 */
+};
+
+/***** ModelHandle *****/
+
+/*
+ * 可热替换的模型，按读-拷贝-更新（RCU）与纪元回收实现。
+ *
+ * 读者`acquire`与`release`之间使用的网络不会被替换或销毁，
+ * 两者各只有几次原子读写，不加锁也不等待。
+ * 写者`publish`以原子交换发布新模型，旧模型待进入读区早于替换的读者全部`release`后销毁：
+ * 由下一次`publish`或显式调用的`reclaim`完成。读者从不回收，
+ * 推理线程上不会出现加锁或释放网络的停顿。
+ * 因此最后一个读者离开时旧模型并不会随之销毁，须由写者或后台线程定期调用`reclaim`，
+ * 否则旧模型一直保留到下一次`publish`或`free`（示例服务在每轮主循环中调用）。
+ *
+ * 读区内多个读者可能同时使用同一网络，因此只应调用可并发的`MLPNet::predict_batch`。
+ */
+struct ModelHandle {
+	_Atomic(ModelVersion*) current;  /* 当前模型 */
+	atomic_uint_fast64_t epoch;      /* 全局纪元，自`1`起，每次替换加一 */
+	atomic_size_t retired_num;       /* 待回收的模型数 */
+	atomic_size_t version;           /* 最新发布的版本号，可不加锁读取 */
+	ModelVersion *retired;  /* 待回收的模型 */
+	ModelReader *reader;    /* 读者 */
+	size_t reclaim_num;     /* 已回收的模型数 */
+	mtx_t lock;             /* 写者、读者链表与回收的锁 */
+
+	/**
+	 * @brief 销毁`ModelHandle`、全部模型与读者，须在全部读者`leave`后调用
+	 */
+	void (*free)(ModelHandle *this);
+
+	/**
+	 * @brief  领取读者
+	 * @return 读者，由`ModelHandle`持有
+	 */
+	ModelReader *(*join)(ModelHandle *this);
+
+	/**
+	 * @brief 归还读者，须不在读区内
+	 * @param reader `[IN]`读者
+	 */
+	void (*leave)(ModelHandle *this, ModelReader *reader);
+
+	/**
+	 * @brief  进入读区并取得当前模型，不可嵌套
+	 * @param  reader `[INOUT]`读者，版本号记入`reader->version`
+	 * @return 网络，在`release`前有效
+	 */
+	MLPNet *(*acquire)(ModelHandle *this, ModelReader *reader);
+
+	/**
+	 * @brief 离开读区，只清除读者的纪元，不回收模型，回收见`reclaim`
+	 * @param reader `[INOUT]`读者
+	 */
+	void (*release)(ModelHandle *this, ModelReader *reader);
+
+	/**
+	 * @brief  回收不再被读取的旧模型，可与读者并发调用
+	 *
+	 * 没有待回收的模型时不加锁，可在写者或后台线程的循环中频繁调用。
+	 *
+	 * @return 仍待回收的模型数
+	 */
+	size_t (*reclaim)(ModelHandle *this);
+
+	/**
+	 * @brief  发布新模型并回收不再被读取的旧模型，可与读者并发调用
+	 * @param  net `[OWN]`网络
+	 * @return 新的版本号
+	 */
+	size_t (*publish)(ModelHandle *this, MLPNet *net);
+
+	/**
+	 * @brief  由快照载入并发布新模型
+	 *
+	 * 仅支持`snapshot_load`可载入的网络，损失函数沿用当前模型。
+	 *
+	 * @param  path 快照路径
+	 * @return 新的版本号；载入失败或输入输出大小与当前模型不同时返回`0`，不替换
+	 */
+	size_t (*reload)(ModelHandle *this, char *path);
+};
+
+/**
+ * @brief  创建`ModelHandle`
+ * @param  net `[OWN]`初始网络，版本号为`1`
+ * @return `[OWN]``ModelHandle`指针
+ */
+ModelHandle *new_model_handle(MLPNet *net);
+
+#endif  /* HANDLE_H_ */
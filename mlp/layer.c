@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vector.h"
+#include "matrix.h"
+#include "mlp.h"
+#include "rand.h"
+#include "layer.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Layer *new_softmax_layer(size_t size);
+static void softmax_forward(Layer *this, const float *input, float *output,
+                            float *work, bool train);
+static void softmax_backward(Layer *this, const float *input,
+                             const float *output, float *work,
+                             const float *out_grad, float *param_grad,
+                             float *in_grad);
+
+Layer *new_residual_layer(FCLayer *inner);
+static void residual_init(Layer *this, uint64_t key);
+static void residual_forward(Layer *this, const float *input, float *output,
+                             float *work, bool train);
+static void residual_backward(Layer *this, const float *input,
+                              const float *output, float *work,
+                              const float *out_grad, float *param_grad,
+                              float *in_grad);
+
+Layer *new_embedding_layer(size_t field_num, size_t vocab, size_t dim);
+static void embedding_init(Layer *this, uint64_t key);
+static void embedding_forward(Layer *this, const float *input, float *output,
+                              float *work, bool train);
+static void embedding_backward(Layer *this, const float *input,
+                               const float *output, float *work,
+                               const float *out_grad, float *param_grad,
+                               float *in_grad);
+static size_t embedding_rows(Layer *this, const float *input, size_t *row);
+
+/*** 内部 ***/
+
+static bool embedding_index(Layer *this, float x, size_t *index);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Layer *new_softmax_layer(size_t size)
+{
+	Layer *this = new_layer(size, size, 0, 0);
+	this->forward = softmax_forward;
+	this->backward = softmax_backward;
+	return this;
+}
+
+static void softmax_forward(Layer *this, const float *input, float *output,
+                            float *work, bool train)
+{
+	(void)work;
+	(void)train;
+	float max = input[0];
+	for (size_t i = 1; i < this->size; i++)
+		if (input[i] > max)
+			max = input[i];
+	float sum = 0.0;
+	for (size_t i = 0; i < this->size; i++) {
+		output[i] = expf(input[i] - max);
+		sum += output[i];
+	}
+	for (size_t i = 0; i < this->size; i++)
+		output[i] /= sum;
+}
+
+static void softmax_backward(Layer *this, const float *input,
+                             const float *output, float *work,
+                             const float *out_grad, float *param_grad,
+                             float *in_grad)
+{
+	(void)input;
+	(void)work;
+	(void)param_grad;
+	if (!in_grad)
+		return;
+	float dot = 0.0;
+	for (size_t i = 0; i < this->size; i++)
+		dot += out_grad[i] * output[i];
+	for (size_t i = 0; i < this->size; i++)
+		in_grad[i] = output[i] * (out_grad[i] - dot);
+}
+
+Layer *new_residual_layer(FCLayer *inner)
+{
+	if (inner->size != inner->next_size)
+		goto size_fail;
+	size_t n = inner->size;
+	Layer *this = new_layer(n, n, (n + 1) * n, 2 * n);
+	for (size_t c = 0; c < n; c++)
+		memcpy(this->param + c * n, inner->weight->val[c]->val,
+		       sizeof(float) * n);
+	memcpy(this->param + n * n, inner->bias->val, sizeof(float) * n);
+	this->actf = inner->actf;
+	this->dactf = inner->dactf;
+	this->init = residual_init;
+	this->forward = residual_forward;
+	this->backward = residual_backward;
+	return this;
+size_fail:
+	printf("Residual layer size mismatch!");
+	exit(1);
+}
+
+static void residual_init(Layer *this, uint64_t key)
+{
+	size_t n = this->size;
+	float bound = sqrt(6.0 / (2.0 * n));
+	rand_fill_uniform_at(this->param, n * n, key, 0, -bound, bound);
+	memset(this->param + n * n, 0, sizeof(float) * n);
+}
+
+/* `work`的前半为线性变换结果，后半供反向传播存放其梯度 */
+static void residual_forward(Layer *this, const float *input, float *output,
+                             float *work, bool train)
+{
+	(void)train;
+	size_t n = this->size;
+	memcpy(work, this->param + n * n, sizeof(float) * n);
+	for (size_t c = 0; c < n; c++) {
+		const float *w = this->param + c * n;
+		for (size_t r = 0; r < n; r++)
+			work[r] += w[r] * input[c];
+	}
+	for (size_t r = 0; r < n; r++)
+		output[r] = input[r] + this->actf(work[r]);
+}
+
+static void residual_backward(Layer *this, const float *input,
+                              const float *output, float *work,
+                              const float *out_grad, float *param_grad,
+                              float *in_grad)
+{
+	(void)output;
+	size_t n = this->size;
+	float *delta = work + n;
+	float *bias_grad = param_grad + n * n;
+	for (size_t r = 0; r < n; r++) {
+		delta[r] = out_grad[r] * this->dactf(work[r]);
+		bias_grad[r] += delta[r];
+	}
+	for (size_t c = 0; c < n; c++) {
+		const float *w = this->param + c * n;
+		float *w_grad = param_grad + c * n;
+		float sum = 0.0;
+		for (size_t r = 0; r < n; r++) {
+			w_grad[r] += delta[r] * input[c];
+			sum += w[r] * delta[r];
+		}
+		if (in_grad)
+			in_grad[c] = out_grad[c] + sum;
+	}
+}
+
+Layer *new_embedding_layer(size_t field_num, size_t vocab, size_t dim)
+{
+	Layer *this = new_layer(field_num, field_num * dim, vocab * dim, 0);
+	this->row_size = dim;
+	this->init = embedding_init;
+	this->forward = embedding_forward;
+	this->backward = embedding_backward;
+	this->rows = embedding_rows;
+	return this;
+}
+
+static void embedding_init(Layer *this, uint64_t key)
+{
+	size_t dim = this->next_size / this->size;
+	float bound = sqrt(3.0 / dim);
+	rand_fill_uniform_at(this->param, this->param_size, key, 0, -bound,
+	                     bound);
+}
+
+static void embedding_forward(Layer *this, const float *input, float *output,
+                              float *work, bool train)
+{
+	(void)work;
+	(void)train;
+	size_t dim = this->next_size / this->size;
+	for (size_t f = 0; f < this->size; f++) {
+		size_t index;
+		if (embedding_index(this, input[f], &index))
+			memcpy(output + f * dim, this->param + index * dim,
+			       sizeof(float) * dim);
+		else
+			memset(output + f * dim, 0, sizeof(float) * dim);
+	}
+}
+
+static void embedding_backward(Layer *this, const float *input,
+                               const float *output, float *work,
+                               const float *out_grad, float *param_grad,
+                               float *in_grad)
+{
+	(void)output;
+	(void)work;
+	size_t dim = this->next_size / this->size;
+	for (size_t f = 0; f < this->size; f++) {
+		size_t index;
+		if (!embedding_index(this, input[f], &index))
+			continue;
+		float *row = param_grad + index * dim;
+		for (size_t k = 0; k < dim; k++)
+			row[k] += out_grad[f * dim + k];
+	}
+	if (in_grad)
+		memset(in_grad, 0, sizeof(float) * this->size);
+}
+
+static size_t embedding_rows(Layer *this, const float *input, size_t *row)
+{
+	size_t num = 0;
+	for (size_t f = 0; f < this->size; f++)
+		if (embedding_index(this, input[f], row + num))
+			num++;
+	return num;
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  将输入转换为嵌入表的行号
+ * @param  this  `[IN]`嵌入层
+ * @param  x     输入
+ * @param  index `[OUT]`行号
+ * @return 未越界返回`true`；否则，返回`false`
+ */
+static bool embedding_index(Layer *this, float x, size_t *index)
+{
+	size_t dim = this->next_size / this->size;
+	size_t vocab = this->param_size / dim;
+	if (!(x >= 0.0) || x >= (float)vocab)
+		return false;
+	*index = (size_t)x;
+	return true;
+}
@@ -0,0 +1,56 @@
+#ifndef LAYER_H_
+#define LAYER_H_
+
+#include <stddef.h>
+#include "mlp.h"
+
+/*
+ * 非全连接的通用层，与`new_dense_layer`包装的全连接层一起传入
+ * `new_mlp_net_layers`即可组成异构网络，例如：
+ *
+ *	Layer *layer[4] = {
+ *		new_embedding_layer(8, 1000, 16),
+ *		new_dense_layer(hidden),
+ *		new_residual_layer(block),
+ *		new_softmax_layer(10),
+ *	};
+ *	MLPNet *net = new_mlp_net_layers(4, layer, ce_loss, d_ce_loss);
+ *
+ * 各层的参数均为一维数组，权重按列存储，布局同全连接层。
+ */
+
+/**
+ * @brief  创建 softmax 层
+ *
+ * 无参数，减去最大值后再取指数以免溢出。
+ *
+ * @param  size 输入与输出大小
+ * @return `[OWN]``Layer`指针
+ */
+Layer *new_softmax_layer(size_t size);
+
+/**
+ * @brief  创建残差层，输出为`x + actf(Wx + b)`
+ *
+ * 内层的输入与输出大小须相等，其滑动归一化与丢弃不生效。
+ *
+ * @param  inner `[IN]`内层，拷贝其权重、偏置与激活函数
+ * @return `[OWN]``Layer`指针
+ */
+Layer *new_residual_layer(FCLayer *inner);
+
+/**
+ * @brief  创建嵌入层
+ *
+ * 输入为`field_num`个以`float`表示的下标，输出为各下标对应的嵌入向量依次拼接，
+ * 越界的下标输出`0`。反向传播只写入用到的行，输入梯度恒为`0`。
+ * 梯度按行稀疏（`row_size`为`dim`），每个样本的清零、累加与更新只涉及用到的行。
+ *
+ * @param  field_num 输入的下标个数
+ * @param  vocab     词表大小
+ * @param  dim       嵌入维度
+ * @return `[OWN]``Layer`指针
+ */
+Layer *new_embedding_layer(size_t field_num, size_t vocab, size_t dim);
+
+#endif  /* LAYER_H_ */
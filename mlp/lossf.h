@@ -1,3 +1,6 @@
+#ifndef LOSSF_H_
+#define LOSSF_H_
+
 #include "vector.h"
 
 /**
@@ -16,6 +19,17 @@ float mse_loss(Vector *out, Vector *label);
  */
 Vector *d_mse_loss(Vector *out, Vector *label);
 
+/**
+ * @brief  平方差损失函数对单个输出的导数
+ * @param  out   输出值
+ * @param  label 标签值
+ * @return 导数
+ */
+static inline float d_mse(float out, float label)
+{
+	return 2 * (out - label);
+}
+
 /**
  * @brief  交叉熵损失函数
  * @param  out   `[IN]`网络输出层
@@ -47,3 +61,5 @@ float softmax_ce_loss(Vector *out, Vector *label);
  * @return `[OWN]`输出层梯度
  */
 Vector *d_softmax_ce_loss(Vector *out, Vector *label);
+
+#endif  /* LOSSF_H_ */
@@ -1,26 +1,57 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 #include "vector.h"
 #include "matrix.h"
+#include "pool.h"
 
 /***** 声明 *****/
+/*** 外部 ***/
 
 Matrix *new_matrix(size_t row, size_t col, Vector **val);
+Matrix *new_matrix_view(size_t row, size_t col, float *val);
 static void matrix_free(Matrix *this);
 static void matrix_clear(Matrix *this);
 static void matrix_rand_uniform(Matrix *this, float min, float max);
 static void matrix_transpose(Matrix *this);
+static void matrix_transpose_to(Matrix *this, Matrix *target);
 static void matrix_act(Matrix *this, Vector *target);
 static void matrix_add(Matrix *this, Matrix *target);
 static void matrix_sub(Matrix *this, Matrix *target);
 static void matrix_scale(Matrix *this, float scalar);
+static void matrix_ger(Matrix *this, float alpha, Vector *x, Vector *y);
 static Matrix *matrix_copy(Matrix *this);
 static void matrix_print(Matrix *this, size_t dp);
 
 Matrix *outer(Vector *v1, Vector *v2);
 
+/*** 内部 ***/
+
+/* 并行任务的参数 */
+typedef struct {
+	Matrix *m;     /* 矩阵 */
+	Matrix *t;     /* 另一矩阵 */
+	float *x;      /* 输入 */
+	float *y;      /* 输入或输出 */
+	float alpha;   /* 倍率 */
+} MatrixTask;
+
+static void act_rows(void *arg, size_t begin, size_t end);
+static void add_cols(void *arg, size_t begin, size_t end);
+static void ger_cols(void *arg, size_t begin, size_t end);
+static inline void transpose_block(float *const *src, float *const *dst);
+static void transpose_tile(Vector **src, Vector **dst, size_t i0, size_t j0,
+                           size_t ni, size_t nj);
+static void transpose_square(Matrix *this);
+
 /***** 实现 *****/
+/*** 外部 ***/
 
 Matrix *new_matrix(size_t row, size_t col, Vector **val)
 {
@@ -46,10 +77,47 @@ Matrix *new_matrix(size_t row, size_t col, Vector **val)
 		.clear = matrix_clear,
 		.rand_uniform = matrix_rand_uniform,
 		.transpose = matrix_transpose,
+		.transpose_to = matrix_transpose_to,
 		.act = matrix_act,
 		.add = matrix_add,
 		.sub = matrix_sub,
 		.scale = matrix_scale,
+		.ger = matrix_ger,
+		.copy = matrix_copy,
+		.print = matrix_print,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+Matrix *new_matrix_view(size_t row, size_t col, float *val)
+{
+	Vector **this_val = (Vector**)calloc(col, sizeof(Vector*));
+	if (!this_val)
+		goto fail;
+	for (size_t i = 0; i < col; i++)
+		this_val[i] = new_vector_view(row, val + i * row);
+
+	Matrix *this = (Matrix*)malloc(sizeof(Matrix));
+	if (!this)
+		goto fail;
+	*this = (Matrix) {
+		.row = row,
+		.col = col,
+		.val = this_val,
+
+		.free = matrix_free,
+		.clear = matrix_clear,
+		.rand_uniform = matrix_rand_uniform,
+		.transpose = matrix_transpose,
+		.transpose_to = matrix_transpose_to,
+		.act = matrix_act,
+		.add = matrix_add,
+		.sub = matrix_sub,
+		.scale = matrix_scale,
+		.ger = matrix_ger,
 		.copy = matrix_copy,
 		.print = matrix_print,
 	};
@@ -81,48 +149,54 @@ void matrix_rand_uniform(Matrix *this, float min, float max)
 
 void matrix_transpose(Matrix *this)
 {
-	size_t row = this->row;
-	size_t col = this->col;
+	if (this->row == this->col) {
+		transpose_square(this);
+		return;
+	}
 
-	Vector **new_val = (Vector**)calloc(row, sizeof(Vector*));
-	if (!new_val)
-		goto fail;
-	for (size_t i = 0; i < row; i++) {
-		new_val[i] = new_vector(col, NULL);
-		for (size_t j = 0; j < col; j++)
-			new_val[i]->val[j] = this->val[j]->val[i];
+	Matrix *tmp = new_matrix(this->col, this->row, NULL);
+	this->transpose_to(this, tmp);
+	Vector **val = this->val;
+	this->val = tmp->val;
+	tmp->val = val;
+	tmp->row = this->row;
+	tmp->col = this->col;
+	this->row = tmp->col;
+	this->col = tmp->row;
+	tmp->free(tmp);
+}
+
+static void matrix_transpose_to(Matrix *this, Matrix *target)
+{
+	for (size_t j = 0; j < this->col; j += MATRIX_TILE) {
+		size_t nj = this->col - j < MATRIX_TILE ? this->col - j
+		                                        : MATRIX_TILE;
+		for (size_t i = 0; i < this->row; i += MATRIX_TILE) {
+			size_t ni = this->row - i < MATRIX_TILE ? this->row - i
+			                                        : MATRIX_TILE;
+			transpose_tile(this->val + j, target->val + i, i, j,
+			               ni, nj);
+		}
 	}
-	for (size_t i = 0; i < col; i++)
-		this->val[i]->free(this->val[i]);
-	free(this->val);
-	
-	this->row = col;
-	this->col = row;
-	this->val = new_val;
-	return;
-fail:
-	printf("Memory not enough!");
-	exit(1);
 }
 
 static void matrix_act(Matrix *this, Vector *target)
 {
 	Vector *res = new_vector(this->row, NULL);
-	Vector *tmp;
-	for (size_t i = 0; i < this->col; i++) {
-		tmp = this->val[i]->copy(this->val[i]);
-		tmp->scale(tmp, target->val[i]);
-		res->add(res, tmp);
-		tmp->free(tmp);
-	}
+	MatrixTask task = {.m = this, .x = target->val, .y = res->val};
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, this->row, pool_grain(this->col), act_rows,
+	                   &task);
 	target->set(target, this->row, res->val);
 	res->free(res);
 }
 
 static void matrix_add(Matrix *this, Matrix *target)
 {
-	for (size_t i = 0; i < this->col; i++)
-		this->val[i]->add(this->val[i], target->val[i]);
+	MatrixTask task = {.m = this, .t = target};
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, this->col, pool_grain(this->row), add_cols,
+	                   &task);
 }
 
 static void matrix_sub(Matrix *this, Matrix *target)
@@ -137,6 +211,14 @@ static void matrix_scale(Matrix *this, float scalar)
 		this->val[i]->scale(this->val[i], scalar);
 }
 
+static void matrix_ger(Matrix *this, float alpha, Vector *x, Vector *y)
+{
+	MatrixTask task = {.m = this, .x = x->val, .y = y->val, .alpha = alpha};
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, this->col, pool_grain(this->row), ger_cols,
+	                   &task);
+}
+
 static Matrix *matrix_copy(Matrix *this)
 {
 	return new_matrix(this->row, this->col, this->val);
@@ -198,19 +280,209 @@ fail:
 
 Matrix *outer(Vector *v1, Vector *v2)
 {
-	size_t row = v1->size;
-	size_t col = v2->size;
-	Vector **ret_val = (Vector**)calloc(col, sizeof(Vector*));
-	for (size_t i = 0; i < col; i++) {
-		Vector *tmp;
-		tmp = v1->copy(v1);
-		tmp->scale(tmp, v2->val[i]);
-		ret_val[i] = tmp;
+	Matrix *ret = new_matrix(v1->size, v2->size, NULL);
+	ret->ger(ret, 1.0, v1, v2);
+	return ret;
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief 计算`matrix_act`结果的`[begin, end)`行
+ * @param arg   `[INOUT]``MatrixTask`，`x`为输入，`y`为输出
+ * @param begin 起始行
+ * @param end   终止行（不含）
+ */
+static void act_rows(void *arg, size_t begin, size_t end)
+{
+	MatrixTask *task = (MatrixTask*)arg;
+	for (size_t i = 0; i < task->m->col; i++) {
+		float *col = task->m->val[i]->val;
+		float x = task->x[i];
+		for (size_t j = begin; j < end; j++)
+			task->y[j] += col[j] * x;
 	}
+}
 
-	Matrix *ret = new_matrix(row, col, ret_val);
-	for (size_t i = 0; i < col; i++)
-		ret_val[i]->free(ret_val[i]);
-	free(ret_val);
-	return ret;
+/**
+ * @brief 将`t`的`[begin, end)`列加到`m`上
+ * @param arg   `[INOUT]``MatrixTask`
+ * @param begin 起始列
+ * @param end   终止列（不含）
+ */
+static void add_cols(void *arg, size_t begin, size_t end)
+{
+	MatrixTask *task = (MatrixTask*)arg;
+	for (size_t i = begin; i < end; i++)
+		task->m->val[i]->add(task->m->val[i], task->t->val[i]);
+}
+
+/**
+ * @brief 转置一个完整的 8x8 块：`dst[a][b] = src[b][a]`
+ *
+ * 有 AVX 时以 8 个 256 位寄存器经解包、混洗与跨通道置换完成；
+ * 有 SSE 时分为 4 个 4x4 子块，各以`_MM_TRANSPOSE4_PS`完成；
+ * 否则逐个元素拷贝。`src`与`dst`不可重叠。
+ *
+ * @param src `[IN]`源块的 8 列，每列 8 个连续元素
+ * @param dst `[OUT]`目标块的 8 列
+ */
+static inline void transpose_block(float *const *src, float *const *dst)
+{
+#if defined(__AVX__)
+	__m256 r0 = _mm256_loadu_ps(src[0]);
+	__m256 r1 = _mm256_loadu_ps(src[1]);
+	__m256 r2 = _mm256_loadu_ps(src[2]);
+	__m256 r3 = _mm256_loadu_ps(src[3]);
+	__m256 r4 = _mm256_loadu_ps(src[4]);
+	__m256 r5 = _mm256_loadu_ps(src[5]);
+	__m256 r6 = _mm256_loadu_ps(src[6]);
+	__m256 r7 = _mm256_loadu_ps(src[7]);
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+	__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+	__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+	__m256 t4 = _mm256_unpacklo_ps(r4, r5);
+	__m256 t5 = _mm256_unpackhi_ps(r4, r5);
+	__m256 t6 = _mm256_unpacklo_ps(r6, r7);
+	__m256 t7 = _mm256_unpackhi_ps(r6, r7);
+	r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	r4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	r5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	r6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+	r7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+	_mm256_storeu_ps(dst[0], _mm256_permute2f128_ps(r0, r4, 0x20));
+	_mm256_storeu_ps(dst[1], _mm256_permute2f128_ps(r1, r5, 0x20));
+	_mm256_storeu_ps(dst[2], _mm256_permute2f128_ps(r2, r6, 0x20));
+	_mm256_storeu_ps(dst[3], _mm256_permute2f128_ps(r3, r7, 0x20));
+	_mm256_storeu_ps(dst[4], _mm256_permute2f128_ps(r0, r4, 0x31));
+	_mm256_storeu_ps(dst[5], _mm256_permute2f128_ps(r1, r5, 0x31));
+	_mm256_storeu_ps(dst[6], _mm256_permute2f128_ps(r2, r6, 0x31));
+	_mm256_storeu_ps(dst[7], _mm256_permute2f128_ps(r3, r7, 0x31));
+#elif defined(__SSE__)
+	for (size_t a = 0; a < 8; a += 4) {
+		for (size_t b = 0; b < 8; b += 4) {
+			__m128 r0 = _mm_loadu_ps(src[b] + a);
+			__m128 r1 = _mm_loadu_ps(src[b + 1] + a);
+			__m128 r2 = _mm_loadu_ps(src[b + 2] + a);
+			__m128 r3 = _mm_loadu_ps(src[b + 3] + a);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(dst[a] + b, r0);
+			_mm_storeu_ps(dst[a + 1] + b, r1);
+			_mm_storeu_ps(dst[a + 2] + b, r2);
+			_mm_storeu_ps(dst[a + 3] + b, r3);
+		}
+	}
+#else
+	for (size_t a = 0; a < 8; a++)
+		for (size_t b = 0; b < 8; b++)
+			dst[a][b] = src[b][a];
+#endif
+}
+
+/**
+ * @brief 转置一块：`dst[a][j0 + b] = src[b][i0 + a]`
+ *
+ * 完整的块由`transpose_block`转置；边缘不足一块的部分先整块读入局部缓冲区，
+ * 再按目标列连续写出。
+ *
+ * @param src `[IN]`源矩阵自第`j0`列起的列向量
+ * @param dst `[OUT]`目标矩阵自第`i0`列起的列向量
+ * @param i0  块在源矩阵中的起始行
+ * @param j0  块在源矩阵中的起始列
+ * @param ni  块的行数
+ * @param nj  块的列数
+ */
+static void transpose_tile(Vector **src, Vector **dst, size_t i0, size_t j0,
+                           size_t ni, size_t nj)
+{
+	if (ni == MATRIX_TILE && nj == MATRIX_TILE) {
+		float *s[MATRIX_TILE];
+		float *d[MATRIX_TILE];
+		for (size_t k = 0; k < MATRIX_TILE; k++) {
+			s[k] = src[k]->val + i0;
+			d[k] = dst[k]->val + j0;
+		}
+		transpose_block(s, d);
+		return;
+	}
+
+	float tile[MATRIX_TILE][MATRIX_TILE];
+	for (size_t b = 0; b < nj; b++) {
+		float *s = src[b]->val + i0;
+		for (size_t a = 0; a < ni; a++)
+			tile[a][b] = s[a];
+	}
+	for (size_t a = 0; a < ni; a++) {
+		float *d = dst[a]->val + j0;
+		for (size_t b = 0; b < nj; b++)
+			d[b] = tile[a][b];
+	}
+}
+
+/**
+ * @brief 原地分块转置方阵
+ *
+ * 块`(i0, j0)`与`(j0, i0)`成对交换：前者经`transpose_block`转置到局部缓冲区，
+ * 后者转置到前者的位置，再将缓冲区写入后者的位置。
+ */
+static void transpose_square(Matrix *this)
+{
+	size_t n = this->row;
+	Vector **val = this->val;
+	for (size_t i0 = 0; i0 < n; i0 += MATRIX_TILE) {
+		size_t ni = n - i0 < MATRIX_TILE ? n - i0 : MATRIX_TILE;
+		for (size_t j0 = i0; j0 < n; j0 += MATRIX_TILE) {
+			size_t nj = n - j0 < MATRIX_TILE ? n - j0 : MATRIX_TILE;
+			if (ni == MATRIX_TILE && nj == MATRIX_TILE) {
+				float tile[MATRIX_TILE][MATRIX_TILE];
+				float *t[MATRIX_TILE];
+				float *s[MATRIX_TILE];
+				float *d[MATRIX_TILE];
+				for (size_t k = 0; k < MATRIX_TILE; k++) {
+					t[k] = tile[k];
+					s[k] = val[j0 + k]->val + i0;
+					d[k] = val[i0 + k]->val + j0;
+				}
+				transpose_block(s, t);
+				if (i0 != j0)
+					transpose_block(d, s);
+				for (size_t k = 0; k < MATRIX_TILE; k++)
+					memcpy(d[k], tile[k], sizeof(tile[k]));
+				continue;
+			}
+			for (size_t b = 0; b < nj; b++) {
+				/*
+				 * 对角块只遍历行号大于列号的下三角部分，
+				 * 每个元素与其关于对角线的镜像交换
+				 */
+				size_t a = i0 == j0 ? b + 1 : 0;
+				for (; a < ni; a++) {
+					float tmp = val[j0 + b]->val[i0 + a];
+					val[j0 + b]->val[i0 + a] = val[i0 + a]->val[j0 + b];
+					val[i0 + a]->val[j0 + b] = tmp;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief 对`[begin, end)`列做秩一更新
+ * @param arg   `[INOUT]``MatrixTask`，`x`为列向量，`y`为行向量
+ * @param begin 起始列
+ * @param end   终止列（不含）
+ */
+static void ger_cols(void *arg, size_t begin, size_t end)
+{
+	MatrixTask *task = (MatrixTask*)arg;
+	for (size_t i = begin; i < end; i++) {
+		float *col = task->m->val[i]->val;
+		float a = task->alpha * task->y[i];
+		for (size_t j = 0; j < task->m->row; j++)
+			col[j] += a * task->x[j];
+	}
 }
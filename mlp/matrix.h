@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include "vector.h"
 
+#define MATRIX_TILE 8  /* 分块转置的块大小 */
+
 typedef struct Matrix Matrix;
 
 /***** Matrix *****/
@@ -31,10 +33,16 @@ struct Matrix {
 	void (*rand_uniform)(Matrix *this, float min, float max);
 
 	/**
-	 * @brief 转置矩阵
+	 * @brief 转置矩阵，方阵原地转置，否则经临时矩阵分块转置
 	 */
 	void (*transpose)(Matrix *this);
 
+	/**
+	 * @brief 分块转置到已分配的`Matrix`，不分配内存
+	 * @param target `[OUT]`转置结果，行列数须与自身相反
+	 */
+	void (*transpose_to)(Matrix *this, Matrix *target);
+
 	/**
 	 * @brief  作用于`Vector`
 	 * @param  target `[INOUT]`作用的`Vector`
@@ -59,6 +67,14 @@ struct Matrix {
 	 */
 	void (*scale)(Matrix *this, float scalar);
 
+	/**
+	 * @brief 秩一更新，即`this += alpha * x * y^T`，不分配内存
+	 * @param alpha 倍率
+	 * @param x     `[IN]`列向量，长度为行数
+	 * @param y     `[IN]`行向量，长度为列数
+	 */
+	void (*ger)(Matrix *this, float alpha, Vector *x, Vector *y);
+
 	/**
 	 * @brief  拷贝自身
 	 * @return `[OWN]`拷贝
@@ -81,6 +97,19 @@ struct Matrix {
  */
 Matrix *new_matrix(size_t row, size_t col, Vector **val);
 
+/**
+ * @brief  创建引用外部存储的`Matrix`
+ *
+ * 各列为`new_vector_view`，`free`不释放`val`。
+ * 非方阵`transpose`后将改用自有存储，不再引用`val`。
+ *
+ * @param  row 行数
+ * @param  col 列数
+ * @param  val `[IN]`值，按列连续存储
+ * @return `[OWN]``Matrix`指针
+ */
+Matrix *new_matrix_view(size_t row, size_t col, float *val);
+
 /***** 其他 *****/
 
 /**
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __GLIBC__
+#include <malloc.h>  /* malloc_usable_size */
+#endif
+#include "vector.h"
+#include "matrix.h"
+#include "memory.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+size_t mem_total(MemStat *stat);
+void mem_add(MemStat *stat, MemStat *target);
+void mem_track(MemStat *stat, size_t *field, void *ptr, size_t size);
+void mem_vector(MemStat *stat, size_t *field, Vector *vector, bool view);
+void mem_matrix(MemStat *stat, size_t *field, Matrix *matrix, bool view);
+size_t mem_chunk(size_t size);
+void mem_print(MemStat *stat, char *name);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+size_t mem_total(MemStat *stat)
+{
+	return stat->param + stat->activation + stat->grad + stat->data
+	       + stat->object + stat->overhead;
+}
+
+void mem_add(MemStat *stat, MemStat *target)
+{
+	stat->param += target->param;
+	stat->activation += target->activation;
+	stat->grad += target->grad;
+	stat->data += target->data;
+	stat->object += target->object;
+	stat->overhead += target->overhead;
+	stat->alloc_num += target->alloc_num;
+}
+
+void mem_track(MemStat *stat, size_t *field, void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	size_t chunk;
+#ifdef __GLIBC__
+	chunk = malloc_usable_size(ptr) + sizeof(size_t);
+#else
+	chunk = mem_chunk(size);
+#endif
+	*field += size;
+	stat->overhead += chunk > size ? chunk - size : 0;
+	stat->alloc_num++;
+}
+
+void mem_vector(MemStat *stat, size_t *field, Vector *vector, bool view)
+{
+	if (!vector)
+		return;
+	mem_track(stat, &stat->object, vector, sizeof(Vector));
+	if (!view)
+		mem_track(stat, field, vector->val, sizeof(float) * vector->size);
+}
+
+void mem_matrix(MemStat *stat, size_t *field, Matrix *matrix, bool view)
+{
+	mem_track(stat, &stat->object, matrix, sizeof(Matrix));
+	mem_track(stat, &stat->object, matrix->val,
+	          sizeof(Vector*) * matrix->col);
+	for (size_t i = 0; i < matrix->col; i++)
+		mem_vector(stat, field, matrix->val[i], view);
+}
+
+size_t mem_chunk(size_t size)
+{
+	size_t chunk = (size + sizeof(size_t) + 15) & ~(size_t)15;
+	return chunk < 32 ? 32 : chunk;
+}
+
+void mem_print(MemStat *stat, char *name)
+{
+	printf("%s: %zu bytes in %zu allocations\n", name, mem_total(stat),
+	       stat->alloc_num);
+	printf("  param %zu, activation %zu, grad %zu, data %zu, "
+	       "object %zu, overhead %zu\n", stat->param, stat->activation,
+	       stat->grad, stat->data, stat->object, stat->overhead);
+}
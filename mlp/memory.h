@@ -0,0 +1,86 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+
+typedef struct MemStat MemStat;
+
+/***** MemStat *****/
+
+/*
+ * 内存占用统计，单位均为字节。
+ *
+ * 除`overhead`外均为申请的字节数。`overhead`为分配器实际占用与申请之差，
+ * 即块头、对齐与最小块的补齐：glibc 下由`malloc_usable_size`得到，
+ * 其他平台按 glibc 的分块规则估计。
+ * 引用他处存储的视图只计其结构体。
+ */
+struct MemStat {
+	size_t param;       /* 参数 */
+	size_t activation;  /* 中间结果、工作区与丢弃掩码 */
+	size_t grad;        /* 梯度与反向传播缓冲区 */
+	size_t data;        /* 数据集样本 */
+	size_t object;      /* 结构体（含方法指针）与指针数组 */
+	size_t overhead;    /* 分配器开销 */
+	size_t alloc_num;   /* 分配次数 */
+};
+
+/**
+ * @brief  获取合计的字节数
+ * @param  stat `[IN]`统计
+ * @return 除`alloc_num`外各项之和
+ */
+size_t mem_total(MemStat *stat);
+
+/**
+ * @brief 累加
+ * @param stat   `[INOUT]`统计
+ * @param target `[IN]`另一统计
+ */
+void mem_add(MemStat *stat, MemStat *target);
+
+/**
+ * @brief 记一次分配
+ * @param stat  `[INOUT]`统计
+ * @param field `[INOUT]``stat`中所属的一项
+ * @param ptr   `[IN]`分配得到的指针，可为`NULL`
+ * @param size  申请的字节数
+ */
+void mem_track(MemStat *stat, size_t *field, void *ptr, size_t size);
+
+/**
+ * @brief 记一个`Vector`
+ * @param stat   `[INOUT]`统计
+ * @param field  `[INOUT]`值所属的一项，为视图时忽略
+ * @param vector `[IN]``Vector`，可为`NULL`
+ * @param view   是否为视图
+ */
+void mem_vector(MemStat *stat, size_t *field, Vector *vector, bool view);
+
+/**
+ * @brief 记一个`Matrix`
+ * @param stat   `[INOUT]`统计
+ * @param field  `[INOUT]`值所属的一项，为视图时忽略
+ * @param matrix `[IN]``Matrix`
+ * @param view   是否为视图
+ */
+void mem_matrix(MemStat *stat, size_t *field, Matrix *matrix, bool view);
+
+/**
+ * @brief  估计一次分配实际占用的字节数（64 位 glibc 的分块规则）
+ * @param  size 申请的字节数
+ * @return 含块头与补齐的字节数
+ */
+size_t mem_chunk(size_t size);
+
+/**
+ * @brief 打印
+ * @param stat `[IN]`统计
+ * @param name 名称
+ */
+void mem_print(MemStat *stat, char *name);
+
+#endif  /* MEMORY_H_ */
@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "vector.h"
 #include "matrix.h"
+#include "memory.h"
 #include "mlp.h"
 #include "rand.h"
+#include "actf.h"
+#include "pool.h"
 
 /***** 声明 *****/
 /*** 外部 ***/
@@ -15,29 +19,126 @@ FCLayer *new_fc_layer(size_t size, size_t next_size, Matrix *weight,
 static void fc_layer_free(FCLayer *this);
 static void fc_layer_clear(FCLayer *this);
 static void fc_layer_forward(FCLayer *this, Vector *input);
+static bool fc_layer_runnorm(FCLayer *this);
 static void fc_layer_add(FCLayer *this, FCLayer *target);
 static void fc_layer_sub(FCLayer *this, FCLayer *target);
 static void fc_layer_scale(FCLayer *this, float scalar);
 static FCLayer *fc_layer_copy(FCLayer *this);
 
+Layer *new_layer(size_t size, size_t next_size, size_t param_size,
+                 size_t work_size);
+Layer *new_dense_layer(FCLayer *fc);
+static void layer_free(Layer *this);
+static Layer *layer_copy(Layer *this);
+static void layer_bind(Layer *this, float *param);
+
 MLPNet *new_mlp_net(size_t size, FCLayer **layer,
                     float (*lossf)(Vector*, Vector*),
                     Vector *(*dlossf)(Vector*, Vector*));
+MLPNet *new_mlp_net_layers(size_t size, Layer **layer,
+                           float (*lossf)(Vector*, Vector*),
+                           Vector *(*dlossf)(Vector*, Vector*));
 static void mlp_net_free(MLPNet *this);
 static void mlp_net_init_xavier(MLPNet *this);
+static void mlp_net_init(MLPNet *this, MLPInit kind, uint64_t seed);
 static void mlp_net_forward(MLPNet *this, Vector *input);
+static Vector *mlp_net_output(MLPNet *this);
 static void mlp_net_grad(MLPNet *this, Vector *label, MLPGrad *grad);
-static void mlp_net_update(MLPNet *this, MLPGrad *grad);
+static MLPNet *mlp_net_fold(MLPNet *this);
+static MLPNet *mlp_net_share(MLPNet *this);
+static void mlp_net_set_checkpoint(MLPNet *this, size_t stride);
+static size_t mlp_net_activation_bytes(MLPNet *this);
+static MemStat mlp_net_memory(MLPNet *this, MemStat *layer);
+static bool mlp_net_update(MLPNet *this, MLPGrad *grad, float rate);
+static void mlp_net_predict_batch(MLPNet *this, Vector **input, size_t num,
+                                  size_t *res, Vector **prob);
+static bool mlp_net_export_c(MLPNet *this, char *path, char *name);
 
 MLPGrad *new_mlp_grad(MLPNet *net);
 static void mlp_grad_free(MLPGrad *this);
 static void mlp_grad_clear(MLPGrad *this);
 static void mlp_grad_add(MLPGrad *this, MLPGrad *target);
 static void mlp_grad_scale(MLPGrad *this, float scalar);
+static void mlp_grad_touch_all(MLPGrad *this);
+static MemStat mlp_grad_memory(MLPGrad *this);
 
 /*** 内部 ***/
 
-static void backward(FCLayer *net, FCLayer *grad, Vector *out_grad);
+/* 批量前向传播任务的参数 */
+typedef struct {
+	FCLayer *layer;  /* 网络层 */
+	float *input;    /* 输入 */
+	float *pre;      /* 线性变换结果，可为`NULL` */
+	float *output;   /* 输出 */
+	bool update;     /* 是否更新滑动归一化的统计量，仅用于单个输入 */
+	uint64_t *mask;  /* 丢弃掩码，仅用于单个输入，可为`NULL` */
+} BatchTask;
+
+/* 逐段处理梯度的参数 */
+typedef struct SegmentTask SegmentTask;
+struct SegmentTask {
+	float *param;     /* 参数，`add`时为被加数 */
+	float *grad;      /* 梯度，`add`时为加数 */
+	float scalar;     /* 学习率或倍率 */
+	double norm2;     /* 平方和 */
+	double *partial;  /* 各块的平方和，见`MLPGrad::partial` */
+	size_t begin;     /* 正在分块处理的区间起点 */
+	size_t end;       /* 正在分块处理的区间终点（不含） */
+	/* 处理`[begin, end)`，返回其平方和，不求平方和时返回`0` */
+	double (*block)(SegmentTask *task, size_t begin, size_t end);
+};
+
+/* 初始化任务的参数 */
+typedef struct {
+	Matrix *weight;  /* 权重 */
+	MLPInit kind;    /* 初始化方式 */
+	uint64_t key;    /* 密钥 */
+	float scale;     /* 均一分布的边界或正态分布的标准差 */
+} InitTask;
+
+static void fc_post(FCLayer *layer, float *z, float *pre, float *out,
+                    bool update, uint64_t *mask);
+static void reset_runnorm(FCLayer *layer);
+static uint32_t dropout_keep(float dropout);
+static void dropout_mask(FCLayer *layer);
+static void backward(FCLayer *net, Vector *node, Vector *pre, MLPGrad *grad,
+                     size_t index, Vector *out_grad, Vector *node_grad);
+static void grad_checkpoint(MLPNet *this, MLPGrad *grad, Vector *out_grad,
+                            Vector *node_grad);
+static float *forward_segment(MLPNet *this, size_t begin, bool train);
+static size_t recompute_size(MLPNet *this, size_t stride);
+static void keep_activation(Vector **v, bool keep, size_t size);
+static size_t max_width(Layer **layer, size_t size);
+static size_t dense_param_size(FCLayer *fc);
+static size_t param_count(Layer **layer, size_t size);
+static size_t param_alloc_size(size_t size);
+static float *param_alloc(size_t size);
+static void param_views(Layer **layer, size_t size, float *param,
+                        Matrix **weight, Vector **bias, Vector **gamma,
+                        Vector **beta, Vector **mean, Vector **var);
+static void param_bind(Layer **layer, size_t size, float *param);
+static double param_norm2(const float *param, size_t size);
+static double add_norm2(float *restrict a, const float *restrict b,
+                        size_t size);
+static GradRows *rows_alloc(Layer *layer);
+static void rows_free(GradRows *rows);
+static void rows_clear(GradRows *rows, float *param);
+static void rows_reset(GradRows *rows, Layer *layer, float *param);
+static void rows_add(GradRows *rows, GradRows *src, float *a, const float *b);
+static void grad_segments(MLPGrad *grad, SegmentTask *task);
+static void segment_run(SegmentTask *task, size_t begin, size_t end);
+static void segment_blocks(void *arg, size_t begin, size_t end);
+static double segment_norm2(SegmentTask *task, size_t begin, size_t end);
+static double segment_add(SegmentTask *task, size_t begin, size_t end);
+static double segment_update(SegmentTask *task, size_t begin, size_t end);
+static double segment_scale(SegmentTask *task, size_t begin, size_t end);
+static void forward_batch(FCLayer *layer, float *input, float *pre,
+                          float *output, size_t num, bool update,
+                          uint64_t *mask);
+static void forward_rows(void *arg, size_t begin, size_t end);
+static void init_cols(void *arg, size_t begin, size_t end);
+static const char *actf_expr(float (*actf)(float));
+static void export_array(FILE *file, float *val, size_t size);
 
 /***** 实现 *****/
 /*** 外部 ***/
@@ -59,9 +160,11 @@ FCLayer *new_fc_layer(size_t size, size_t next_size, Matrix *weight,
 		this_bias = new_vector(next_size, NULL);
 	Vector *this_pre = new_vector(next_size, NULL);
 	Vector *this_out = new_vector(next_size, NULL);
+	uint64_t *this_mask = (uint64_t*)calloc((next_size + 63) / 64,
+	                                        sizeof(uint64_t));
 
 	FCLayer *this = (FCLayer*)malloc(sizeof(FCLayer));
-	if (!this)
+	if (!this || !this_mask)
 		goto fail;
 	*this = (FCLayer) {
 		.size = size,
@@ -71,12 +174,20 @@ FCLayer *new_fc_layer(size_t size, size_t next_size, Matrix *weight,
 		.bias = this_bias,
 		.pre = this_pre,
 		.out = this_out,
+		.gamma = NULL,
+		.beta = NULL,
+		.mean = NULL,
+		.var = NULL,
+		.dropout = 0.0,
+		.mask = this_mask,
+		.bound = false,
 		.actf = actf,
 		.dactf = dactf,
 
 		.free = fc_layer_free,
 		.clear = fc_layer_clear,
 		.forward = fc_layer_forward,
+		.runnorm = fc_layer_runnorm,
 		.add = fc_layer_add,
 		.sub = fc_layer_sub,
 		.scale = fc_layer_scale,
@@ -90,21 +201,40 @@ fail:
 
 static void fc_layer_free(FCLayer *this)
 {
-	this->node->free(this->node);
+	if (this->node)
+		this->node->free(this->node);
 	this->weight->free(this->weight);
 	this->bias->free(this->bias);
-	this->pre->free(this->pre);
-	this->out->free(this->out);
+	if (this->pre)
+		this->pre->free(this->pre);
+	if (this->out)
+		this->out->free(this->out);
+	if (this->gamma) {
+		this->gamma->free(this->gamma);
+		this->beta->free(this->beta);
+		this->mean->free(this->mean);
+		this->var->free(this->var);
+	}
+	free(this->mask);
 	free(this);
 }
 
 static void fc_layer_clear(FCLayer *this)
 {
-	this->node->clear(this->node);
+	if (this->node)
+		this->node->clear(this->node);
 	this->weight->clear(this->weight);
 	this->bias->clear(this->bias);
-	this->pre->clear(this->pre);
-	this->out->clear(this->out);
+	if (this->pre)
+		this->pre->clear(this->pre);
+	if (this->out)
+		this->out->clear(this->out);
+	if (this->gamma) {
+		this->gamma->clear(this->gamma);
+		this->beta->clear(this->beta);
+		this->mean->clear(this->mean);
+		this->var->clear(this->var);
+	}
 }
 
 static void fc_layer_forward(FCLayer *this, Vector *input)
@@ -113,45 +243,229 @@ static void fc_layer_forward(FCLayer *this, Vector *input)
 	this->node->set(this->node, this->size, tmp->val);
 	this->weight->act(this->weight, tmp);
 	tmp->add(tmp, this->bias);
-	this->pre->set(this->pre, this->next_size, tmp->val);
-	tmp->map(tmp, this->actf);
-	this->out->set(this->out, this->next_size, tmp->val);
+	if (this->dropout > 0.0)
+		dropout_mask(this);
+	fc_post(this, tmp->val, this->pre->val, this->out->val, true,
+	        this->dropout > 0.0 ? this->mask : NULL);
 	tmp->free(tmp);
 }
 
+static bool fc_layer_runnorm(FCLayer *this)
+{
+	if (this->gamma)
+		return true;
+	if (this->bound)
+		return false;
+	this->gamma = new_vector(this->next_size, NULL);
+	this->beta = new_vector(this->next_size, NULL);
+	this->mean = new_vector(this->next_size, NULL);
+	this->var = new_vector(this->next_size, NULL);
+	reset_runnorm(this);
+	return true;
+}
+
 static void fc_layer_add(FCLayer *this, FCLayer *target)
 {
 	this->weight->add(this->weight, target->weight);
 	this->bias->add(this->bias, target->bias);
+	if (this->gamma && target->gamma) {
+		this->gamma->add(this->gamma, target->gamma);
+		this->beta->add(this->beta, target->beta);
+	}
 }
 
 static void fc_layer_sub(FCLayer *this, FCLayer *target)
 {
 	this->weight->sub(this->weight, target->weight);
 	this->bias->sub(this->bias, target->bias);
+	if (this->gamma && target->gamma) {
+		this->gamma->sub(this->gamma, target->gamma);
+		this->beta->sub(this->beta, target->beta);
+	}
 }
 
 static void fc_layer_scale(FCLayer *this, float scalar)
 {
 	this->weight->scale(this->weight, scalar);
 	this->bias->scale(this->bias, scalar);
+	if (this->gamma) {
+		this->gamma->scale(this->gamma, scalar);
+		this->beta->scale(this->beta, scalar);
+	}
 }
 
 static FCLayer *fc_layer_copy(FCLayer *this)
 {
-	new_fc_layer(this->size, this->next_size, this->weight, this->bias,
-	             this->actf, this->dactf);
+	FCLayer *copy = new_fc_layer(this->size, this->next_size, this->weight,
+	                             this->bias, this->actf, this->dactf);
+	if (this->gamma) {
+		copy->gamma = this->gamma->copy(this->gamma);
+		copy->beta = this->beta->copy(this->beta);
+		copy->mean = this->mean->copy(this->mean);
+		copy->var = this->var->copy(this->var);
+	}
+	copy->dropout = this->dropout;
+	return copy;
+}
+
+Layer *new_layer(size_t size, size_t next_size, size_t param_size,
+                 size_t work_size)
+{
+	Vector *this_node = new_vector(size, NULL);
+	Vector *this_out = new_vector(next_size, NULL);
+	float *this_work = (float*)calloc(work_size ? work_size : 1,
+	                                  sizeof(float));
+	float *this_param = (float*)calloc(param_size ? param_size : 1,
+	                                   sizeof(float));
+
+	Layer *this = (Layer*)malloc(sizeof(Layer));
+	if (!this || !this_work || !this_param)
+		goto fail;
+	*this = (Layer) {
+		.size = size,
+		.next_size = next_size,
+		.param_size = param_size,
+		.work_size = work_size,
+		.row_size = 0,
+		.offset = 0,
+		.fc = NULL,
+		.node = this_node,
+		.out = this_out,
+		.work = this_work,
+		.param = this_param,
+		.own_param = true,
+		.actf = NULL,
+		.dactf = NULL,
+
+		.free = layer_free,
+		.copy = layer_copy,
+		.bind = layer_bind,
+		.init = NULL,
+		.forward = NULL,
+		.backward = NULL,
+		.rows = NULL,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+Layer *new_dense_layer(FCLayer *fc)
+{
+	FCLayer *this_fc = fc->copy(fc);
+
+	Layer *this = (Layer*)malloc(sizeof(Layer));
+	if (!this)
+		goto fail;
+	*this = (Layer) {
+		.size = fc->size,
+		.next_size = fc->next_size,
+		.param_size = dense_param_size(fc),
+		.work_size = 0,
+		.row_size = 0,
+		.offset = 0,
+		.fc = this_fc,
+		.node = NULL,
+		.out = NULL,
+		.work = NULL,
+		.param = NULL,
+		.own_param = false,
+		.actf = fc->actf,
+		.dactf = fc->dactf,
+
+		.free = layer_free,
+		.copy = layer_copy,
+		.bind = NULL,
+		.init = NULL,
+		.forward = NULL,
+		.backward = NULL,
+		.rows = NULL,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void layer_free(Layer *this)
+{
+	if (this->fc)
+		this->fc->free(this->fc);
+	if (this->node)
+		this->node->free(this->node);
+	if (this->out)
+		this->out->free(this->out);
+	free(this->work);
+	if (this->own_param)
+		free(this->param);
+	free(this);
+}
+
+static Layer *layer_copy(Layer *this)
+{
+	if (this->fc)
+		return new_dense_layer(this->fc);
+	Layer *copy = new_layer(this->size, this->next_size, this->param_size,
+	                        this->work_size);
+	memcpy(copy->param, this->param, sizeof(float) * this->param_size);
+	copy->row_size = this->row_size;
+	copy->actf = this->actf;
+	copy->dactf = this->dactf;
+	copy->free = this->free;
+	copy->copy = this->copy;
+	copy->bind = this->bind;
+	copy->init = this->init;
+	copy->forward = this->forward;
+	copy->backward = this->backward;
+	copy->rows = this->rows;
+	return copy;
+}
+
+static void layer_bind(Layer *this, float *param)
+{
+	memcpy(param, this->param, sizeof(float) * this->param_size);
+	if (this->own_param)
+		free(this->param);
+	this->param = param;
+	this->own_param = false;
 }
 
 MLPNet *new_mlp_net(size_t size, FCLayer **layer,
                     float (*lossf)(Vector*, Vector*),
                     Vector *(*dlossf)(Vector*, Vector*))
 {
-	FCLayer **this_layer = (FCLayer**)calloc(size, sizeof(FCLayer*));
+	Layer **dense = (Layer**)calloc(size, sizeof(Layer*));
+	if (!dense)
+		goto fail;
+	for (size_t i = 0; i < size; i++)
+		dense[i] = new_dense_layer(layer[i]);
+	MLPNet *this = new_mlp_net_layers(size, dense, lossf, dlossf);
+	for (size_t i = 0; i < size; i++)
+		dense[i]->free(dense[i]);
+	free(dense);
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+MLPNet *new_mlp_net_layers(size_t size, Layer **layer,
+                           float (*lossf)(Vector*, Vector*),
+                           Vector *(*dlossf)(Vector*, Vector*))
+{
+	size_t this_param_size = param_count(layer, size);
+	float *this_param = param_alloc(this_param_size);
+	Layer **this_layer = (Layer**)calloc(size, sizeof(Layer*));
 	if (!this_layer)
 		goto fail;
 	for (size_t i = 0; i < size; i++)
 		this_layer[i] = layer[i]->copy(layer[i]);
+	param_bind(this_layer, size, this_param);
+	float *this_backprop = (float*)calloc(2 * max_width(layer, size),
+	                                      sizeof(float));
+	if (!this_backprop)
+		goto fail;
 	
 	MLPNet *this = (MLPNet*)malloc(sizeof(MLPNet));
 	if (!this)
@@ -161,12 +475,31 @@ MLPNet *new_mlp_net(size_t size, FCLayer **layer,
 		.layer = this_layer,
 		.lossf = lossf,
 		.dlossf = dlossf,
+		.param_size = this_param_size,
+		.param = this_param,
+		.own_param = true,
+		.clip_norm = 0.0,
+		.guard = MLP_GUARD_SKIP,
+		.clip_num = 0,
+		.skip_num = 0,
+		.backprop = this_backprop,
+		.grad_hook = NULL,
+		.grad_hook_arg = NULL,
 
 		.free = mlp_net_free,
 		.init_xavier = mlp_net_init_xavier,
+		.init = mlp_net_init,
 		.forward = mlp_net_forward,
+		.output = mlp_net_output,
 		.grad = mlp_net_grad,
+		.fold = mlp_net_fold,
+		.share = mlp_net_share,
+		.set_checkpoint = mlp_net_set_checkpoint,
+		.activation_bytes = mlp_net_activation_bytes,
+		.memory = mlp_net_memory,
 		.update = mlp_net_update,
+		.predict_batch = mlp_net_predict_batch,
+		.export_c = mlp_net_export_c,
 	};
 	return this;
 fail:
@@ -178,66 +511,531 @@ static void mlp_net_free(MLPNet *this)
 {
 	for (size_t i = 0; i < this->size; i++)
 		this->layer[i]->free(this->layer[i]);
+	free(this->layer);
+	if (this->own_param)
+		free(this->param);
+	free(this->recompute);
+	free(this->backprop);
 	free(this);
 }
 
 static void mlp_net_init_xavier(MLPNet *this)
 {
+	this->init(this, MLP_INIT_XAVIER_UNIFORM, rand_next());
+}
+
+static void mlp_net_init(MLPNet *this, MLPInit kind, uint64_t seed)
+{
+	Pool *pool = pool_global();
 	for (size_t i = 0; i < this->size; i++) {
-		FCLayer *layer = this->layer[i];
-		float bound = sqrt(6.0 / (layer->size + layer->next_size));
-		layer->weight->rand_uniform(layer->weight, -bound , bound);
+		uint64_t key = seed ^ ((i + 1) * 0x9e3779b97f4a7c15ULL);
+		if (!this->layer[i]->fc) {
+			if (this->layer[i]->init)
+				this->layer[i]->init(this->layer[i], key);
+			continue;
+		}
+		FCLayer *layer = this->layer[i]->fc;
+		float fan_in = layer->size;
+		float fan_out = layer->next_size;
+		InitTask task = {
+			.weight = layer->weight,
+			.kind = kind,
+			.key = key,
+		};
+		switch (kind) {
+		case MLP_INIT_XAVIER_UNIFORM:
+			task.scale = sqrt(6.0 / (fan_in + fan_out));
+			break;
+		case MLP_INIT_XAVIER_NORMAL:
+			task.scale = sqrt(2.0 / (fan_in + fan_out));
+			break;
+		case MLP_INIT_HE_UNIFORM:
+			task.scale = sqrt(6.0 / fan_in);
+			break;
+		case MLP_INIT_HE_NORMAL:
+			task.scale = sqrt(2.0 / fan_in);
+			break;
+		}
+		pool->parallel_for(pool, 0, layer->weight->col,
+		                   pool_grain(layer->weight->row * 16), init_cols,
+		                   &task);
 		layer->bias->clear(layer->bias);
+		if (layer->gamma)
+			reset_runnorm(layer);
 	}
 }
 
 static void mlp_net_forward(MLPNet *this, Vector *input)
 {
+	if (this->checkpoint) {
+		float *in = input->val;
+		for (size_t i = 0; i < this->size; i += this->checkpoint) {
+			FCLayer *layer = this->layer[i]->fc;
+			memcpy(layer->node->val, in, sizeof(float) * layer->size);
+			in = forward_segment(this, i, true);
+		}
+		FCLayer *last = this->layer[this->size - 1]->fc;
+		memcpy(last->out->val, in, sizeof(float) * last->next_size);
+		return;
+	}
 	for (size_t i = 0; i < this->size; i++) {
-		FCLayer *layer = this->layer[i];
-		layer->forward(layer, input);
-		input = layer->out;	
+		Layer *layer = this->layer[i];
+		if (layer->fc) {
+			layer->fc->forward(layer->fc, input);
+			input = layer->fc->out;
+		} else {
+			memcpy(layer->node->val, input->val,
+			       sizeof(float) * layer->size);
+			layer->forward(layer, layer->node->val, layer->out->val,
+			               layer->work, true);
+			input = layer->out;
+		}
 	}
 }
 
+static Vector *mlp_net_output(MLPNet *this)
+{
+	Layer *last = this->layer[this->size - 1];
+	return last->fc ? last->fc->out : last->out;
+}
+
 static void mlp_net_grad(MLPNet *this, Vector *label, MLPGrad *grad)
 {
-	Vector *out = this->layer[this->size - 1]->out;
-	Vector *out_grad = this->dlossf(out, label);
-	Vector *tmp = out_grad;
-	for (size_t i = this->size; i-- > 0; ) {
-		backward(this->layer[i], grad->layer[i], out_grad);
-		out_grad = grad->layer[i]->node;
+	Vector *out_grad = this->dlossf(this->output(this), label);
+	size_t width = max_width(this->layer, this->size);
+	Vector *node_grad[2] = {
+		new_vector_view(0, this->backprop),
+		new_vector_view(0, this->backprop + width),
+	};
+	if (this->checkpoint) {
+		grad_checkpoint(this, grad, out_grad, node_grad[0]);
+	} else {
+		Vector *in_grad = out_grad;
+		for (size_t i = this->size; i-- > 0; ) {
+			Layer *layer = this->layer[i];
+			Vector *g = node_grad[i % 2];
+			g->size = layer->size;
+			if (layer->fc) {
+				backward(layer->fc, layer->fc->node, layer->fc->pre, grad,
+				         i, in_grad, i ? g : NULL);
+			} else {
+				float *param_grad = grad->param + layer->offset;
+				GradRows *rows = grad->rows[i];
+				if (rows)
+					rows_reset(rows, layer, grad->param);
+				else
+					memset(param_grad, 0, sizeof(float)
+					                      * layer->param_size);
+				layer->backward(layer, layer->node->val, layer->out->val,
+				                layer->work, in_grad->val, param_grad,
+				                i ? g->val : NULL);
+			}
+			if (this->grad_hook)
+				this->grad_hook(this->grad_hook_arg, i);
+			in_grad = g;
+		}
 	}
-	tmp->free(tmp);
+	node_grad[0]->free(node_grad[0]);
+	node_grad[1]->free(node_grad[1]);
+	out_grad->free(out_grad);
+	grad->norm2 = -1.0;
 }
 
-static void mlp_net_update(MLPNet *this, MLPGrad *grad)
+static MLPNet *mlp_net_fold(MLPNet *this)
 {
+	Layer **layer = (Layer**)calloc(this->size, sizeof(Layer*));
+	if (!layer)
+		goto fail;
+	for (size_t i = 0; i < this->size; i++) {
+		if (!this->layer[i]->fc) {
+			layer[i] = this->layer[i]->copy(this->layer[i]);
+			continue;
+		}
+		FCLayer *src = this->layer[i]->fc;
+		FCLayer *dst = new_fc_layer(src->size, src->next_size, src->weight,
+		                            src->bias, src->actf, src->dactf);
+		if (src->gamma) {
+			for (size_t r = 0; r < src->next_size; r++) {
+				float s = src->gamma->val[r]
+				          / sqrtf(src->var->val[r] + MLP_RN_EPS);
+				for (size_t c = 0; c < src->size; c++)
+					dst->weight->val[c]->val[r] *= s;
+				dst->bias->val[r] = s * (src->bias->val[r] - src->mean->val[r])
+				                    + src->beta->val[r];
+			}
+		}
+		layer[i] = new_dense_layer(dst);
+		dst->free(dst);
+	}
+	MLPNet *net = new_mlp_net_layers(this->size, layer, this->lossf,
+	                                 this->dlossf);
 	for (size_t i = 0; i < this->size; i++)
-		this->layer[i]->sub(this->layer[i], grad->layer[i]);
+		layer[i]->free(layer[i]);
+	free(layer);
+	return net;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static MLPNet *mlp_net_share(MLPNet *this)
+{
+	MLPNet *net = new_mlp_net_layers(this->size, this->layer, this->lossf,
+	                                 this->dlossf);
+	param_bind(net->layer, net->size, this->param);
+	free(net->param);
+	net->param = this->param;
+	net->own_param = false;
+	net->clip_norm = this->clip_norm;
+	net->guard = this->guard;
+	return net;
+}
+
+static void mlp_net_set_checkpoint(MLPNet *this, size_t stride)
+{
+	for (size_t i = 0; i < this->size; i++)
+		if (!this->layer[i]->fc)
+			return;
+	for (size_t i = 0; i < this->size; i++) {
+		FCLayer *layer = this->layer[i]->fc;
+		keep_activation(&layer->node, !stride || i % stride == 0,
+		                layer->size);
+		keep_activation(&layer->pre, !stride, layer->next_size);
+		keep_activation(&layer->out, !stride || i + 1 == this->size,
+		                layer->next_size);
+	}
+	free(this->recompute);
+	this->recompute = NULL;
+	if (stride) {
+		this->recompute = (float*)calloc(recompute_size(this, stride),
+		                                 sizeof(float));
+		if (!this->recompute)
+			goto fail;
+	}
+	this->checkpoint = stride;
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static size_t mlp_net_activation_bytes(MLPNet *this)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < this->size; i++) {
+		if (!this->layer[i]->fc) {
+			size += this->layer[i]->size + this->layer[i]->next_size
+			        + this->layer[i]->work_size;
+			continue;
+		}
+		FCLayer *layer = this->layer[i]->fc;
+		if (layer->node)
+			size += layer->node->size;
+		if (layer->pre)
+			size += layer->pre->size;
+		if (layer->out)
+			size += layer->out->size;
+	}
+	if (this->checkpoint)
+		size += recompute_size(this, this->checkpoint);
+	return sizeof(float) * size;
+}
+
+static MemStat mlp_net_memory(MLPNet *this, MemStat *layer)
+{
+	MemStat total = {0};
+	for (size_t i = 0; i < this->size; i++) {
+		Layer *l = this->layer[i];
+		MemStat stat = {0};
+		mem_track(&stat, &stat.object, l, sizeof(Layer));
+		if (this->own_param)
+			stat.param += sizeof(float) * l->param_size;
+		if (l->fc) {
+			FCLayer *fc = l->fc;
+			mem_track(&stat, &stat.object, fc, sizeof(FCLayer));
+			mem_vector(&stat, &stat.activation, fc->node, false);
+			mem_matrix(&stat, NULL, fc->weight, true);
+			mem_vector(&stat, NULL, fc->bias, true);
+			mem_vector(&stat, &stat.activation, fc->pre, false);
+			mem_vector(&stat, &stat.activation, fc->out, false);
+			mem_vector(&stat, NULL, fc->gamma, true);
+			mem_vector(&stat, NULL, fc->beta, true);
+			mem_vector(&stat, NULL, fc->mean, true);
+			mem_vector(&stat, NULL, fc->var, true);
+			mem_track(&stat, &stat.activation, fc->mask,
+			          sizeof(uint64_t) * ((fc->next_size + 63) / 64));
+		} else {
+			mem_vector(&stat, &stat.activation, l->node, false);
+			mem_vector(&stat, &stat.activation, l->out, false);
+			mem_track(&stat, &stat.activation, l->work,
+			          sizeof(float) * (l->work_size ? l->work_size : 1));
+		}
+		if (layer)
+			layer[i] = stat;
+		mem_add(&total, &stat);
+	}
+
+	mem_track(&total, &total.object, this, sizeof(MLPNet));
+	mem_track(&total, &total.object, this->layer,
+	          sizeof(Layer*) * this->size);
+	if (this->own_param) {
+		size_t param_bytes = 0;  /* 已计入各层 */
+		mem_track(&total, &param_bytes, this->param,
+		          param_alloc_size(this->param_size));
+		total.overhead += param_bytes - sizeof(float) * this->param_size;
+	}
+	if (this->recompute)
+		mem_track(&total, &total.activation, this->recompute,
+		          sizeof(float) * recompute_size(this, this->checkpoint));
+	mem_track(&total, &total.grad, this->backprop,
+	          sizeof(float) * 2 * max_width(this->layer, this->size));
+	return total;
+}
+
+static bool mlp_net_update(MLPNet *this, MLPGrad *grad, float rate)
+{
+	SegmentTask task = {
+		.param = this->param,
+		.grad = grad->param,
+		.partial = grad->partial,
+		.block = segment_norm2,
+	};
+	if (grad->norm2 < 0.0)
+		grad_segments(grad, &task);
+	else
+		task.norm2 = grad->norm2;
+	if (!isfinite(task.norm2)) {
+		this->skip_num++;
+		return false;
+	}
+	if (this->clip_norm > 0.0
+	    && task.norm2 > (double)this->clip_norm * this->clip_norm) {
+		rate *= this->clip_norm / sqrt(task.norm2);
+		this->clip_num++;
+	}
+
+	task.scalar = rate;
+	task.block = segment_update;
+	grad_segments(grad, &task);
+	return true;
+}
+
+static void mlp_net_predict_batch(MLPNet *this, Vector **input, size_t num,
+                                  size_t *res, Vector **prob)
+{
+	if (!num)
+		return;
+	size_t max_size = max_width(this->layer, this->size);
+	size_t work_size = 1;
+	for (size_t i = 0; i < this->size; i++)
+		if (this->layer[i]->work_size > work_size)
+			work_size = this->layer[i]->work_size;
+	size_t block = num < MLP_BATCH_BLOCK ? num : MLP_BATCH_BLOCK;
+	float *buf_in = (float*)malloc(sizeof(float) * block * max_size);
+	float *buf_out = (float*)malloc(sizeof(float) * block * max_size);
+	float *work = (float*)malloc(sizeof(float) * work_size);
+	if (!buf_in || !buf_out || !work)
+		goto fail;
+
+	for (size_t begin = 0; begin < num; begin += block) {
+		size_t n = num - begin < block ? num - begin : block;
+		size_t in_size = this->layer[0]->size;
+		for (size_t k = 0; k < n; k++)
+			memcpy(buf_in + k * in_size, input[begin + k]->val,
+			       sizeof(float) * in_size);
+		for (size_t i = 0; i < this->size; i++) {
+			Layer *layer = this->layer[i];
+			if (layer->fc)
+				forward_batch(layer->fc, buf_in, NULL, buf_out, n, false,
+				              NULL);
+			else
+				for (size_t k = 0; k < n; k++)
+					layer->forward(layer, buf_in + k * layer->size,
+					               buf_out + k * layer->next_size, work,
+					               false);
+			float *tmp = buf_in;
+			buf_in = buf_out;
+			buf_out = tmp;
+		}
+
+		size_t out_size = this->layer[this->size - 1]->next_size;
+		for (size_t k = 0; k < n; k++) {
+			float *out = buf_in + k * out_size;
+			size_t max_index = 0;
+			for (size_t j = 1; j < out_size; j++)
+				if (out[j] > out[max_index])
+					max_index = j;
+			res[begin + k] = max_index;
+			if (prob && prob[begin + k])
+				prob[begin + k]->set(prob[begin + k], out_size, out);
+		}
+	}
+	free(buf_in);
+	free(buf_out);
+	free(work);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static bool mlp_net_export_c(MLPNet *this, char *path, char *name)
+{
+	for (size_t i = 0; i < this->size; i++)
+		if (!this->layer[i]->fc)
+			return false;
+	for (size_t i = 0; i < this->size; i++) {
+		if (this->layer[i]->fc->gamma) {
+			MLPNet *folded = this->fold(this);
+			bool res = folded->export_c(folded, path, name);
+			folded->free(folded);
+			return res;
+		}
+	}
+
+	const char **expr = (const char**)calloc(this->size, sizeof(char*));
+	if (!expr)
+		goto fail;
+	size_t max_size = 0;
+	for (size_t i = 0; i < this->size; i++) {
+		expr[i] = actf_expr(this->layer[i]->fc->actf);
+		if (!expr[i]) {
+			free(expr);
+			return false;
+		}
+		if (this->layer[i]->next_size > max_size)
+			max_size = this->layer[i]->next_size;
+	}
+	size_t in_size = this->layer[0]->size;
+	size_t out_size = this->layer[this->size - 1]->next_size;
+
+	size_t path_len = strlen(path);
+	char *file_name = (char*)malloc(path_len + 3);
+	if (!file_name)
+		goto fail;
+	const char *base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+
+	/***** 头文件 *****/
+	sprintf(file_name, "%s.h", path);
+	FILE *file = fopen(file_name, "w");
+	if (!file)
+		goto io_fail;
+	fprintf(file, "/* Generated by MLP-in-C. Do not edit. */\n");
+	fprintf(file, "#ifndef %s_PREDICT_H_\n", name);
+	fprintf(file, "#define %s_PREDICT_H_\n\n", name);
+	fprintf(file, "#define %s_IN_SIZE %zu\n", name, in_size);
+	fprintf(file, "#define %s_OUT_SIZE %zu\n\n", name, out_size);
+	fprintf(file, "void %s_predict(const float *input, float *output);\n\n",
+	        name);
+	fprintf(file, "#endif\n");
+	if (fclose(file))
+		goto io_fail;
+
+	/***** 源文件 *****/
+	sprintf(file_name, "%s.c", path);
+	file = fopen(file_name, "w");
+	if (!file)
+		goto io_fail;
+	fprintf(file, "/* Generated by MLP-in-C. Do not edit. */\n");
+	fprintf(file, "#include <math.h>\n");
+	fprintf(file, "#include \"%s.h\"\n\n", base);
+	for (size_t i = 0; i < this->size; i++) {
+		FCLayer *layer = this->layer[i]->fc;
+		fprintf(file, "static _Alignas(32) const float %s_w%zu[%zu][%zu] = {\n",
+		        name, i, layer->next_size, layer->size);
+		for (size_t r = 0; r < layer->next_size; r++) {
+			fprintf(file, "\t{");
+			for (size_t c = 0; c < layer->size; c++)
+				fprintf(file, "%s%.9g",
+				        c == 0 ? "\n\t\t" : c % 8 ? ", " : ",\n\t\t",
+				        layer->weight->val[c]->val[r]);
+			fprintf(file, "\n\t},\n");
+		}
+		fprintf(file, "};\n\n");
+		fprintf(file, "static _Alignas(32) const float %s_b%zu[%zu] = {",
+		        name, i, layer->next_size);
+		export_array(file, layer->bias->val, layer->next_size);
+		fprintf(file, "};\n\n");
+	}
+	fprintf(file, "void %s_predict(const float *input, float *output)\n{\n",
+	        name);
+	fprintf(file, "\t_Alignas(32) float buf[2][%zu];\n", max_size);
+	fprintf(file, "\tconst float *in = input;\n");
+	fprintf(file, "\tfloat *out;\n\n");
+	for (size_t i = 0; i < this->size; i++) {
+		FCLayer *layer = this->layer[i]->fc;
+		if (i + 1 == this->size)
+			fprintf(file, "\tout = output;\n");
+		else
+			fprintf(file, "\tout = buf[%zu];\n", i % 2);
+		fprintf(file, "\tfor (int r = 0; r < %zu; r++) {\n",
+		        layer->next_size);
+		fprintf(file, "\t\tfloat x = %s_b%zu[r];\n", name, i);
+		fprintf(file, "\t\tfor (int c = 0; c < %zu; c++)\n", layer->size);
+		fprintf(file, "\t\t\tx += %s_w%zu[r][c] * in[c];\n", name, i);
+		fprintf(file, "\t\tout[r] = %s;\n", expr[i]);
+		fprintf(file, "\t}\n");
+		if (i + 1 != this->size)
+			fprintf(file, "\tin = out;\n");
+	}
+	fprintf(file, "}\n");
+	if (fclose(file))
+		goto io_fail;
+
+	free(file_name);
+	free(expr);
+	return true;
+io_fail:
+	free(file_name);
+	free(expr);
+	return false;
+fail:
+	printf("Memory not enough!");
+	exit(1);
 }
 
 MLPGrad *new_mlp_grad(MLPNet *net)
 {
 	size_t this_size = net->size;
-	FCLayer **this_layer = (FCLayer**)calloc(net->size, sizeof(FCLayer*));
-	if (!this_layer)
+	size_t this_param_size = net->param_size;
+	float *this_param = param_alloc(this_param_size);
+	Matrix **this_weight = (Matrix**)calloc(net->size, sizeof(Matrix*));
+	Vector **this_bias = (Vector**)calloc(net->size, sizeof(Vector*));
+	Vector **this_gamma = (Vector**)calloc(net->size, sizeof(Vector*));
+	Vector **this_beta = (Vector**)calloc(net->size, sizeof(Vector*));
+	GradRows **this_rows = (GradRows**)calloc(net->size, sizeof(GradRows*));
+	double *this_partial = (double*)malloc(sizeof(double)
+	                       * (this_param_size / MLP_GRAD_BLOCK + 1));
+	if (!this_weight || !this_bias || !this_gamma || !this_beta
+	    || !this_rows || !this_partial)
 		goto fail;
+	param_views(net->layer, net->size, this_param, this_weight, this_bias,
+	            this_gamma, this_beta, NULL, NULL);
 	for (size_t i = 0; i < net->size; i++)
-		this_layer[i] = net->layer[i]->copy(net->layer[i]);
+		this_rows[i] = rows_alloc(net->layer[i]);
 	
 	MLPGrad *this = (MLPGrad*)malloc(sizeof(MLPGrad));
 	if (!this)
 		goto fail;
 	*this = (MLPGrad) {
 		.size = this_size,
-		.layer = this_layer,
+		.param_size = this_param_size,
+		.param = this_param,
+		.norm2 = 0.0,
+		.weight = this_weight,
+		.bias = this_bias,
+		.gamma = this_gamma,
+		.beta = this_beta,
+		.rows = this_rows,
+		.partial = this_partial,
 
 		.free = mlp_grad_free,
 		.clear = mlp_grad_clear,
 		.add = mlp_grad_add,
 		.scale = mlp_grad_scale,
+		.touch_all = mlp_grad_touch_all,
+		.memory = mlp_grad_memory,
 	};
 	return this;
 fail:
@@ -247,64 +1045,980 @@ fail:
 
 static void mlp_grad_free(MLPGrad *this)
 {
-	for (size_t i = 0; i < this->size; i++)
-		this->layer[i]->free(this->layer[i]);
+	for (size_t i = 0; i < this->size; i++) {
+		if (this->rows[i])
+			rows_free(this->rows[i]);
+		if (!this->weight[i])
+			continue;
+		this->weight[i]->free(this->weight[i]);
+		this->bias[i]->free(this->bias[i]);
+		if (this->gamma[i]) {
+			this->gamma[i]->free(this->gamma[i]);
+			this->beta[i]->free(this->beta[i]);
+		}
+	}
+	free(this->weight);
+	free(this->bias);
+	free(this->gamma);
+	free(this->beta);
+	free(this->rows);
+	free(this->partial);
+	free(this->param);
 	free(this);
 }
 
 static void mlp_grad_clear(MLPGrad *this)
 {
-	for (size_t i = 0; i < this->size; i++)
-		this->layer[i]->clear(this->layer[i]);
+	size_t begin = 0;
+	for (size_t i = 0; i < this->size; i++) {
+		GradRows *rows = this->rows[i];
+		if (!rows)
+			continue;
+		memset(this->param + begin, 0,
+		       sizeof(float) * (rows->offset - begin));
+		rows_clear(rows, this->param);
+		begin = rows->offset + rows->row_size * rows->row_num;
+	}
+	memset(this->param + begin, 0,
+	       sizeof(float) * (this->param_size - begin));
+	this->norm2 = 0.0;
 }
 
 static void mlp_grad_add(MLPGrad *this, MLPGrad *target)
 {
-	for (size_t i = 0; i < this->size; i++)
-		this->layer[i]->add(this->layer[i], target->layer[i]);
+	SegmentTask task = {
+		.param = this->param,
+		.grad = target->param,
+		.partial = this->partial,
+		.block = segment_add,
+	};
+	size_t begin = 0;
+	for (size_t i = 0; i < this->size; i++) {
+		GradRows *rows = this->rows[i];
+		GradRows *src = target->rows[i];
+		if (!rows)
+			continue;
+		if (rows->num == MLP_ROWS_ALL || src->num == MLP_ROWS_ALL) {
+			/* 并入其后的稠密部分整体相加 */
+			rows->num = MLP_ROWS_ALL;
+			rows->norm2 = -1.0;
+			continue;
+		}
+		segment_run(&task, begin, rows->offset);
+		rows_add(rows, src, this->param, target->param);
+		task.norm2 += rows->norm2;
+		begin = rows->offset + rows->row_size * rows->row_num;
+	}
+	segment_run(&task, begin, this->param_size);
+	this->norm2 = task.norm2;
 }
 
 static void mlp_grad_scale(MLPGrad *this, float scalar)
 {
+	SegmentTask task = {
+		.grad = this->param,
+		.scalar = scalar,
+		.partial = this->partial,
+		.block = segment_scale,
+	};
+	grad_segments(this, &task);
 	for (size_t i = 0; i < this->size; i++)
-		this->layer[i]->scale(this->layer[i], scalar);
+		if (this->rows[i] && this->rows[i]->norm2 >= 0.0)
+			this->rows[i]->norm2 *= (double)scalar * scalar;
+	if (this->norm2 >= 0.0)
+		this->norm2 *= (double)scalar * scalar;
+}
+
+static void mlp_grad_touch_all(MLPGrad *this)
+{
+	for (size_t i = 0; i < this->size; i++) {
+		if (!this->rows[i])
+			continue;
+		this->rows[i]->num = MLP_ROWS_ALL;
+		this->rows[i]->norm2 = -1.0;
+	}
+	this->norm2 = -1.0;
+}
+
+static MemStat mlp_grad_memory(MLPGrad *this)
+{
+	MemStat stat = {0};
+	mem_track(&stat, &stat.object, this, sizeof(MLPGrad));
+	Vector **vec[3] = {this->bias, this->gamma, this->beta};
+	for (size_t k = 0; k < 3; k++)
+		mem_track(&stat, &stat.object, vec[k], sizeof(Vector*) * this->size);
+	mem_track(&stat, &stat.object, this->weight, sizeof(Matrix*) * this->size);
+	for (size_t i = 0; i < this->size; i++) {
+		if (this->weight[i])
+			mem_matrix(&stat, NULL, this->weight[i], true);
+		for (size_t k = 0; k < 3; k++)
+			mem_vector(&stat, NULL, vec[k][i], true);
+	}
+	mem_track(&stat, &stat.grad, this->partial, sizeof(double)
+	          * (this->param_size / MLP_GRAD_BLOCK + 1));
+	mem_track(&stat, &stat.object, this->rows,
+	          sizeof(GradRows*) * this->size);
+	for (size_t i = 0; i < this->size; i++) {
+		GradRows *rows = this->rows[i];
+		if (!rows)
+			continue;
+		mem_track(&stat, &stat.object, rows, sizeof(GradRows));
+		mem_track(&stat, &stat.grad, rows->row,
+		          sizeof(size_t) * rows->capacity);
+		mem_track(&stat, &stat.grad, rows->mark,
+		          rows->row_num ? rows->row_num : 1);
+	}
+	size_t param_bytes = 0;
+	mem_track(&stat, &param_bytes, this->param,
+	          param_alloc_size(this->param_size));
+	stat.grad += sizeof(float) * this->param_size;
+	stat.overhead += param_bytes - sizeof(float) * this->param_size;
+	return stat;
 }
 
 /*** 内部 ***/
 
 /**
- * @brief 反向传播
- * @param net      `[IN]`网络层
- * @param grad     `[INOUT]`梯度层
- * @param out_grad `[IN]`输出层梯度
+ * @brief 线性变换之后的逐元素部分：滑动归一化、激活与丢弃
+ * @param layer  `[INOUT]`网络层
+ * @param z      `[IN]`线性变换结果
+ * @param pre    `[OUT]`写入`FCLayer::pre`的值，传入`NULL`以忽略
+ * @param out    `[OUT]`输出，可与`z`为同一存储
+ * @param update 是否以`z`更新滑动统计量
+ * @param mask   `[IN]`丢弃掩码，传入`NULL`以不丢弃
+ */
+static void fc_post(FCLayer *layer, float *z, float *pre, float *out,
+                    bool update, uint64_t *mask)
+{
+	size_t n = layer->next_size;
+	if (layer->gamma) {
+		float *gamma = layer->gamma->val;
+		float *beta = layer->beta->val;
+		float *mean = layer->mean->val;
+		float *var = layer->var->val;
+		for (size_t r = 0; r < n; r++) {
+			if (update) {
+				float d = z[r] - mean[r];
+				mean[r] += (1.0 - MLP_RN_MOMENTUM) * d;
+				var[r] = MLP_RN_MOMENTUM
+				         * (var[r] + (1.0 - MLP_RN_MOMENTUM) * d * d);
+			}
+			float x = (z[r] - mean[r]) / sqrtf(var[r] + MLP_RN_EPS);
+			if (pre)
+				pre[r] = x;
+			out[r] = layer->actf(gamma[r] * x + beta[r]);
+		}
+	} else {
+		for (size_t r = 0; r < n; r++) {
+			if (pre)
+				pre[r] = z[r];
+			out[r] = layer->actf(z[r]);
+		}
+	}
+	if (mask) {
+		float scale = 65536.0 / dropout_keep(layer->dropout);
+		for (size_t r = 0; r < n; r++)
+			out[r] = mask[r / 64] >> (r % 64) & 1 ? out[r] * scale : 0.0;
+	}
+}
+
+/**
+ * @brief 将滑动归一化参数与统计量恢复为恒等变换
+ * @param layer `[INOUT]`网络层
+ */
+static void reset_runnorm(FCLayer *layer)
+{
+	for (size_t r = 0; r < layer->next_size; r++) {
+		layer->gamma->val[r] = 1.0;
+		layer->beta->val[r] = 0.0;
+		layer->mean->val[r] = 0.0;
+		layer->var->val[r] = 1.0;
+	}
+}
+
+/**
+ * @brief  将保留概率量化为`16`位定点数
+ * @param  dropout 丢弃概率
+ * @return 保留概率乘`65536`，取值于`[1, 65535]`
+ */
+static uint32_t dropout_keep(float dropout)
+{
+	long keep = lroundf((1.0 - dropout) * 65536.0);
+	if (keep < 1)
+		keep = 1;
+	if (keep > 65535)
+		keep = 65535;
+	return (uint32_t)keep;
+}
+
+/**
+ * @brief 生成丢弃掩码
+ *
+ * 按保留概率的二进制位从低到高，以随机数逐次与（位为`0`）或或（位为`1`），
+ * 每位为`1`的概率即为该二进制小数。每`64`个节点只需`16`个随机数。
+ *
+ * @param layer `[INOUT]`网络层
  */
-static void backward(FCLayer *net, FCLayer *grad, Vector *out_grad)
+static void dropout_mask(FCLayer *layer)
 {
-	Vector *tmp_v;
-	Matrix *tmp_m;
-	grad->out->set(grad->out, out_grad->size, out_grad->val);
+	uint32_t keep = dropout_keep(layer->dropout);
+	int low = 0;
+	while (!(keep >> low & 1))
+		low++;
+	for (size_t w = 0; w < (layer->next_size + 63) / 64; w++) {
+		uint64_t x = 0;
+		for (int j = low; j < 16; j++) {
+			uint64_t r = rand_next();
+			x = keep >> j & 1 ? x | r : x & r;
+		}
+		layer->mask[w] = x;
+	}
+}
 
-	/***** pre *****/
-	tmp_v = net->pre->copy(net->pre);
-	tmp_v->map(tmp_v, net->dactf);
-	for (size_t i = 0; i < net->next_size; i++)
-		grad->pre->val[i] = tmp_v->val[i] * (grad->out->val[i]);
-	tmp_v->free(tmp_v);
+/**
+ * @brief 反向传播
+ *
+ * 偏置的梯度即线性变换结果的梯度，故直接写入偏置梯度后复用。
+ * 滑动归一化的统计量视为常量。
+ *
+ * @param net       `[IN]`网络层
+ * @param node      `[IN]`该层的输入
+ * @param pre       `[IN]`该层的`pre`
+ * @param grad      `[OUT]`梯度
+ * @param index     层序号
+ * @param out_grad  `[IN]`输出梯度
+ * @param node_grad `[OUT]`输入梯度，可与`out_grad`为同一存储，
+ *                  传入`NULL`以忽略
+ */
+static void backward(FCLayer *net, Vector *node, Vector *pre, MLPGrad *grad,
+                     size_t index, Vector *out_grad, Vector *node_grad)
+{
+	Matrix *weight_grad = grad->weight[index];
+	Vector *bias_grad = grad->bias[index];
+	float scale = 0.0;
+	if (net->dropout > 0.0)
+		scale = 65536.0 / dropout_keep(net->dropout);
 
 	/***** bias *****/
-	grad->bias->free(grad->bias);
-	grad->bias = grad->pre->copy(grad->pre);
+	for (size_t i = 0; i < net->next_size; i++) {
+		float g = out_grad->val[i];
+		if (net->dropout > 0.0)
+			g = net->mask[i / 64] >> (i % 64) & 1 ? g * scale : 0.0;
+		if (net->gamma) {
+			float gamma = net->gamma->val[i];
+			float d = g * net->dactf(gamma * pre->val[i] + net->beta->val[i]);
+			grad->gamma[index]->val[i] = d * pre->val[i];
+			grad->beta[index]->val[i] = d;
+			bias_grad->val[i] = d * gamma
+			                    / sqrtf(net->var->val[i] + MLP_RN_EPS);
+		} else {
+			bias_grad->val[i] = g * net->dactf(pre->val[i]);
+		}
+	}
 
 	/***** weight *****/
-	grad->weight->free(grad->weight);
-	grad->weight = outer(grad->pre, net->node);
+	weight_grad->clear(weight_grad);
+	weight_grad->ger(weight_grad, 1.0, bias_grad, node);
 
 	/***** node *****/
-	tmp_m = net->weight->copy(net->weight);
-	tmp_v = grad->pre->copy(grad->pre);
-	tmp_m->transpose(tmp_m);
-	tmp_m->act(tmp_m, tmp_v);
-	tmp_m->free(tmp_m);
-	grad->node->free(grad->node);
-	grad->node = tmp_v;
+	if (!node_grad)
+		return;
+	for (size_t i = 0; i < net->size; i++) {
+		float *w = net->weight->val[i]->val;
+		float sum = 0.0;
+		for (size_t j = 0; j < net->next_size; j++)
+			sum += w[j] * bias_grad->val[j];
+		node_grad->val[i] = sum;
+	}
+}
+
+/**
+ * @brief 检查点模式下的反向传播
+ *
+ * 从最后一段开始，由段首的`node`重算该段各层的`pre`与`out`，
+ * 再在段内逐层反向传播。
+ *
+ * @param this      `[IN]`网络
+ * @param grad      `[OUT]`梯度
+ * @param out_grad  `[IN]`输出层梯度
+ * @param node_grad `[INOUT]`引用`backprop`的节点梯度
+ */
+static void grad_checkpoint(MLPNet *this, MLPGrad *grad, Vector *out_grad,
+                            Vector *node_grad)
+{
+	Vector *node = new_vector_view(0, NULL);
+	Vector *pre = new_vector_view(0, NULL);
+	size_t stride = this->checkpoint;
+	size_t begin = (this->size - 1) / stride * stride;
+	for (;;) {
+		size_t end = begin + stride < this->size ? begin + stride : this->size;
+		size_t offset = 0;
+		for (size_t i = begin; i < end; i++)
+			offset += 2 * this->layer[i]->next_size;
+		forward_segment(this, begin, false);
+		for (size_t i = end; i-- > begin; ) {
+			FCLayer *layer = this->layer[i]->fc;
+			offset -= 2 * layer->next_size;
+			pre->size = layer->next_size;
+			pre->val = this->recompute + offset;
+			node->size = layer->size;
+			if (i == begin)
+				node->val = layer->node->val;
+			else
+				node->val = this->recompute + offset - layer->size;
+			node_grad->size = layer->size;
+			backward(layer, node, pre, grad, i, out_grad,
+			         i ? node_grad : NULL);
+			if (this->grad_hook)
+				this->grad_hook(this->grad_hook_arg, i);
+			out_grad = node_grad;
+		}
+		if (begin == 0)
+			break;
+		begin -= stride;
+	}
+	node->free(node);
+	pre->free(pre);
+}
+
+/**
+ * @brief  检查点模式下前向传播一段
+ *
+ * 以第`begin`层的`node`为输入，各层的`pre`与`out`依次写入重算缓冲区。
+ * 重算时沿用前向传播时的丢弃掩码与滑动统计量，结果与之相同。
+ *
+ * @param  this  `[INOUT]`网络
+ * @param  begin 段首层序号
+ * @param  train 为`true`时是前向传播，否则为重算
+ * @return 该段最后一层的输出
+ */
+static float *forward_segment(MLPNet *this, size_t begin, bool train)
+{
+	size_t end = begin + this->checkpoint;
+	if (end > this->size)
+		end = this->size;
+	float *in = this->layer[begin]->fc->node->val;
+	float *buf = this->recompute;
+	for (size_t i = begin; i < end; i++) {
+		FCLayer *layer = this->layer[i]->fc;
+		if (train && layer->dropout > 0.0)
+			dropout_mask(layer);
+		forward_batch(layer, in, buf, buf + layer->next_size, 1, train,
+		              layer->dropout > 0.0 ? layer->mask : NULL);
+		in = buf + layer->next_size;
+		buf += 2 * layer->next_size;
+	}
+	return in;
+}
+
+/**
+ * @brief  获取重算缓冲区的长度
+ * @param  this   `[IN]`网络
+ * @param  stride 检查点间隔
+ * @return 各段`pre`与`out`长度之和的最大值
+ */
+static size_t recompute_size(MLPNet *this, size_t stride)
+{
+	size_t max_size = 0;
+	for (size_t begin = 0; begin < this->size; begin += stride) {
+		size_t size = 0;
+		for (size_t i = begin; i < begin + stride && i < this->size; i++)
+			size += 2 * this->layer[i]->next_size;
+		if (size > max_size)
+			max_size = size;
+	}
+	return max_size;
+}
+
+/**
+ * @brief  获取各层输入与输出大小的最大值
+ * @param  layer `[IN]`层
+ * @param  size  层数
+ * @return 最大值
+ */
+static size_t max_width(Layer **layer, size_t size)
+{
+	size_t width = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (layer[i]->size > width)
+			width = layer[i]->size;
+		if (layer[i]->next_size > width)
+			width = layer[i]->next_size;
+	}
+	return width;
+}
+
+/**
+ * @brief  获取全连接层的参数数量
+ * @param  fc `[IN]`全连接层
+ * @return 权重、偏置与滑动归一化参数的数量之和
+ */
+static size_t dense_param_size(FCLayer *fc)
+{
+	size_t count = (fc->size + 1) * fc->next_size;
+	if (fc->gamma)
+		count += 4 * fc->next_size;
+	return count;
+}
+
+/**
+ * @brief  获取参数总数
+ * @param  layer `[IN]`层
+ * @param  size  层数
+ * @return 各层参数数量之和
+ */
+static size_t param_count(Layer **layer, size_t size)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (layer[i]->fc)
+			count += dense_param_size(layer[i]->fc);
+		else
+			count += layer[i]->param_size;
+	}
+	return count;
+}
+
+/**
+ * @brief  获取参数缓冲区实际申请的字节数
+ * @param  size 参数总数
+ * @return 补齐到`MLP_ALIGN`的倍数且不为`0`的字节数
+ */
+static size_t param_alloc_size(size_t size)
+{
+	size_t bytes = sizeof(float) * size;
+	bytes = (bytes + MLP_ALIGN - 1) / MLP_ALIGN * MLP_ALIGN;
+	return bytes ? bytes : MLP_ALIGN;
+}
+
+/**
+ * @brief  分配按`MLP_ALIGN`对齐且初始值为`0`的参数缓冲区
+ * @param  size 参数总数
+ * @return `[OWN]`缓冲区
+ */
+static float *param_alloc(size_t size)
+{
+	size_t bytes = param_alloc_size(size);
+	float *param = (float*)aligned_alloc(MLP_ALIGN, bytes);
+	if (!param)
+		goto fail;
+	memset(param, 0, bytes);
+	return param;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 在参数缓冲区上创建各层的视图
+ *
+ * 各层依次存放权重（按列）与偏置，启用滑动归一化时其后再依次存放
+ * `gamma`/`beta`/`mean`/`var`，`MLPNet`与`MLPGrad`共用此布局。
+ * 未启用滑动归一化的层，其滑动归一化视图为`NULL`；
+ * 非全连接层占用`Layer::param_size`个参数，其各视图均为`NULL`。
+ *
+ * @param layer  `[IN]`层
+ * @param size   层数
+ * @param param  `[IN]`参数缓冲区
+ * @param weight `[OUT]`各层权重的视图
+ * @param bias   `[OUT]`各层偏置的视图
+ * @param gamma  `[OUT]`各层滑动归一化缩放的视图，传入`NULL`以忽略
+ * @param beta   `[OUT]`各层滑动归一化平移的视图，传入`NULL`以忽略
+ * @param mean   `[OUT]`各层滑动均值的视图，传入`NULL`以忽略
+ * @param var    `[OUT]`各层滑动方差的视图，传入`NULL`以忽略
+ */
+static void param_views(Layer **layer, size_t size, float *param,
+                        Matrix **weight, Vector **bias, Vector **gamma,
+                        Vector **beta, Vector **mean, Vector **var)
+{
+	for (size_t i = 0; i < size; i++) {
+		FCLayer *fc = layer[i]->fc;
+		Vector **bn[4] = {gamma, beta, mean, var};
+		if (!fc) {
+			weight[i] = NULL;
+			bias[i] = NULL;
+			for (size_t k = 0; k < 4; k++)
+				if (bn[k])
+					bn[k][i] = NULL;
+			param += layer[i]->param_size;
+			continue;
+		}
+		size_t n = fc->next_size;
+		weight[i] = new_matrix_view(n, fc->size, param);
+		param += n * fc->size;
+		bias[i] = new_vector_view(n, param);
+		param += n;
+		for (size_t k = 0; k < 4; k++) {
+			if (!bn[k])
+				continue;
+			bn[k][i] = fc->gamma ? new_vector_view(n, param + k * n) : NULL;
+		}
+		if (fc->gamma)
+			param += 4 * n;
+	}
+}
+
+/**
+ * @brief 将各层的参数移入参数缓冲区，并改为引用其中的视图
+ *
+ * 同时设置各层的`param_size`与`offset`，非全连接层经其`bind`移入。
+ * 全连接层标记为`bound`，此后不可再启用滑动归一化。
+ *
+ * @param layer `[INOUT]`层
+ * @param size  层数
+ * @param param `[OUT]`参数缓冲区
+ */
+static void param_bind(Layer **layer, size_t size, float *param)
+{
+	Matrix **weight = (Matrix**)calloc(size, sizeof(Matrix*));
+	Vector **vec = (Vector**)calloc(5 * size, sizeof(Vector*));
+	if (!weight || !vec)
+		goto fail;
+	param_views(layer, size, param, weight, vec, vec + size, vec + 2 * size,
+	            vec + 3 * size, vec + 4 * size);
+	size_t offset = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (layer[i]->fc)
+			layer[i]->param_size = dense_param_size(layer[i]->fc);
+		layer[i]->offset = offset;
+		offset += layer[i]->param_size;
+		if (!layer[i]->fc) {
+			layer[i]->bind(layer[i], param + layer[i]->offset);
+			continue;
+		}
+		FCLayer *l = layer[i]->fc;
+		l->bound = true;
+		for (size_t c = 0; c < l->size; c++)
+			memcpy(weight[i]->val[c]->val, l->weight->val[c]->val,
+			       sizeof(float) * l->next_size);
+		l->weight->free(l->weight);
+		l->weight = weight[i];
+		Vector **own[5] = {&l->bias, &l->gamma, &l->beta, &l->mean, &l->var};
+		for (size_t k = 0; k < 5; k++) {
+			Vector *view = vec[k * size + i];
+			if (!view)
+				continue;
+			memcpy(view->val, (*own[k])->val, sizeof(float) * view->size);
+			(*own[k])->free(*own[k]);
+			*own[k] = view;
+		}
+	}
+	free(weight);
+	free(vec);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief  求参数的平方和
+ *
+ * 以`double`分为`8`路累加，以便编译器向量化且大参数量时不丢失精度。
+ * 出现非有限值时结果亦非有限。
+ *
+ * @param  param `[IN]`参数
+ * @param  size  参数总数
+ * @return 平方和
+ */
+static double param_norm2(const float *param, size_t size)
+{
+	double sum[8] = {0.0};
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+		for (size_t k = 0; k < 8; k++)
+			sum[k] += (double)param[i + k] * param[i + k];
+	for (; i < size; i++)
+		sum[0] += (double)param[i] * param[i];
+	double norm2 = 0.0;
+	for (size_t k = 0; k < 8; k++)
+		norm2 += sum[k];
+	return norm2;
+}
+
+/**
+ * @brief  `a += b`，同时求出结果的平方和
+ *
+ * 累加方式同`param_norm2`，与加法在同一次遍历中完成。
+ *
+ * @param  a    `[INOUT]`被加数
+ * @param  b    `[IN]`加数
+ * @param  size 长度
+ * @return 结果的平方和
+ */
+static double add_norm2(float *restrict a, const float *restrict b,
+                        size_t size)
+{
+	double sum[8] = {0.0};
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		for (size_t k = 0; k < 8; k++) {
+			a[i + k] += b[i + k];
+			sum[k] += (double)a[i + k] * a[i + k];
+		}
+	}
+	for (; i < size; i++) {
+		a[i] += b[i];
+		sum[0] += (double)a[i] * a[i];
+	}
+	double norm2 = 0.0;
+	for (size_t k = 0; k < 8; k++)
+		norm2 += sum[k];
+	return norm2;
+}
+
+/**
+ * @brief  为稀疏层创建`GradRows`，初始时没有行
+ * @param  layer `[IN]`层
+ * @return `[OWN]``GradRows`指针；`Layer::row_size`为`0`时返回`NULL`
+ */
+static GradRows *rows_alloc(Layer *layer)
+{
+	if (layer->fc || !layer->row_size)
+		return NULL;
+	size_t row_num = layer->param_size / layer->row_size;
+	size_t capacity = row_num + layer->size;
+	size_t *this_row = (size_t*)malloc(sizeof(size_t) * capacity);
+	uint8_t *this_mark = (uint8_t*)calloc(row_num ? row_num : 1,
+	                                      sizeof(uint8_t));
+
+	GradRows *this = (GradRows*)malloc(sizeof(GradRows));
+	if (!this || !this_row || !this_mark)
+		goto fail;
+	*this = (GradRows) {
+		.offset = layer->offset,
+		.row_size = layer->row_size,
+		.row_num = row_num,
+		.num = 0,
+		.capacity = capacity,
+		.row = this_row,
+		.mark = this_mark,
+		.norm2 = 0.0,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 销毁`GradRows`
+ * @param rows `[OWN]``GradRows`
+ */
+static void rows_free(GradRows *rows)
+{
+	free(rows->row);
+	free(rows->mark);
+	free(rows);
+}
+
+/**
+ * @brief 清零记下的行，并清空记录
+ * @param rows  `[INOUT]`记录
+ * @param param `[OUT]``MLPGrad::param`
+ */
+static void rows_clear(GradRows *rows, float *param)
+{
+	float *val = param + rows->offset;
+	if (rows->num == MLP_ROWS_ALL) {
+		memset(val, 0, sizeof(float) * rows->row_size * rows->row_num);
+		memset(rows->mark, 0, rows->row_num);
+	} else {
+		for (size_t k = 0; k < rows->num; k++) {
+			memset(val + rows->row[k] * rows->row_size, 0,
+			       sizeof(float) * rows->row_size);
+			rows->mark[rows->row[k]] = 0;
+		}
+	}
+	rows->num = 0;
+	rows->norm2 = 0.0;
+}
+
+/**
+ * @brief 逐样本反向传播前，清零上一样本写入的行，再记下本样本将写入的行
+ * @param rows  `[INOUT]`记录
+ * @param layer `[IN]`层，`node`为本样本的输入
+ * @param param `[OUT]``MLPGrad::param`
+ */
+static void rows_reset(GradRows *rows, Layer *layer, float *param)
+{
+	rows_clear(rows, param);
+	size_t num = layer->rows(layer, layer->node->val, rows->row);
+	for (size_t k = 0; k < num; k++) {
+		size_t r = rows->row[k];
+		if (rows->mark[r])
+			continue;
+		rows->mark[r] = 1;
+		rows->row[rows->num++] = r;
+	}
+	rows->norm2 = -1.0;
+}
+
+/**
+ * @brief 将`src`记下的行加到`a`中，并合并记录
+ *
+ * 平方和已知时只按改变的行增量维护，否则相加后重新计算。
+ *
+ * @param rows `[INOUT]`被加数的记录
+ * @param src  `[IN]`加数的记录
+ * @param a    `[INOUT]`被加数的`MLPGrad::param`
+ * @param b    `[IN]`加数的`MLPGrad::param`
+ */
+static void rows_add(GradRows *rows, GradRows *src, float *a, const float *b)
+{
+	size_t n = rows->row_size;
+	double norm2 = rows->norm2;
+	bool known = norm2 >= 0.0;
+	for (size_t k = 0; k < src->num; k++) {
+		size_t r = src->row[k];
+		float *x = a + rows->offset + r * n;
+		const float *y = b + rows->offset + r * n;
+		for (size_t j = 0; j < n; j++) {
+			float sum = x[j] + y[j];
+			norm2 += (double)sum * sum - (double)x[j] * x[j];
+			x[j] = sum;
+		}
+		if (!rows->mark[r]) {
+			rows->mark[r] = 1;
+			rows->row[rows->num++] = r;
+		}
+	}
+	if (known) {
+		rows->norm2 = norm2 < 0.0 ? 0.0 : norm2;
+		return;
+	}
+	norm2 = 0.0;
+	for (size_t k = 0; k < rows->num; k++)
+		norm2 += param_norm2(a + rows->offset + rows->row[k] * n, n);
+	rows->norm2 = norm2;
+}
+
+/**
+ * @brief 对梯度中可能非零的各段调用`task->block`，平方和累加到`task->norm2`
+ *
+ * 稠密部分按连续区间分块并行处理，稀疏层逐行处理，
+ * 视为全部行的稀疏层并入稠密部分。
+ *
+ * @param grad `[IN]`梯度
+ * @param task `[INOUT]`任务，下标相对于`MLPGrad::param`
+ */
+static void grad_segments(MLPGrad *grad, SegmentTask *task)
+{
+	size_t begin = 0;
+	for (size_t i = 0; i < grad->size; i++) {
+		GradRows *rows = grad->rows[i];
+		if (!rows || rows->num == MLP_ROWS_ALL)
+			continue;
+		segment_run(task, begin, rows->offset);
+		size_t n = rows->row_size;
+		for (size_t k = 0; k < rows->num; k++) {
+			size_t row = rows->offset + rows->row[k] * n;
+			task->norm2 += task->block(task, row, row + n);
+		}
+		begin = rows->offset + rows->row_size * rows->row_num;
+	}
+	segment_run(task, begin, grad->param_size);
+}
+
+/**
+ * @brief 以线程池处理一段连续的梯度，平方和累加到`task->norm2`
+ *
+ * 按`MLP_GRAD_BLOCK`切块，各块的平方和写入`task->partial`后按块序相加，
+ * 结果与线程数无关。
+ *
+ * @param task  `[INOUT]`任务
+ * @param begin 起点
+ * @param end   终点（不含）
+ */
+static void segment_run(SegmentTask *task, size_t begin, size_t end)
+{
+	if (end <= begin)
+		return;
+	size_t num = (end - begin + MLP_GRAD_BLOCK - 1) / MLP_GRAD_BLOCK;
+	if (num == 1) {
+		task->norm2 += task->block(task, begin, end);
+		return;
+	}
+	task->begin = begin;
+	task->end = end;
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, num, pool_grain(MLP_GRAD_BLOCK),
+	                   segment_blocks, task);
+	for (size_t k = 0; k < num; k++)
+		task->norm2 += task->partial[k];
+}
+
+/* 线程池任务，处理第`begin`至`end`块，`arg`为`SegmentTask` */
+static void segment_blocks(void *arg, size_t begin, size_t end)
+{
+	SegmentTask *task = (SegmentTask*)arg;
+	for (size_t k = begin; k < end; k++) {
+		size_t from = task->begin + k * MLP_GRAD_BLOCK;
+		size_t to = from + MLP_GRAD_BLOCK < task->end
+		            ? from + MLP_GRAD_BLOCK : task->end;
+		task->partial[k] = task->block(task, from, to);
+	}
+}
+
+/* 求一段梯度的平方和 */
+static double segment_norm2(SegmentTask *task, size_t begin, size_t end)
+{
+	return param_norm2(task->grad + begin, end - begin);
+}
+
+/* 一段梯度`param += grad`，返回结果的平方和 */
+static double segment_add(SegmentTask *task, size_t begin, size_t end)
+{
+	return add_norm2(task->param + begin, task->grad + begin, end - begin);
+}
+
+/* 一段参数`param -= scalar * grad` */
+static double segment_update(SegmentTask *task, size_t begin, size_t end)
+{
+	float *restrict a = task->param;
+	const float *restrict b = task->grad;
+	float rate = task->scalar;
+	for (size_t i = begin; i < end; i++)
+		a[i] -= rate * b[i];
+	return 0.0;
+}
+
+/* 一段梯度数乘 */
+static double segment_scale(SegmentTask *task, size_t begin, size_t end)
+{
+	float *restrict a = task->grad;
+	float scalar = task->scalar;
+	for (size_t i = begin; i < end; i++)
+		a[i] *= scalar;
+	return 0.0;
+}
+
+/**
+ * @brief 按需创建或销毁中间结果
+ * @param v    `[INOUT]`中间结果
+ * @param keep 是否保留
+ * @param size 长度
+ */
+static void keep_activation(Vector **v, bool keep, size_t size)
+{
+	if (keep && !*v) {
+		*v = new_vector(size, NULL);
+	} else if (!keep && *v) {
+		(*v)->free(*v);
+		*v = NULL;
+	}
+}
+
+/**
+ * @brief 批量前向传播，不修改层内的中间结果
+ *
+ * 逐列遍历权重，每列在整批输入上复用，相当于一次矩阵乘法。
+ *
+ * @param layer  `[IN]`网络层
+ * @param input  `[IN]`输入，`num`行`layer->size`列，按行存储
+ * @param pre    `[OUT]`线性变换结果，形状同`output`，传入`NULL`以忽略
+ * @param output `[OUT]`输出，`num`行`layer->next_size`列，按行存储
+ * @param num    输入数量
+ * @param update 是否更新滑动统计量，仅用于单个输入
+ * @param mask   `[IN]`丢弃掩码，仅用于单个输入，传入`NULL`以不丢弃
+ */
+static void forward_batch(FCLayer *layer, float *input, float *pre,
+                          float *output, size_t num, bool update,
+                          uint64_t *mask)
+{
+	BatchTask task = {
+		.layer = layer,
+		.input = input,
+		.pre = pre,
+		.output = output,
+		.update = update,
+		.mask = mask,
+	};
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, num,
+	                   pool_grain(layer->size * layer->next_size),
+	                   forward_rows, &task);
+}
+
+/**
+ * @brief 批量前向传播第`[begin, end)`个输入
+ * @param arg   `[INOUT]``BatchTask`
+ * @param begin 起始下标
+ * @param end   终止下标（不含）
+ */
+static void forward_rows(void *arg, size_t begin, size_t end)
+{
+	BatchTask *task = (BatchTask*)arg;
+	FCLayer *layer = task->layer;
+	size_t in_size = layer->size;
+	size_t out_size = layer->next_size;
+	for (size_t k = begin; k < end; k++)
+		memcpy(task->output + k * out_size, layer->bias->val,
+		       sizeof(float) * out_size);
+	for (size_t c = 0; c < in_size; c++) {
+		float *w = layer->weight->val[c]->val;
+		for (size_t k = begin; k < end; k++) {
+			float x = task->input[k * in_size + c];
+			float *out = task->output + k * out_size;
+			for (size_t r = 0; r < out_size; r++)
+				out[r] += w[r] * x;
+		}
+	}
+	for (size_t k = begin; k < end; k++) {
+		float *out = task->output + k * out_size;
+		fc_post(layer, out, task->pre ? task->pre + k * out_size : NULL, out,
+		        task->update, task->mask);
+	}
+}
+
+/**
+ * @brief 初始化权重的`[begin, end)`列
+ * @param arg   `[INOUT]``InitTask`
+ * @param begin 起始列
+ * @param end   终止列（不含）
+ */
+static void init_cols(void *arg, size_t begin, size_t end)
+{
+	InitTask *task = (InitTask*)arg;
+	size_t row = task->weight->row;
+	for (size_t i = begin; i < end; i++) {
+		float *col = task->weight->val[i]->val;
+		if (task->kind == MLP_INIT_XAVIER_UNIFORM
+		    || task->kind == MLP_INIT_HE_UNIFORM)
+			rand_fill_uniform_at(col, row, task->key, i * row,
+			                     -task->scale, task->scale);
+		else
+			rand_fill_normal_at(col, row, task->key, i * row, 0.0,
+			                    task->scale);
+	}
+}
+
+/**
+ * @brief  获取激活函数在导出代码中的表达式
+ * @param  actf 激活函数
+ * @return 以`x`为自变量的表达式，无法识别时返回`NULL`
+ */
+static const char *actf_expr(float (*actf)(float))
+{
+	static const char *expr[ACTF_NUM] = {
+		"1.0f / (1.0f + expf(-x))",
+		"fmaxf(x, 0.0f)",
+		"x",
+	};
+	int index = actf_find(actf);
+	return index < 0 ? NULL : expr[index];
+}
+
+/**
+ * @brief 以 C 初始化列表格式写出数组
+ * @param file `[INOUT]`文件
+ * @param val  `[IN]`数组
+ * @param size 长度
+ */
+static void export_array(FILE *file, float *val, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		fprintf(file, "%s%.9g",
+		        i == 0 ? "\n\t" : i % 8 ? ", " : ",\n\t", val[i]);
+	fprintf(file, "\n");
 }
@@ -2,24 +2,63 @@
 #define MLP_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <math.h>
 #include "vector.h"
 #include "matrix.h"
+#include "memory.h"
 
+#define MLP_BATCH_BLOCK 64  /* 批量推理时每次处理的输入数量 */
+#define MLP_ALIGN 64        /* 梯度缓冲区的对齐字节数 */
+#define MLP_RN_MOMENTUM 0.99  /* 滑动归一化统计量的衰减率 */
+#define MLP_RN_EPS 1e-5       /* 滑动归一化分母中的小量 */
+#define MLP_ROWS_ALL SIZE_MAX /* `GradRows::num`取此值时视为全部行均可能非零 */
+#define MLP_GRAD_BLOCK 16384  /* 梯度逐段处理时交给线程池的块长 */
+
+typedef enum MLPInit MLPInit;
+typedef enum MLPGuard MLPGuard;
 typedef struct FCLayer FCLayer;
+typedef struct Layer Layer;
 typedef struct MLPNet MLPNet;
+typedef struct GradRows GradRows;
 typedef struct MLPGrad MLPGrad;
 
+/***** MLPInit *****/
+
+/* 权重初始化方式 */
+enum MLPInit {
+	MLP_INIT_XAVIER_UNIFORM,  /* U(-sqrt(6 / (in + out)), sqrt(6 / (in + out))) */
+	MLP_INIT_XAVIER_NORMAL,   /* N(0, 2 / (in + out)) */
+	MLP_INIT_HE_UNIFORM,      /* U(-sqrt(6 / in), sqrt(6 / in)) */
+	MLP_INIT_HE_NORMAL,       /* N(0, 2 / in) */
+};
+
+/***** MLPGuard *****/
+
+/* 梯度出现非有限值时的处理方式，两者均不更新参数 */
+enum MLPGuard {
+	MLP_GUARD_SKIP,   /* 跳过本次更新 */
+	MLP_GUARD_ABORT,  /* 跳过本次更新，并令`Trainer`停止训练 */
+};
+
 /***** FCLayer *****/
 
 struct FCLayer {
 	size_t size;       /* 大小 */
 	size_t next_size;  /* 下层大小 */
-	Vector *node;      /* 节点 */
+	Vector *node;      /* 节点，检查点模式下非检查点层为`NULL` */
 	Matrix *weight;    /* 权重 */
 	Vector *bias;      /* 偏置 */
-	Vector *pre;       /* 线性变换结果 */
-	Vector *out;       /* 输出 */
+	Vector *pre;       /* 线性变换结果，滑动归一化时为归一化结果，检查点模式下为`NULL` */
+	Vector *out;       /* 输出，检查点模式下除输出层外为`NULL` */
+	Vector *gamma;     /* 滑动归一化的缩放，为`NULL`时不做滑动归一化 */
+	Vector *beta;      /* 滑动归一化的平移 */
+	Vector *mean;      /* 滑动均值 */
+	Vector *var;       /* 滑动方差 */
+	float dropout;     /* 输出的丢弃概率，为`0`时不丢弃，默认`0` */
+	uint64_t *mask;    /* 丢弃掩码，按位存储，`1`为保留 */
+	bool bound;        /* 参数是否已移入`MLPNet::param` */
 	float (*actf)(float x);   /* 激活函数 */
 	float (*dactf)(float x);  /* 激活函数的导函数 */
 
@@ -34,11 +73,24 @@ struct FCLayer {
 	void (*clear)(FCLayer *this);
 
 	/**
-	 * @brief  前向传播
+	 * @brief  前向传播（训练模式）
 	 * @param  input `[IN]`输入
 	 */
 	void (*forward)(FCLayer *this, Vector *input);
 
+	/**
+	 * @brief  启用滑动归一化，须在`new_mlp_net`之前调用
+	 *
+	 * 以滑动均值与滑动方差归一化线性变换结果，再经`gamma`缩放、`beta`平移，
+	 * 位于线性变换与激活函数之间，与二者在同一次遍历中计算。
+	 * 这不是批归一化：训练按单个样本进行，没有批统计量，前向传播先以本样本
+	 * 按`MLP_RN_MOMENTUM`更新滑动统计量，再以其归一化；反向传播视统计量为常量。
+	 *
+	 * @return 成功或已启用时返回`true`；已加入`MLPNet`时参数位于其缓冲区中，
+	 *         无法扩展，不做任何事并返回`false`
+	 */
+	bool (*runnorm)(FCLayer *this);
+
 	/**
 	 * @brief  相加
 	 * @param  target `[IN]`另一`FCLayer`
@@ -78,13 +130,131 @@ FCLayer *new_fc_layer(size_t size, size_t next_size, Matrix *weight,
                       Vector *bias, float (*actf)(float),
                       float (*dactf)(float));
 
+/***** Layer *****/
+
+/*
+ * 通用层。
+ *
+ * 全连接层由`new_dense_layer`包装，其计算由`MLPNet`直接完成，
+ * 检查点、滑动归一化、折叠与导出仅支持全连接层。
+ * 其他种类（见`layer.h`）由`new_layer`创建后设置`forward`/`backward`等钩子，
+ * 参数位于`param`，加入`MLPNet`后为`MLPNet::param`中的视图。
+ */
+struct Layer {
+	size_t size;        /* 输入大小 */
+	size_t next_size;   /* 输出大小 */
+	size_t param_size;  /* 参数数量 */
+	size_t work_size;   /* 每个样本前向传播所需的工作区大小 */
+	size_t row_size;    /* 稀疏梯度一行的参数数量，为`0`时梯度稠密 */
+	size_t offset;      /* 参数在`MLPNet::param`中的偏移 */
+	FCLayer *fc;        /* 全连接层，其他种类为`NULL` */
+	Vector *node;       /* 输入，全连接层为`NULL` */
+	Vector *out;        /* 输出，全连接层为`NULL` */
+	float *work;        /* 工作区，全连接层为`NULL` */
+	float *param;       /* 参数，全连接层为`NULL` */
+	bool own_param;     /* 是否拥有`param` */
+	float (*actf)(float x);   /* 激活函数，不需要时为`NULL` */
+	float (*dactf)(float x);  /* 激活函数的导函数，不需要时为`NULL` */
+
+	/**
+	 * @brief 销毁`Layer`
+	 */
+	void (*free)(Layer *this);
+
+	/**
+	 * @brief  拷贝自身，参数为自有的拷贝
+	 * @return `[OWN]`拷贝
+	 */
+	Layer *(*copy)(Layer *this);
+
+	/**
+	 * @brief 令参数改为引用`param`，并将当前值拷贝过去
+	 * @param param `[OUT]`参数缓冲区中属于本层的部分
+	 */
+	void (*bind)(Layer *this, float *param);
+
+	/**
+	 * @brief 初始化参数，可为`NULL`
+	 * @param key 密钥，由`MLPNet::init`的种子与层序号决定
+	 */
+	void (*init)(Layer *this, uint64_t key);
+
+	/**
+	 * @brief 前向传播一个样本，不得修改`this`的其他成员
+	 * @param input  `[IN]`输入
+	 * @param output `[OUT]`输出
+	 * @param work   `[OUT]`工作区，供`backward`使用
+	 * @param train  是否为训练模式
+	 */
+	void (*forward)(Layer *this, const float *input, float *output,
+	                float *work, bool train);
+
+	/**
+	 * @brief 反向传播一个样本
+	 * @param input      `[IN]`输入
+	 * @param output     `[IN]`输出
+	 * @param work       `[INOUT]`前向传播时的工作区，前向传播写入的部分不得修改
+	 * @param out_grad   `[IN]`输出梯度
+	 * @param param_grad `[INOUT]`参数梯度，累加
+	 * @param in_grad    `[OUT]`输入梯度，传入`NULL`以忽略
+	 */
+	void (*backward)(Layer *this, const float *input, const float *output,
+	                 float *work, const float *out_grad, float *param_grad,
+	                 float *in_grad);
+
+	/**
+	 * @brief  获取一个样本的梯度可能非零的行，`row_size`非零时须设置
+	 *
+	 * 参数按每`row_size`个一行划分，`backward`只写入这些行。
+	 *
+	 * @param  input `[IN]`该样本的输入
+	 * @param  row   `[OUT]`行号，至多`size`个，可重复
+	 * @return 行数
+	 */
+	size_t (*rows)(Layer *this, const float *input, size_t *row);
+};
+
+/**
+ * @brief  创建通用层，供各种类的构造函数使用
+ *
+ * 分配`node`/`out`/`work`与初始值为`0`的`param`，钩子中只设置了
+ * `free`/`copy`/`bind`，其余由调用者设置。
+ *
+ * @param  size       输入大小
+ * @param  next_size  输出大小
+ * @param  param_size 参数数量
+ * @param  work_size  工作区大小
+ * @return `[OWN]``Layer`指针
+ */
+Layer *new_layer(size_t size, size_t next_size, size_t param_size,
+                 size_t work_size);
+
+/**
+ * @brief  将全连接层包装为通用层
+ * @param  fc `[IN]`全连接层
+ * @return `[OWN]``Layer`指针
+ */
+Layer *new_dense_layer(FCLayer *fc);
+
 /***** MLPNet *****/
 
 struct MLPNet {
-	size_t size;      /* 不含输出层的层数 */
-	FCLayer **layer;  /* 层 */
+	size_t size;    /* 不含输出层的层数 */
+	Layer **layer;  /* 层 */
 	float (*lossf)(Vector*, Vector*);    /* 损失函数 */
 	Vector *(*dlossf)(Vector*, Vector*);  /* 损失函数的梯度函数 */
+	size_t param_size;  /* 参数总数 */
+	float *param;       /* 全部参数，布局同`MLPGrad`，各层参数为其视图 */
+	bool own_param;     /* 是否拥有`param`，由`share`创建的网络为`false` */
+	float clip_norm;    /* 梯度全局范数的上限，为`0`时不裁剪，默认`0` */
+	MLPGuard guard;     /* 梯度出现非有限值时的处理方式，默认跳过 */
+	size_t clip_num;    /* 被裁剪的更新次数 */
+	size_t skip_num;    /* 因梯度出现非有限值而跳过的更新次数 */
+	size_t checkpoint;  /* 检查点间隔，为`0`时保存全部中间结果 */
+	float *recompute;   /* 检查点模式下一段内各层的`pre`与`out` */
+	float *backprop;    /* 反向传播时节点梯度的缓冲区 */
+	void (*grad_hook)(void *arg, size_t index);  /* 每求出一层的梯度后调用，默认`NULL` */
+	void *grad_hook_arg;  /* `grad_hook`的参数 */
 
 	/**
 	 * @brief 销毁 MLPNet
@@ -92,28 +262,141 @@ struct MLPNet {
 	void (*free)(MLPNet *this);
 
 	/**
-	 * @brief Xavier 初始化网络
+	 * @brief Xavier 初始化网络，种子取自当前线程的随机数流
 	 */
 	void (*init_xavier)(MLPNet *this);
 
+	/**
+	 * @brief 初始化网络，权重并行生成，偏置置零
+	 *
+	 * 每个权重只由`seed`、层序号与其下标决定，结果与线程数无关。
+	 *
+	 * @param kind 初始化方式
+	 * @param seed 种子
+	 */
+	void (*init)(MLPNet *this, MLPInit kind, uint64_t seed);
+
 	/** 
-	 * @brief 前向传播
+	 * @brief 前向传播（训练模式）
+	 *
+	 * 更新滑动归一化的统计量并重新生成丢弃掩码，推理请用`predict_batch`。
+	 *
 	 * @param input `[IN]`输入
 	 */
 	void (*forward)(MLPNet *this, Vector *input);
 
+	/**
+	 * @brief  获取最近一次`forward`的输出
+	 * @return 输出层的输出，引用网络内部
+	 */
+	Vector *(*output)(MLPNet *this);
+
 	/**
 	 * @brief 计算梯度
+	 *
+	 * 自输出层起逐层求出梯度，设置了`grad_hook`时每求出第`index`层的梯度即以该序号调用，
+	 * 此后本次调用不再修改该层的梯度。
+	 *
 	 * @param label `[IN]`标签
 	 * @param grad  `[OUT]`梯度容器
 	 */
 	void (*grad)(MLPNet *this, Vector *label, MLPGrad *grad);
 
 	/**
-	 * @brief 更新参数
-	 * @param grad 梯度
+	 * @brief  生成用于推理的网络
+	 *
+	 * 滑动归一化折叠进权重与偏置，丢弃去除，推理时不再有额外开销。
+	 * 非全连接层原样拷贝。
+	 *
+	 * @return `[OWN]`新的`MLPNet`
+	 */
+	MLPNet *(*fold)(MLPNet *this);
+
+	/**
+	 * @brief  创建共享参数的网络
+	 *
+	 * 新网络的各层中间结果、丢弃掩码与缓冲区各自独立，`param`引用本网络的`param`，
+	 * 可在各自的线程中`forward`/`grad`/`update`，即 Hogwild! 式的无锁训练。
+	 * 须在没有其他线程更新参数时调用。
+	 *
+	 * @return `[OWN]`新的`MLPNet`，须在本网络之前销毁
+	 */
+	MLPNet *(*share)(MLPNet *this);
+
+	/**
+	 * @brief 设置检查点间隔
+	 *
+	 * 间隔为`k`时，只保存第`0, k, 2k, ...`层的`node`与输出层的`out`，
+	 * 其余中间结果在`grad`中逐段重算，以约一次额外的前向传播换取内存。
+	 * 各段共用一块重算缓冲区，其大小取决于最宽的一段。
+	 * 设置后须重新`forward`再`grad`。仅支持全部由全连接层组成的网络，
+	 * 否则不做任何事。
+	 *
+	 * @param stride 间隔，传入`0`以保存全部中间结果
 	 */
-	void (*update)(MLPNet *this, MLPGrad *grad);
+	void (*set_checkpoint)(MLPNet *this, size_t stride);
+
+	/**
+	 * @brief  获取中间结果占用的内存
+	 *
+	 * 包括各层的`node`/`pre`/`out`/`work`与重算缓冲区，
+	 * 比较`set_checkpoint`前后的返回值即可得到节省的峰值内存。
+	 *
+	 * @return 字节数
+	 */
+	size_t (*activation_bytes)(MLPNet *this);
+
+	/**
+	 * @brief  统计内存占用
+	 *
+	 * 各层计入其结构体、中间结果、丢弃掩码、参数视图与其在`param`中的份额，
+	 * 合计另含网络结构体、`param`的补齐与对齐、重算与反向传播缓冲区。
+	 * 不拥有`param`时不计参数。
+	 *
+	 * @param  layer `[OUT]`各层的统计，传入`NULL`以忽略
+	 * @return 合计
+	 */
+	MemStat (*memory)(MLPNet *this, MemStat *layer);
+
+	/**
+	 * @brief  更新参数，即`param -= rate * grad`
+	 *
+	 * 梯度的全局范数超过`clip_norm`时按比例缩小到`clip_norm`。
+	 * 范数取自`grad->norm2`，未知时才额外遍历一次梯度。
+	 *
+	 * @param  grad `[IN]`梯度
+	 * @param  rate 学习率
+	 * @return 已更新返回`true`；梯度出现非有限值而跳过时返回`false`
+	 */
+	bool (*update)(MLPNet *this, MLPGrad *grad, float rate);
+
+	/**
+	 * @brief 批量推理
+	 *
+	 * 不使用各层的`node`/`pre`/`out`，可与其他`predict_batch`并发调用，
+	 * 但不可与`update`并发。滑动归一化不更新统计量，不做丢弃。
+	 *
+	 * @param input `[IN]`输入数组
+	 * @param num   输入数量，为`0`时不做任何事
+	 * @param res   `[OUT]`各输入的最大输出下标
+	 * @param prob  `[OUT]`各输入的输出层，传入`NULL`或元素为`NULL`以忽略
+	 */
+	void (*predict_batch)(MLPNet *this, Vector **input, size_t num,
+	                      size_t *res, Vector **prob);
+
+	/**
+	 * @brief  导出为独立的 C 推理源文件
+	 *
+	 * 生成`<path>.h`与`<path>.c`，权重为`static const`数组，
+	 * 推理函数为`void <name>_predict(const float *input, float *output)`，
+	 * 不依赖本库，也不使用堆。激活函数仅支持`actf.h`中的函数。
+	 * 滑动归一化先经`fold`折叠。含非全连接层时返回`false`。
+	 *
+	 * @param  path 输出路径，不含扩展名
+	 * @param  name 生成的标识符前缀
+	 * @return 成功返回`true`；否则，返回`false`
+	 */
+	bool (*export_c)(MLPNet *this, char *path, char *name);
 };
 
 /**
@@ -127,12 +410,53 @@ MLPNet *new_mlp_net(size_t size, FCLayer **layer,
                     float (*lossf)(Vector*, Vector*),
                     Vector *(*dlossf)(Vector*, Vector*));
 
+/**
+ * @brief 由通用层创建`MLPNet`
+ *
+ * 相邻两层的`next_size`与`size`须相等。
+ *
+ * @param size  含输出层的层数
+ * @param layer `[IN]`层
+ * @param loss  损失函数
+ * @param dloss 损失函数的导函数
+ */
+MLPNet *new_mlp_net_layers(size_t size, Layer **layer,
+                           float (*lossf)(Vector*, Vector*),
+                           Vector *(*dlossf)(Vector*, Vector*));
+
+/***** GradRows *****/
+
+/*
+ * 稀疏层梯度中可能非零的行。
+ *
+ * `MLPNet::grad`只清零上一样本写入的行，`MLPGrad`的`clear`/`add`/`scale`、
+ * `MLPNet::update`与 Hogwild! 的更新也只遍历这些行，而非整个参数表。
+ */
+struct GradRows {
+	size_t offset;    /* 该层梯度在`MLPGrad::param`中的偏移 */
+	size_t row_size;  /* 一行的参数数量 */
+	size_t row_num;   /* 总行数 */
+	size_t num;       /* `row`中的行数，为`MLP_ROWS_ALL`时视为全部行 */
+	size_t capacity;  /* `row`的容量，为`row_num`加该层输入大小 */
+	size_t *row;      /* 可能非零的行 */
+	uint8_t *mark;    /* 各行是否已在`row`中 */
+	double norm2;     /* 这些行的平方和，为负时未知 */
+};
+
 /***** MLPGrad *****/
 
 struct MLPGrad
 {
-	size_t size;      /* 不含输出层的层数 */
-	FCLayer **layer;  /* 层 */
+	size_t size;        /* 不含输出层的层数 */
+	size_t param_size;  /* 梯度总数 */
+	float *param;       /* 全部梯度，按层依次存放权重（按列）与偏置 */
+	double norm2;       /* 平方和，由`clear`/`add`/`scale`顺带维护，为负时未知 */
+	Matrix **weight;    /* 各层权重梯度，引用`param`，非全连接层为`NULL` */
+	Vector **bias;      /* 各层偏置梯度，引用`param`，非全连接层为`NULL` */
+	Vector **gamma;     /* 各层滑动归一化缩放的梯度，未启用时为`NULL` */
+	Vector **beta;      /* 各层滑动归一化平移的梯度，未启用时为`NULL` */
+	GradRows **rows;    /* 各层可能非零的行，`Layer::row_size`为`0`的层为`NULL` */
+	double *partial;    /* 分块处理时各块的平方和，每`MLP_GRAD_BLOCK`个梯度一块 */
 
 	/**
 	 * @brief 销毁`MLPGrad`
@@ -145,7 +469,7 @@ struct MLPGrad
 	void (*clear)(MLPGrad *this);
 
 	/**
-	 * @brief 相加
+	 * @brief 相加，同时求出结果的平方和
 	 * @param target `[IN]`一`MLPGrad`
 	 */
 	void (*add)(MLPGrad *this, MLPGrad *target);
@@ -155,10 +479,25 @@ struct MLPGrad
 	 * @param scalar 倍率
 	 */
 	void (*scale)(MLPGrad *this, float scalar);
+
+	/**
+	 * @brief 视稀疏层的全部行均可能非零，绕过以上方法直接修改`param`后须调用
+	 */
+	void (*touch_all)(MLPGrad *this);
+
+	/**
+	 * @brief  统计内存占用，各层梯度的份额同`MLPNet::memory`中的`param`
+	 * @return 合计
+	 */
+	MemStat (*memory)(MLPGrad *this);
 };
 
 /**
- * @brief  创建`MLPGrad`
+ * @brief  创建`MLPGrad`，初始值为`0`
+ *
+ * 只保存可训练参数的梯度，全部位于一块按`MLP_ALIGN`对齐的连续内存中，
+ * 非全连接层的梯度位于`param + Layer::offset`。
+ *
  * @param  net `[IN]`对应的`MLPNet`
  * @return `[OWN]``MLPGrad`指针
  */
@@ -0,0 +1,339 @@
+#ifdef __linux__
+#define _GNU_SOURCE  /* sched_setaffinity */
+#include <sched.h>
+#endif
+#ifdef __unix__
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "pool.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Pool *new_pool(size_t size, bool pin);
+static void pool_free(Pool *this);
+static void pool_parallel_for(Pool *this, size_t begin, size_t end,
+                              size_t grain,
+                              void (*func)(void *arg, size_t begin,
+                                           size_t end),
+                              void *arg);
+
+void pool_global_config(size_t size, bool pin);
+Pool *pool_global(void);
+
+/*** 内部 ***/
+
+static int pool_worker(void *arg);
+static void pool_push(Pool *this, size_t id, PoolTask task);
+static bool pool_take(Pool *this, size_t id, PoolTask *task);
+static void pool_run(PoolTask *task);
+static void pool_pin(size_t id);
+static void pool_global_create(void);
+static void pool_global_free(void);
+
+static thread_local Pool *current_pool = NULL;  /* 当前线程所属的线程池 */
+static thread_local size_t current_id = SIZE_MAX;  /* 当前线程的序号 */
+
+static Pool *global_pool = NULL;
+static once_flag global_once = ONCE_FLAG_INIT;
+static size_t global_size = SIZE_MAX;  /* `SIZE_MAX`表示自动 */
+static bool global_pin = false;
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Pool *new_pool(size_t size, bool pin)
+{
+	PoolWorker *this_worker = (PoolWorker*)calloc(size, sizeof(PoolWorker));
+	PoolDeque *this_deque = (PoolDeque*)calloc(size, sizeof(PoolDeque));
+	if (size && (!this_worker || !this_deque))
+		goto fail;
+
+	Pool *this = (Pool*)malloc(sizeof(Pool));
+	if (!this)
+		goto fail;
+	*this = (Pool) {
+		.size = size,
+		.pin = pin,
+		.worker = this_worker,
+		.deque = this_deque,
+
+		.free = pool_free,
+		.parallel_for = pool_parallel_for,
+	};
+	atomic_init(&this->queued, 0);
+	atomic_init(&this->next, 0);
+	atomic_init(&this->stop, false);
+	if (mtx_init(&this->lock, mtx_plain) != thrd_success
+	    || cnd_init(&this->wake) != thrd_success)
+		goto thrd_fail;
+	for (size_t i = 0; i < size; i++)
+		if (mtx_init(&this->deque[i].lock, mtx_plain) != thrd_success)
+			goto thrd_fail;
+	for (size_t i = 0; i < size; i++) {
+		this->worker[i] = (PoolWorker) {
+			.pool = this,
+			.id = i,
+		};
+		if (thrd_create(&this->worker[i].thread, pool_worker,
+		                &this->worker[i]) != thrd_success)
+			goto thrd_fail;
+	}
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+static void pool_free(Pool *this)
+{
+	mtx_lock(&this->lock);
+	atomic_store(&this->stop, true);
+	cnd_broadcast(&this->wake);
+	mtx_unlock(&this->lock);
+	for (size_t i = 0; i < this->size; i++)
+		thrd_join(this->worker[i].thread, NULL);
+
+	for (size_t i = 0; i < this->size; i++) {
+		mtx_destroy(&this->deque[i].lock);
+		free(this->deque[i].task);
+	}
+	mtx_destroy(&this->lock);
+	cnd_destroy(&this->wake);
+	free(this->worker);
+	free(this->deque);
+	free(this);
+}
+
+static void pool_parallel_for(Pool *this, size_t begin, size_t end,
+                              size_t grain,
+                              void (*func)(void *arg, size_t begin,
+                                           size_t end),
+                              void *arg)
+{
+	if (end <= begin)
+		return;
+	size_t len = end - begin;
+	if (grain == 0)
+		grain = 1;
+	if (this->size == 0 || len < 2 * grain) {
+		func(arg, begin, end);
+		return;
+	}
+
+	/* 子区间数不超过线程数的 4 倍，以免调度开销 */
+	size_t num = len / grain;
+	if (num > (this->size + 1) * 4)
+		num = (this->size + 1) * 4;
+	size_t step = (len + num - 1) / num;
+	num = (len + step - 1) / step;
+
+	size_t id = current_pool == this ? current_id : SIZE_MAX;
+	atomic_size_t pending;
+	atomic_init(&pending, num - 1);
+	for (size_t i = 1; i < num; i++) {
+		size_t task_end = begin + (i + 1) * step;
+		PoolTask task = {
+			.func = func,
+			.arg = arg,
+			.begin = begin + i * step,
+			.end = task_end < end ? task_end : end,
+			.pending = &pending,
+		};
+		pool_push(this, id, task);
+	}
+	mtx_lock(&this->lock);
+	cnd_broadcast(&this->wake);
+	mtx_unlock(&this->lock);
+
+	func(arg, begin, begin + step);
+	while (atomic_load(&pending)) {
+		PoolTask task;
+		if (pool_take(this, id, &task))
+			pool_run(&task);
+		else
+			thrd_yield();
+	}
+}
+
+void pool_global_config(size_t size, bool pin)
+{
+	global_size = size;
+	global_pin = pin;
+}
+
+Pool *pool_global(void)
+{
+	call_once(&global_once, pool_global_create);
+	return global_pool;
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  工作线程
+ * @param  arg `[IN]``PoolWorker`指针
+ * @return `0`
+ */
+static int pool_worker(void *arg)
+{
+	PoolWorker *worker = (PoolWorker*)arg;
+	Pool *this = worker->pool;
+	current_pool = this;
+	current_id = worker->id;
+	if (this->pin)
+		pool_pin(worker->id);
+
+	for (;;) {
+		PoolTask task;
+		if (pool_take(this, worker->id, &task)) {
+			pool_run(&task);
+			continue;
+		}
+		mtx_lock(&this->lock);
+		while (!atomic_load(&this->queued) && !atomic_load(&this->stop))
+			cnd_wait(&this->wake, &this->lock);
+		mtx_unlock(&this->lock);
+		if (atomic_load(&this->stop) && !atomic_load(&this->queued))
+			break;
+	}
+	return 0;
+}
+
+/**
+ * @brief 提交任务
+ * @param id   当前线程的序号，外部线程为`SIZE_MAX`
+ * @param task 任务
+ */
+static void pool_push(Pool *this, size_t id, PoolTask task)
+{
+	if (id == SIZE_MAX)
+		id = atomic_fetch_add(&this->next, 1) % this->size;
+	PoolDeque *deque = &this->deque[id];
+
+	mtx_lock(&deque->lock);
+	if (deque->tail - deque->head == deque->cap) {
+		size_t cap = deque->cap ? deque->cap * 2 : 64;
+		PoolTask *task_buf = (PoolTask*)malloc(cap * sizeof(PoolTask));
+		if (!task_buf)
+			goto fail;
+		for (size_t i = deque->head; i != deque->tail; i++)
+			task_buf[i - deque->head] = deque->task[i % deque->cap];
+		free(deque->task);
+		deque->task = task_buf;
+		deque->tail -= deque->head;
+		deque->head = 0;
+		deque->cap = cap;
+	}
+	deque->task[deque->tail++ % deque->cap] = task;
+	atomic_fetch_add(&this->queued, 1);
+	mtx_unlock(&deque->lock);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief  取出任务：先从自己的队尾取，再从其他线程的队首窃取
+ * @param  id   当前线程的序号，外部线程为`SIZE_MAX`
+ * @param  task `[OUT]`任务
+ * @return 若取到任务，返回`true`；否则，返回`false`
+ */
+static bool pool_take(Pool *this, size_t id, PoolTask *task)
+{
+	if (!atomic_load(&this->queued))
+		return false;
+	if (id != SIZE_MAX) {
+		PoolDeque *deque = &this->deque[id];
+		mtx_lock(&deque->lock);
+		if (deque->tail != deque->head) {
+			*task = deque->task[--deque->tail % deque->cap];
+			atomic_fetch_sub(&this->queued, 1);
+			mtx_unlock(&deque->lock);
+			return true;
+		}
+		mtx_unlock(&deque->lock);
+	}
+
+	size_t start = id == SIZE_MAX ? 0 : id + 1;
+	for (size_t i = 0; i < this->size; i++) {
+		PoolDeque *deque = &this->deque[(start + i) % this->size];
+		mtx_lock(&deque->lock);
+		if (deque->tail != deque->head) {
+			*task = deque->task[deque->head++ % deque->cap];
+			atomic_fetch_sub(&this->queued, 1);
+			mtx_unlock(&deque->lock);
+			return true;
+		}
+		mtx_unlock(&deque->lock);
+	}
+	return false;
+}
+
+/**
+ * @brief 执行任务并通知所属的`parallel_for`
+ * @param task `[IN]`任务
+ */
+static void pool_run(PoolTask *task)
+{
+	task->func(task->arg, task->begin, task->end);
+	atomic_fetch_sub(task->pending, 1);
+}
+
+/**
+ * @brief 将当前线程绑定到 CPU
+ * @param id 工作线程序号
+ */
+static void pool_pin(size_t id)
+{
+#ifdef __linux__
+	long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpu_num <= 0)
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(id % (size_t)cpu_num, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+#else
+	(void)id;
+#endif
+}
+
+/**
+ * @brief 创建库共享的线程池
+ */
+static void pool_global_create(void)
+{
+	size_t size = global_size;
+	if (size == SIZE_MAX) {
+		char *env = getenv("MLP_THREADS");
+		long cpu_num = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (env)
+			size = (size_t)strtoul(env, NULL, 10);
+		else
+			size = cpu_num > 1 ? (size_t)cpu_num - 1 : 0;
+	}
+	global_pool = new_pool(size, global_pin);
+	atexit(pool_global_free);
+}
+
+/**
+ * @brief 销毁库共享的线程池
+ */
+static void pool_global_free(void)
+{
+	global_pool->free(global_pool);
+	global_pool = NULL;
+}
@@ -0,0 +1,117 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#define POOL_GRAIN 16384  /* 每个任务的最小计算量，低于此值时串行执行 */
+
+typedef struct Pool Pool;
+typedef struct PoolTask PoolTask;
+typedef struct PoolDeque PoolDeque;
+typedef struct PoolWorker PoolWorker;
+
+/***** PoolTask *****/
+
+struct PoolTask {
+	void (*func)(void *arg, size_t begin, size_t end);  /* 任务函数 */
+	void *arg;                /* 任务参数 */
+	size_t begin;             /* 区间起点 */
+	size_t end;               /* 区间终点（不含） */
+	atomic_size_t *pending;   /* 所属`parallel_for`的剩余任务数 */
+};
+
+/***** PoolDeque *****/
+
+struct PoolDeque {
+	mtx_t lock;      /* 锁 */
+	PoolTask *task;  /* 环形缓冲区 */
+	size_t cap;      /* 容量 */
+	size_t head;     /* 队首，供其他线程窃取 */
+	size_t tail;     /* 队尾，供所属线程取用 */
+};
+
+/***** PoolWorker *****/
+
+struct PoolWorker {
+	Pool *pool;     /* 所属线程池 */
+	size_t id;      /* 序号 */
+	thrd_t thread;  /* 线程 */
+};
+
+/***** Pool *****/
+
+struct Pool {
+	size_t size;           /* 工作线程数，为`0`时全部串行执行 */
+	bool pin;              /* 是否将工作线程绑定到 CPU */
+	PoolWorker *worker;    /* 工作线程 */
+	PoolDeque *deque;      /* 各工作线程的任务队列 */
+	atomic_size_t queued;  /* 队列中的任务总数 */
+	atomic_size_t next;    /* 外部线程提交任务时轮询的下标 */
+	atomic_bool stop;      /* 是否停止 */
+	mtx_t lock;            /* 休眠锁 */
+	cnd_t wake;            /* 唤醒休眠的工作线程 */
+
+	/**
+	 * @brief 停止工作线程并销毁`Pool`
+	 */
+	void (*free)(Pool *this);
+
+	/**
+	 * @brief 并行执行`func`于`[begin, end)`的各个子区间
+	 *
+	 * 子区间长度不小于`grain`，区间不足两个子区间时在当前线程串行执行。
+	 * 调用线程在等待期间也会执行任务，可在任务中嵌套调用。
+	 *
+	 * @param begin 区间起点
+	 * @param end   区间终点（不含）
+	 * @param grain 子区间的最小长度
+	 * @param func  任务函数，处理`[begin, end)`
+	 * @param arg   `[INOUT]`任务参数
+	 */
+	void (*parallel_for)(Pool *this, size_t begin, size_t end, size_t grain,
+	                     void (*func)(void *arg, size_t begin, size_t end),
+	                     void *arg);
+};
+
+/**
+ * @brief  创建`Pool`
+ * @param  size 工作线程数
+ * @param  pin  是否将工作线程绑定到 CPU，仅在 Linux 下有效
+ * @return `[OWN]``Pool`指针
+ */
+Pool *new_pool(size_t size, bool pin);
+
+/***** 其他 *****/
+
+/**
+ * @brief 设置库共享线程池的参数，须在首次调用`pool_global`前调用
+ *
+ * 未设置时，工作线程数取环境变量`MLP_THREADS`，否则取 CPU 数减一。
+ *
+ * @param size 工作线程数
+ * @param pin  是否将工作线程绑定到 CPU
+ */
+void pool_global_config(size_t size, bool pin);
+
+/**
+ * @brief  获取库共享的线程池，首次调用时创建
+ * @return 线程池
+ */
+Pool *pool_global(void);
+
+/**
+ * @brief  按每个下标的计算量求子区间的最小长度
+ * @param  cost 每个下标的计算量
+ * @return 子区间的最小长度
+ */
+static inline size_t pool_grain(size_t cost)
+{
+	if (cost == 0 || cost >= POOL_GRAIN)
+		return 1;
+	return (POOL_GRAIN + cost - 1) / cost;
+}
+
+#endif  /* POOL_H_ */
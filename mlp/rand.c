@@ -0,0 +1,230 @@
+#include <stdint.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include "rand.h"
+
+#define RAND_LANES 8  /* 批量填充的并行路数 */
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+void rand_seed(uint64_t seed);
+void rand_stream(uint64_t stream);
+uint64_t rand_next(void);
+float rand_uniform(float min, float max);
+size_t rand_below(size_t n);
+void rand_fill_uniform(float *val, size_t size, float min, float max);
+void rand_fill_uniform_at(float *val, size_t size, uint64_t key,
+                          uint64_t offset, float min, float max);
+void rand_fill_normal_at(float *val, size_t size, uint64_t key,
+                         uint64_t offset, float mean, float stddev);
+
+/*** 内部 ***/
+
+/* 线程的随机数状态 */
+typedef struct {
+	uint64_t s[4];        /* xoshiro256** 状态 */
+	uint64_t stream;      /* 流号 */
+	uint64_t generation;  /* 初始化时的种子代数，`0`表示未初始化 */
+} RandState;
+
+static uint64_t splitmix64(uint64_t *x);
+static void rand_init(RandState *state);
+static RandState *rand_state(void);
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint32_t rotl32(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/* splitmix64 的输出变换，64 位的双射 */
+static inline uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * @brief  由密钥得到计数器哈希的起点
+ *
+ * 先对整个 64 位密钥做一次混合，密钥间的任何简单关系（如只差几位）
+ * 都不会保留到起点上。
+ *
+ * @param  key 密钥
+ * @return 起点
+ */
+static inline uint64_t rand_key(uint64_t key)
+{
+	return mix64(key + 0x9e3779b97f4a7c15ULL);
+}
+
+/**
+ * @brief  计数器哈希，由起点与下标得到 32 位随机数
+ *
+ * 即以`base`为状态的 splitmix64 的第`counter`个输出，
+ * 不同密钥的序列只在起点之差恰为步长的倍数时重叠。
+ *
+ * @param  base    `rand_key`得到的起点
+ * @param  counter 下标
+ * @return 随机数
+ */
+static inline uint32_t rand_hash(uint64_t base, uint64_t counter)
+{
+	return (uint32_t)(mix64(base + counter * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static atomic_uint_fast64_t global_seed = 0x853c49e6748fea9bULL;
+static atomic_uint_fast64_t global_generation = 1;
+static atomic_uint_fast64_t global_stream = 0;  /* 下一个待领取的流号 */
+static thread_local RandState local_state = {.generation = 0};
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+void rand_seed(uint64_t seed)
+{
+	atomic_store(&global_seed, seed);
+	atomic_store(&global_stream, 0);
+	atomic_fetch_add(&global_generation, 1);
+}
+
+void rand_stream(uint64_t stream)
+{
+	local_state.stream = stream;
+	rand_init(&local_state);
+}
+
+uint64_t rand_next(void)
+{
+	uint64_t *s = rand_state()->s;
+	uint64_t ret = rotl64(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+	return ret;
+}
+
+float rand_uniform(float min, float max)
+{
+	return min + (rand_next() >> 40) * 0x1p-24f * (max - min);
+}
+
+size_t rand_below(size_t n)
+{
+	if (!n)
+		return 0;
+	/* 拒绝采样，丢弃不足一整轮的尾部 */
+	uint64_t limit = UINT64_MAX - UINT64_MAX % n;
+	uint64_t x;
+	do
+		x = rand_next();
+	while (x >= limit);
+	return x % n;
+}
+
+void rand_fill_uniform(float *val, size_t size, float min, float max)
+{
+	if (size < RAND_LANES * 8) {
+		for (size_t i = 0; i < size; i++)
+			val[i] = rand_uniform(min, max);
+		return;
+	}
+
+	uint32_t s[4][RAND_LANES];
+	for (size_t i = 0; i < 4; i++)
+		for (size_t j = 0; j < RAND_LANES; j += 2) {
+			uint64_t x = rand_next();
+			s[i][j] = (uint32_t)x;
+			s[i][j + 1] = (uint32_t)(x >> 32);
+		}
+
+	float range = (max - min) * 0x1p-24f;
+	size_t i = 0;
+	for (; i + RAND_LANES <= size; i += RAND_LANES)
+		for (size_t j = 0; j < RAND_LANES; j++) {
+			uint32_t res = s[0][j] + s[3][j];
+			uint32_t t = s[1][j] << 9;
+			s[2][j] ^= s[0][j];
+			s[3][j] ^= s[1][j];
+			s[1][j] ^= s[2][j];
+			s[0][j] ^= s[3][j];
+			s[2][j] ^= t;
+			s[3][j] = rotl32(s[3][j], 11);
+			val[i + j] = min + (res >> 8) * range;
+		}
+	for (; i < size; i++)
+		val[i] = rand_uniform(min, max);
+}
+
+void rand_fill_uniform_at(float *val, size_t size, uint64_t key,
+                          uint64_t offset, float min, float max)
+{
+	float range = (max - min) * 0x1p-24f;
+	uint64_t base = rand_key(key);
+	for (size_t i = 0; i < size; i++)
+		val[i] = min + (rand_hash(base, offset + i) >> 8) * range;
+}
+
+void rand_fill_normal_at(float *val, size_t size, uint64_t key,
+                         uint64_t offset, float mean, float stddev)
+{
+	/* Box-Muller 变换，每个下标使用两个独立的哈希值 */
+	uint64_t base = rand_key(key);
+	uint64_t base2 = rand_key(~key);
+	for (size_t i = 0; i < size; i++) {
+		float u1 = ((rand_hash(base, offset + i) >> 8) + 1) * 0x1p-24f;
+		float u2 = (rand_hash(base2, offset + i) >> 8) * 0x1p-24f;
+		val[i] = mean + stddev * sqrtf(-2.0f * logf(u1))
+		                * cosf(6.28318530718f * u2);
+	}
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  splitmix64，用于由种子展开状态
+ * @param  x `[INOUT]`计数器
+ * @return 随机数
+ */
+static uint64_t splitmix64(uint64_t *x)
+{
+	return mix64(*x += 0x9e3779b97f4a7c15ULL);
+}
+
+/**
+ * @brief 按全局种子与流号初始化状态
+ * @param state `[INOUT]`状态
+ */
+static void rand_init(RandState *state)
+{
+	uint64_t x = atomic_load(&global_seed)
+	             ^ (state->stream * 0xd1b54a32d192ed03ULL);
+	for (size_t i = 0; i < 4; i++)
+		state->s[i] = splitmix64(&x);
+	state->generation = atomic_load(&global_generation);
+}
+
+/**
+ * @brief  获取当前线程的状态，必要时领取流号并初始化
+ * @return 状态
+ */
+static RandState *rand_state(void)
+{
+	RandState *state = &local_state;
+	if (state->generation != atomic_load(&global_generation)) {
+		state->stream = atomic_fetch_add(&global_stream, 1);
+		rand_init(state);
+	}
+	return state;
+}
@@ -1,4 +1,36 @@
-#include <stdlib.h>
+#ifndef RAND_H_
+#define RAND_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * xoshiro256** 随机数发生器。
+ *
+ * 每个线程拥有独立的流，互不加锁。各线程首次使用时按顺序领取流号，
+ * 也可用`rand_stream`显式指定；种子与流号相同则序列相同。
+ */
+
+/**
+ * @brief 设置全局种子，各线程在下次使用时重新初始化其流
+ * @param seed 种子
+ */
+void rand_seed(uint64_t seed);
+
+/**
+ * @brief 将当前线程切换到指定的流，并从该流的起点开始
+ *
+ * 再次调用`rand_seed`后，线程将重新领取流号。
+ *
+ * @param stream 流号
+ */
+void rand_stream(uint64_t stream);
+
+/**
+ * @brief  生成 64 位随机数
+ * @return 随机数
+ */
+uint64_t rand_next(void);
 
 /**
  * @brief  生成均一分布的随机数
@@ -6,7 +38,54 @@
  * @param  max 最大值
  * @return `[min, max)`中的随机数
  */
-static inline float rand_uniform(float min, float max)
-{
-	return min + (float)rand() / (RAND_MAX + 1.0) * (max - min);  /* Powered by ChatGPT */
-}
+float rand_uniform(float min, float max);
+
+/**
+ * @brief  生成均一分布的随机整数，无取模偏差
+ * @param  n 上界
+ * @return `[0, n)`中的随机整数；`n`为`0`时返回`0`，不消耗随机数
+ */
+size_t rand_below(size_t n);
+
+/**
+ * @brief 批量填充均一分布的随机数
+ *
+ * 以当前线程的流为种子展开多路 xoshiro128+，各路相互独立，便于向量化。
+ *
+ * @param val  `[OUT]`数组
+ * @param size 长度
+ * @param min  最小值
+ * @param max  最大值
+ */
+void rand_fill_uniform(float *val, size_t size, float min, float max);
+
+/**
+ * @brief 按下标填充均一分布的随机数
+ *
+ * 第`i`个值只由`key`与`offset + i`决定，与调用顺序、线程数无关，
+ * 可将数组分块后并行填充。
+ * 密钥先经 64 位混合，不同密钥（含只差几位的相邻种子）的序列互不相关。
+ *
+ * @param val    `[OUT]`数组
+ * @param size   长度
+ * @param key    密钥
+ * @param offset 首个值的下标
+ * @param min    最小值
+ * @param max    最大值
+ */
+void rand_fill_uniform_at(float *val, size_t size, uint64_t key,
+                          uint64_t offset, float min, float max);
+
+/**
+ * @brief 按下标填充正态分布的随机数，性质同`rand_fill_uniform_at`
+ * @param val    `[OUT]`数组
+ * @param size   长度
+ * @param key    密钥
+ * @param offset 首个值的下标
+ * @param mean   均值
+ * @param stddev 标准差
+ */
+void rand_fill_normal_at(float *val, size_t size, uint64_t key,
+                         uint64_t offset, float mean, float stddev);
+
+#endif  /* RAND_H_ */
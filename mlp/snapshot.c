@@ -0,0 +1,531 @@
+#ifdef __unix__
+#define _POSIX_C_SOURCE 200809L  /* fileno, fsync */
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+#include "vector.h"
+#include "mlp.h"
+#include "actf.h"
+#include "snapshot.h"
+#include "timer.h"
+
+#define SNAPSHOT_MAGIC "MLPS"
+#define SNAPSHOT_VERSION 2
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Snapshot *new_snapshot(MLPNet *net, char *path);
+static void snapshot_free(Snapshot *this);
+static void snapshot_take(Snapshot *this, size_t step);
+static void snapshot_flush(Snapshot *this);
+static void snapshot_print(Snapshot *this);
+bool snapshot_restore(MLPNet *net, char *path, size_t *step);
+MLPNet *snapshot_load(char *path, float (*lossf)(Vector*, Vector*),
+                      Vector *(*dlossf)(Vector*, Vector*), size_t *step);
+
+/*** 内部 ***/
+
+/* 文件头 */
+typedef struct {
+	char magic[4];        /* `SNAPSHOT_MAGIC` */
+	uint32_t version;     /* `SNAPSHOT_VERSION` */
+	uint64_t layer_num;   /* 层数 */
+	uint64_t param_size;  /* 参数总数 */
+} FileHeader;
+
+/* 一层的描述 */
+typedef struct {
+	uint64_t size;        /* 输入大小 */
+	uint64_t next_size;   /* 输出大小 */
+	uint64_t param_size;  /* 参数数量 */
+	int32_t dense;        /* 是否为全连接层 */
+	int32_t actf;         /* 激活函数在`actf_get`中的序号，未知时为`-1` */
+	int32_t runnorm;      /* 是否启用滑动归一化 */
+	float dropout;        /* 丢弃概率 */
+} LayerRecord;
+
+/* 读入的快照 */
+typedef struct {
+	FileHeader header;    /* 文件头 */
+	LayerRecord *layer;   /* 各层描述 */
+	uint64_t step;        /* 步数 */
+	float *param;         /* 参数 */
+} SnapshotFile;
+
+static int snapshot_worker(void *arg);
+static size_t write_file(Snapshot *this, float *param, size_t step);
+static SnapshotFile *read_file(char *path);
+static void snapshot_file_free(SnapshotFile *file);
+static bool valid_layers(SnapshotFile *file);
+static bool match_layer(Layer *layer, LayerRecord *record);
+static uint64_t checksum(uint64_t hash, const void *data, size_t size);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Snapshot *new_snapshot(MLPNet *net, char *path)
+{
+	char *this_path = (char*)malloc(strlen(path) + 1);
+	size_t this_header_size = sizeof(FileHeader)
+	                          + sizeof(LayerRecord) * net->size;
+	unsigned char *this_header = (unsigned char*)calloc(this_header_size, 1);
+	float *buf0 = (float*)malloc(sizeof(float) * (net->param_size + 1));
+	float *buf1 = (float*)malloc(sizeof(float) * (net->param_size + 1));
+	if (!this_path || !this_header || !buf0 || !buf1)
+		goto fail;
+	strcpy(this_path, path);
+
+	FileHeader header = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.layer_num = net->size,
+		.param_size = net->param_size,
+	};
+	memcpy(this_header, &header, sizeof(FileHeader));
+	for (size_t i = 0; i < net->size; i++) {
+		Layer *layer = net->layer[i];
+		LayerRecord record = {
+			.size = layer->size,
+			.next_size = layer->next_size,
+			.param_size = layer->param_size,
+			.dense = layer->fc != NULL,
+			.actf = layer->fc ? actf_find(layer->fc->actf) : -1,
+			.runnorm = layer->fc && layer->fc->gamma,
+			.dropout = layer->fc ? layer->fc->dropout : 0.0,
+		};
+		memcpy(this_header + sizeof(FileHeader) + sizeof(LayerRecord) * i,
+		       &record, sizeof(LayerRecord));
+	}
+
+	Snapshot *this = (Snapshot*)malloc(sizeof(Snapshot));
+	if (!this)
+		goto fail;
+	*this = (Snapshot) {
+		.net = net,
+		.path = this_path,
+		.header = this_header,
+		.header_size = this_header_size,
+		.buf = {buf0, buf1},
+		.step = {0, 0},
+		.writing = -1,
+		.pending = -1,
+		.stop = false,
+
+		.take_num = 0,
+		.write_num = 0,
+		.drop_num = 0,
+		.fail_num = 0,
+		.last_step = 0,
+		.bytes = 0,
+		.take_time = 0.0,
+		.take_max = 0.0,
+		.write_time = 0.0,
+		.write_max = 0.0,
+
+		.free = snapshot_free,
+		.take = snapshot_take,
+		.flush = snapshot_flush,
+		.print = snapshot_print,
+	};
+	if (mtx_init(&this->lock, mtx_plain) != thrd_success
+	    || cnd_init(&this->arrive) != thrd_success
+	    || cnd_init(&this->finish) != thrd_success
+	    || thrd_create(&this->worker, snapshot_worker, this)
+	       != thrd_success)
+		goto thrd_fail;
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+thrd_fail:
+	printf("Thread creation failed!");
+	exit(1);
+}
+
+static void snapshot_free(Snapshot *this)
+{
+	mtx_lock(&this->lock);
+	this->stop = true;
+	cnd_signal(&this->arrive);
+	mtx_unlock(&this->lock);
+	thrd_join(this->worker, NULL);
+
+	mtx_destroy(&this->lock);
+	cnd_destroy(&this->arrive);
+	cnd_destroy(&this->finish);
+	free(this->path);
+	free(this->header);
+	free(this->buf[0]);
+	free(this->buf[1]);
+	free(this);
+}
+
+static void snapshot_take(Snapshot *this, size_t step)
+{
+	double start = timer_now();
+	mtx_lock(&this->lock);
+	int index = this->writing == 0 ? 1 : 0;
+	if (this->pending >= 0)
+		this->drop_num++;
+	memcpy(this->buf[index], this->net->param,
+	       sizeof(float) * this->net->param_size);
+	this->step[index] = step;
+	this->pending = index;
+	cnd_signal(&this->arrive);
+
+	double time = timer_now() - start;
+	this->take_num++;
+	this->take_time += time;
+	if (time > this->take_max)
+		this->take_max = time;
+	mtx_unlock(&this->lock);
+}
+
+static void snapshot_flush(Snapshot *this)
+{
+	mtx_lock(&this->lock);
+	while (this->pending >= 0 || this->writing >= 0)
+		cnd_wait(&this->finish, &this->lock);
+	mtx_unlock(&this->lock);
+}
+
+static void snapshot_print(Snapshot *this)
+{
+	mtx_lock(&this->lock);
+	printf("Snapshots: %zu taken, %zu written, %zu dropped, %zu failed\n",
+	       this->take_num, this->write_num, this->drop_num, this->fail_num);
+	printf("Take: %.3f ms avg, %.3f ms max\n",
+	       this->take_num ? this->take_time / this->take_num * 1e3 : 0.0,
+	       this->take_max * 1e3);
+	printf("Write: %.3f ms avg, %.3f ms max, %zu bytes total\n",
+	       this->write_num ? this->write_time / this->write_num * 1e3 : 0.0,
+	       this->write_max * 1e3, this->bytes);
+	mtx_unlock(&this->lock);
+}
+
+bool snapshot_restore(MLPNet *net, char *path, size_t *step)
+{
+	SnapshotFile *file = read_file(path);
+	if (!file)
+		return false;
+	bool match = file->header.layer_num == net->size
+	             && file->header.param_size == net->param_size;
+	for (size_t i = 0; match && i < net->size; i++)
+		match = match_layer(net->layer[i], file->layer + i);
+	if (match) {
+		memcpy(net->param, file->param, sizeof(float) * net->param_size);
+		if (step)
+			*step = file->step;
+	}
+	snapshot_file_free(file);
+	return match;
+}
+
+MLPNet *snapshot_load(char *path, float (*lossf)(Vector*, Vector*),
+                      Vector *(*dlossf)(Vector*, Vector*), size_t *step)
+{
+	SnapshotFile *file = read_file(path);
+	if (!file)
+		return NULL;
+	size_t size = file->header.layer_num;
+	if (!valid_layers(file)) {
+		snapshot_file_free(file);
+		return NULL;
+	}
+
+	FCLayer **layer = (FCLayer**)calloc(size, sizeof(FCLayer*));
+	if (!layer)
+		goto fail;
+	for (size_t i = 0; i < size; i++) {
+		LayerRecord *record = file->layer + i;
+		float (*actf)(float);
+		float (*dactf)(float);
+		actf_get(record->actf, &actf, &dactf);
+		layer[i] = new_fc_layer(record->size, record->next_size, NULL, NULL,
+		                        actf, dactf);
+		if (record->runnorm)
+			layer[i]->runnorm(layer[i]);
+		layer[i]->dropout = record->dropout;
+	}
+	MLPNet *net = new_mlp_net(size, layer, lossf, dlossf);
+	for (size_t i = 0; i < size; i++)
+		layer[i]->free(layer[i]);
+	free(layer);
+
+	if (net->param_size != file->header.param_size) {
+		net->free(net);
+		net = NULL;
+	} else {
+		memcpy(net->param, file->param, sizeof(float) * net->param_size);
+		if (step)
+			*step = file->step;
+	}
+	snapshot_file_free(file);
+	return net;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  写出线程，依次写出等待中的快照
+ * @param  arg `[INOUT]``Snapshot`指针
+ * @return `0`
+ */
+static int snapshot_worker(void *arg)
+{
+	Snapshot *this = (Snapshot*)arg;
+
+	mtx_lock(&this->lock);
+	for (;;) {
+		while (this->pending < 0 && !this->stop)
+			cnd_wait(&this->arrive, &this->lock);
+		if (this->pending < 0)
+			break;
+		int index = this->pending;
+		this->writing = index;
+		this->pending = -1;
+		mtx_unlock(&this->lock);
+
+		double start = timer_now();
+		size_t bytes = write_file(this, this->buf[index], this->step[index]);
+		double time = timer_now() - start;
+
+		mtx_lock(&this->lock);
+		this->writing = -1;
+		if (bytes) {
+			this->write_num++;
+			this->last_step = this->step[index];
+			this->bytes += bytes;
+			this->write_time += time;
+			if (time > this->write_max)
+				this->write_max = time;
+		} else {
+			this->fail_num++;
+		}
+		cnd_broadcast(&this->finish);
+	}
+	mtx_unlock(&this->lock);
+	return 0;
+}
+
+/**
+ * @brief  写出一个快照
+ *
+ * 先写入临时文件并刷盘，再改名为目标文件，中途崩溃不会留下不完整的快照。
+ * 在 Unix 上改名后还会刷新所在目录，以免改名本身丢失。
+ *
+ * @param  this  `[IN]``Snapshot`
+ * @param  param `[IN]`参数
+ * @param  step  步数
+ * @return 写出的字节数；失败时返回`0`
+ */
+static size_t write_file(Snapshot *this, float *param, size_t step)
+{
+	char *tmp = (char*)malloc(strlen(this->path) + 5);
+	if (!tmp)
+		goto fail;
+	sprintf(tmp, "%s.tmp", this->path);
+
+	uint64_t this_step = step;
+	size_t param_bytes = sizeof(float) * this->net->param_size;
+	uint64_t sum = checksum(0xcbf29ce484222325ULL, this->header,
+	                        this->header_size);
+	sum = checksum(sum, &this_step, sizeof(uint64_t));
+	sum = checksum(sum, param, param_bytes);
+
+	FILE *file = fopen(tmp, "wb");
+	if (!file)
+		goto io_fail;
+	bool ok = fwrite(this->header, 1, this->header_size, file)
+	          == this->header_size
+	          && fwrite(&this_step, sizeof(uint64_t), 1, file) == 1
+	          && fwrite(param, 1, param_bytes, file) == param_bytes
+	          && fwrite(&sum, sizeof(uint64_t), 1, file) == 1
+	          && fflush(file) == 0;
+#ifdef __unix__
+	ok = ok && fsync(fileno(file)) == 0;
+#endif
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		goto io_fail;
+#ifndef __unix__
+	remove(this->path);  /* 非 POSIX 的`rename`不覆盖已有文件 */
+#endif
+	if (rename(tmp, this->path))
+		goto io_fail;
+#ifdef __unix__
+	char *dir = tmp;
+	strcpy(dir, this->path);
+	char *slash = strrchr(dir, '/');
+	if (slash == dir)
+		slash[1] = '\0';
+	else if (slash)
+		*slash = '\0';
+	else
+		strcpy(dir, ".");
+	int fd = open(dir, O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+#endif
+	free(tmp);
+	return this->header_size + 2 * sizeof(uint64_t) + param_bytes;
+io_fail:
+	remove(tmp);
+	free(tmp);
+	return 0;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief  读入快照并校验
+ * @param  path 快照路径
+ * @return `[OWN]`快照；文件不存在、格式不符或校验失败时返回`NULL`
+ */
+static SnapshotFile *read_file(char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	SnapshotFile *this = (SnapshotFile*)calloc(1, sizeof(SnapshotFile));
+	if (!this)
+		goto fail;
+	if (fread(&this->header, sizeof(FileHeader), 1, file) != 1
+	    || memcmp(this->header.magic, SNAPSHOT_MAGIC, 4)
+	    || this->header.version != SNAPSHOT_VERSION)
+		goto format_fail;
+
+	/* 先确认文件长度，以免按损坏的文件头分配过多内存，先比较再相乘防溢出 */
+	if (fseek(file, 0, SEEK_END))
+		goto format_fail;
+	long length = ftell(file);
+	uint64_t layer_num = this->header.layer_num;
+	uint64_t param_size = this->header.param_size;
+	if (length < 0 || layer_num > (uint64_t)length / sizeof(LayerRecord)
+	    || param_size > (uint64_t)length / sizeof(float)
+	    || (uint64_t)length != sizeof(FileHeader)
+	                          + sizeof(LayerRecord) * layer_num
+	                          + 2 * sizeof(uint64_t)
+	                          + sizeof(float) * param_size
+	    || fseek(file, sizeof(FileHeader), SEEK_SET))
+		goto format_fail;
+
+	this->layer = (LayerRecord*)malloc(sizeof(LayerRecord)
+	                                   * (layer_num + 1));
+	this->param = (float*)malloc(sizeof(float) * (param_size + 1));
+	if (!this->layer || !this->param)
+		goto fail;
+	uint64_t sum;
+	if (fread(this->layer, sizeof(LayerRecord), layer_num, file) != layer_num
+	    || fread(&this->step, sizeof(uint64_t), 1, file) != 1
+	    || fread(this->param, sizeof(float), param_size, file) != param_size
+	    || fread(&sum, sizeof(uint64_t), 1, file) != 1)
+		goto format_fail;
+	uint64_t expect_sum = checksum(0xcbf29ce484222325ULL, &this->header,
+	                               sizeof(FileHeader));
+	expect_sum = checksum(expect_sum, this->layer,
+	                      sizeof(LayerRecord) * layer_num);
+	expect_sum = checksum(expect_sum, &this->step, sizeof(uint64_t));
+	expect_sum = checksum(expect_sum, this->param,
+	                      sizeof(float) * param_size);
+	if (sum != expect_sum)
+		goto format_fail;
+	fclose(file);
+	return this;
+format_fail:
+	fclose(file);
+	snapshot_file_free(this);
+	return NULL;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 销毁读入的快照
+ * @param file `[IN]`快照
+ */
+static void snapshot_file_free(SnapshotFile *file)
+{
+	free(file->layer);
+	free(file->param);
+	free(file);
+}
+
+/**
+ * @brief  检查快照中的各层能否重建为全连接网络
+ *
+ * 各层的参数数量须与其大小相符、合计须等于文件头中的参数总数，
+ * 这样按描述创建的层不会超出文件本身的大小。
+ *
+ * @param  file `[IN]`快照
+ * @return 能重建返回`true`；否则，返回`false`
+ */
+static bool valid_layers(SnapshotFile *file)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < file->header.layer_num; i++) {
+		LayerRecord *record = file->layer + i;
+		uint64_t size = record->size;
+		uint64_t next_size = record->next_size;
+		if (!record->dense || record->actf < 0
+		    || record->actf >= ACTF_NUM
+		    || (record->runnorm != 0 && record->runnorm != 1)
+		    || !(record->dropout >= 0.0 && record->dropout < 1.0)
+		    || size == 0 || next_size == 0
+		    || (i > 0 && size != file->layer[i - 1].next_size))
+			return false;
+		/* 参数数量为`(size + 1) * next_size`，滑动归一化另加 4 倍 */
+		uint64_t width = size + 1 + (record->runnorm ? 4 : 0);
+		if (width < size || next_size > record->param_size / width
+		    || width * next_size != record->param_size
+		    || record->param_size > file->header.param_size - total)
+			return false;
+		total += record->param_size;
+	}
+	return file->header.layer_num > 0 && total == file->header.param_size;
+}
+
+/**
+ * @brief  判断层与快照中的描述是否一致
+ * @param  layer  `[IN]`层
+ * @param  record `[IN]`描述
+ * @return 一致返回`true`；否则，返回`false`
+ */
+static bool match_layer(Layer *layer, LayerRecord *record)
+{
+	return record->size == layer->size
+	       && record->next_size == layer->next_size
+	       && record->param_size == layer->param_size
+	       && record->dense == (layer->fc != NULL)
+	       && record->runnorm == (layer->fc && layer->fc->gamma);
+}
+
+/**
+ * @brief  FNV-1a 散列
+ * @param  hash 初值，可为上一段数据的散列
+ * @param  data `[IN]`数据
+ * @param  size 字节数
+ * @return 散列值
+ */
+static uint64_t checksum(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,107 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <threads.h>
+#include "vector.h"
+#include "mlp.h"
+
+typedef struct Snapshot Snapshot;
+
+/***** Snapshot *****/
+
+/*
+ * 异步快照。
+ *
+ * `take`只在锁内将`MLPNet::param`拷入两块缓冲区中空闲的一块，
+ * 由后台线程写入临时文件、刷盘后再改名为目标文件，训练不必等待磁盘。
+ * 写出较慢时，尚未开始写出的旧快照会被新快照覆盖。
+ *
+ * 文件依次为文件头、各层描述、步数、参数与校验和，均按本机字节序存储，
+ * 校验和覆盖之前的全部内容。
+ */
+struct Snapshot {
+	MLPNet *net;      /* 网络 */
+	char *path;       /* 目标路径 */
+	void *header;     /* 文件头与各层描述，创建时生成 */
+	size_t header_size;  /* 文件头与各层描述的字节数 */
+	float *buf[2];    /* 参数缓冲区 */
+	size_t step[2];   /* 各缓冲区对应的步数 */
+	int writing;      /* 正在写出的缓冲区，没有时为`-1` */
+	int pending;      /* 等待写出的缓冲区，没有时为`-1` */
+	bool stop;        /* 是否停止 */
+	mtx_t lock;       /* 缓冲区与统计量的锁 */
+	cnd_t arrive;     /* 新快照到达 */
+	cnd_t finish;     /* 一次写出完成 */
+	thrd_t worker;    /* 写出线程 */
+
+	size_t take_num;    /* 拍下快照的次数 */
+	size_t write_num;   /* 成功写出的次数 */
+	size_t drop_num;    /* 写出前被覆盖的次数 */
+	size_t fail_num;    /* 写出失败的次数 */
+	size_t last_step;   /* 最近一次成功写出的快照的步数 */
+	size_t bytes;       /* 累计写出的字节数 */
+	double take_time;   /* `take`累计耗时（秒），即训练的停顿 */
+	double take_max;    /* `take`单次最大耗时（秒） */
+	double write_time;  /* 写出累计耗时（秒），含刷盘与改名 */
+	double write_max;   /* 写出单次最大耗时（秒） */
+
+	/**
+	 * @brief 写出尚未写出的快照，停止写出线程并销毁`Snapshot`，不销毁`net`
+	 */
+	void (*free)(Snapshot *this);
+
+	/**
+	 * @brief 拍下快照，须在两次`update`之间调用
+	 * @param step 步数，随快照写出
+	 */
+	void (*take)(Snapshot *this, size_t step);
+
+	/**
+	 * @brief 等待已拍下的快照全部写出
+	 */
+	void (*flush)(Snapshot *this);
+
+	/**
+	 * @brief 打印统计量
+	 */
+	void (*print)(Snapshot *this);
+};
+
+/**
+ * @brief  创建`Snapshot`
+ * @param  net  `[IN]`网络，须在`Snapshot`销毁后再销毁
+ * @param  path 目标路径，临时文件为其后加`.tmp`
+ * @return `[OWN]``Snapshot`指针
+ */
+Snapshot *new_snapshot(MLPNet *net, char *path);
+
+/**
+ * @brief  从快照恢复参数
+ *
+ * 网络的结构须与快照一致，支持任意种类的层。
+ *
+ * @param  net  `[INOUT]`网络
+ * @param  path 快照路径
+ * @param  step `[OUT]`快照的步数，传入`NULL`以忽略
+ * @return 成功返回`true`；文件损坏或结构不一致时返回`false`，不修改网络
+ */
+bool snapshot_restore(MLPNet *net, char *path, size_t *step);
+
+/**
+ * @brief  由快照创建网络
+ *
+ * 仅支持全部由全连接层组成且激活函数均来自`actf.h`的网络。
+ * 创建各层前先检查描述与参数总数是否相符，损坏的文件不会导致过量分配。
+ *
+ * @param  path   快照路径
+ * @param  lossf  损失函数
+ * @param  dlossf 损失函数的导函数
+ * @param  step   `[OUT]`快照的步数，传入`NULL`以忽略
+ * @return `[OWN]``MLPNet`指针；失败时返回`NULL`
+ */
+MLPNet *snapshot_load(char *path, float (*lossf)(Vector*, Vector*),
+                      Vector *(*dlossf)(Vector*, Vector*), size_t *step);
+
+#endif  /* SNAPSHOT_H_ */
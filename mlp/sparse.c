@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "vector.h"
+#include "matrix.h"
+#include "mlp.h"
+#include "pool.h"
+#include "sparse.h"
+
+/* 补齐的粒度，为各格式块行数与块列数的公倍数 */
+#define SPARSE_PAD 8
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+float mlp_prune(MLPNet *net, float sparsity, SparseFormat format);
+SparseNet *new_sparse_net(MLPNet *net, SparseFormat format);
+static void sparse_net_free(SparseNet *this);
+static void sparse_net_predict_batch(SparseNet *this, Vector **input,
+                                     size_t num, size_t *res, Vector **prob);
+static size_t sparse_net_bytes(SparseNet *this);
+
+/*** 内部 ***/
+
+/* 剪枝时的块 */
+typedef struct {
+	float score;   /* 平方和 */
+	size_t index;  /* 块序号，按行优先 */
+} PruneBlock;
+
+/* 稀疏前向传播任务的参数 */
+typedef struct {
+	SparseLayer *layer;  /* 网络层 */
+	const float *input;  /* 输入，按节点存储，每个节点`num`个值 */
+	float *output;       /* 输出，按节点存储 */
+	size_t num;          /* 输入数量 */
+} SparseTask;
+
+static bool format_block(SparseFormat format, size_t *row, size_t *col);
+static size_t pad(size_t size);
+static int prune_block_cmp(const void *a, const void *b);
+static void sparse_layer_init(SparseLayer *this, FCLayer *fc,
+                              size_t R, size_t C);
+static void sparse_forward(SparseLayer *layer, const float *input,
+                           float *output, size_t num);
+static void sparse_rows(void *arg, size_t begin, size_t end);
+static inline void bsr_rows(SparseTask *task, size_t begin, size_t end,
+                            size_t R, size_t C);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+float mlp_prune(MLPNet *net, float sparsity, SparseFormat format)
+{
+	size_t R, C;
+	if (!format_block(format, &R, &C))
+		return 0.0;
+	size_t total = 0;
+	size_t zero = 0;
+	for (size_t i = 0; i < net->size; i++) {
+		FCLayer *fc = net->layer[i]->fc;
+		if (!fc)
+			continue;
+		size_t block_rows = (fc->next_size + R - 1) / R;
+		size_t block_cols = (fc->size + C - 1) / C;
+		size_t num = block_rows * block_cols;
+		PruneBlock *block = (PruneBlock*)malloc(sizeof(PruneBlock)
+		                                        * (num ? num : 1));
+		if (!block)
+			goto fail;
+		for (size_t b = 0; b < num; b++) {
+			size_t br = b / block_cols;
+			size_t bc = b % block_cols;
+			float score = 0.0;
+			for (size_t c = bc * C; c < (bc + 1) * C && c < fc->size; c++)
+				for (size_t r = br * R; r < (br + 1) * R
+				     && r < fc->next_size; r++)
+					score += fc->weight->val[c]->val[r]
+					         * fc->weight->val[c]->val[r];
+			block[b] = (PruneBlock) {.score = score, .index = b};
+		}
+		qsort(block, num, sizeof(PruneBlock), prune_block_cmp);
+
+		size_t count = fc->size * fc->next_size;
+		size_t target = (size_t)(sparsity * count + 0.5);
+		size_t pruned = 0;
+		for (size_t b = 0; b < num && pruned < target; b++) {
+			size_t br = block[b].index / block_cols;
+			size_t bc = block[b].index % block_cols;
+			for (size_t c = bc * C; c < (bc + 1) * C && c < fc->size; c++) {
+				for (size_t r = br * R; r < (br + 1) * R
+				     && r < fc->next_size; r++) {
+					fc->weight->val[c]->val[r] = 0.0;
+					pruned++;
+				}
+			}
+		}
+		free(block);
+
+		total += count;
+		for (size_t c = 0; c < fc->size; c++)
+			for (size_t r = 0; r < fc->next_size; r++)
+				zero += fc->weight->val[c]->val[r] == 0.0;
+	}
+	return total ? (float)zero / total : 0.0;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+SparseNet *new_sparse_net(MLPNet *net, SparseFormat format)
+{
+	size_t R, C;
+	if (!format_block(format, &R, &C))
+		return NULL;
+	for (size_t i = 0; i < net->size; i++)
+		if (!net->layer[i]->fc)
+			return NULL;
+	for (size_t i = 0; i < net->size; i++) {
+		if (net->layer[i]->fc->gamma) {
+			MLPNet *folded = net->fold(net);
+			SparseNet *res = new_sparse_net(folded, format);
+			folded->free(folded);
+			return res;
+		}
+	}
+
+	SparseLayer *this_layer = (SparseLayer*)calloc(net->size,
+	                                               sizeof(SparseLayer));
+	if (!this_layer)
+		goto fail;
+	size_t this_width = 0;
+	for (size_t i = 0; i < net->size; i++) {
+		FCLayer *fc = net->layer[i]->fc;
+		sparse_layer_init(this_layer + i, fc, R, C);
+		if (pad(fc->size) > this_width)
+			this_width = pad(fc->size);
+		if (pad(fc->next_size) > this_width)
+			this_width = pad(fc->next_size);
+	}
+
+	SparseNet *this = (SparseNet*)malloc(sizeof(SparseNet));
+	if (!this)
+		goto fail;
+	*this = (SparseNet) {
+		.size = net->size,
+		.layer = this_layer,
+		.format = format,
+		.width = this_width,
+
+		.free = sparse_net_free,
+		.predict_batch = sparse_net_predict_batch,
+		.bytes = sparse_net_bytes,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void sparse_net_free(SparseNet *this)
+{
+	for (size_t i = 0; i < this->size; i++) {
+		free(this->layer[i].row_ptr);
+		free(this->layer[i].col);
+		free(this->layer[i].val);
+		free(this->layer[i].bias);
+	}
+	free(this->layer);
+	free(this);
+}
+
+static void sparse_net_predict_batch(SparseNet *this, Vector **input,
+                                     size_t num, size_t *res, Vector **prob)
+{
+	if (!num)
+		return;
+	size_t block = num < MLP_BATCH_BLOCK ? num : MLP_BATCH_BLOCK;
+	SparseLayer *first = this->layer;
+	SparseLayer *last = this->layer + this->size - 1;
+	float *buf_in = (float*)malloc(sizeof(float) * block * this->width);
+	float *buf_out = (float*)malloc(sizeof(float) * block * this->width);
+	float *out = (float*)malloc(sizeof(float) * last->next_size);
+	if (!buf_in || !buf_out || !out)
+		goto fail;
+
+	for (size_t begin = 0; begin < num; begin += block) {
+		size_t n = num - begin < block ? num - begin : block;
+		for (size_t c = 0; c < pad(first->size); c++)
+			for (size_t k = 0; k < n; k++)
+				buf_in[c * n + k] = c < first->size
+				                    ? input[begin + k]->val[c] : 0.0;
+		for (size_t i = 0; i < this->size; i++) {
+			sparse_forward(this->layer + i, buf_in, buf_out, n);
+			float *tmp = buf_in;
+			buf_in = buf_out;
+			buf_out = tmp;
+		}
+
+		for (size_t k = 0; k < n; k++) {
+			size_t max_index = 0;
+			for (size_t j = 0; j < last->next_size; j++) {
+				out[j] = buf_in[j * n + k];
+				if (out[j] > out[max_index])
+					max_index = j;
+			}
+			res[begin + k] = max_index;
+			if (prob && prob[begin + k])
+				prob[begin + k]->set(prob[begin + k], last->next_size, out);
+		}
+	}
+	free(buf_in);
+	free(buf_out);
+	free(out);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static size_t sparse_net_bytes(SparseNet *this)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < this->size; i++) {
+		SparseLayer *layer = this->layer + i;
+		size_t block_rows = (layer->next_size + layer->block_row - 1)
+		                    / layer->block_row;
+		bytes += sizeof(uint32_t) * (block_rows + 1 + layer->block_num);
+		bytes += sizeof(float) * layer->block_num * layer->block_row
+		         * layer->block_col;
+		bytes += sizeof(float) * layer->next_size;
+	}
+	return bytes;
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  获取稀疏格式的块形状
+ * @param  format 稀疏格式
+ * @param  row    `[OUT]`块的行数
+ * @param  col    `[OUT]`块的列数
+ * @return 是否为已知的格式；未知时不写入`row`与`col`
+ */
+static bool format_block(SparseFormat format, size_t *row, size_t *col)
+{
+	switch (format) {
+	case SPARSE_CSR:
+		*row = 1;
+		*col = 1;
+		return true;
+	case SPARSE_BSR_4X4:
+		*row = 4;
+		*col = 4;
+		return true;
+	case SPARSE_BSR_8X1:
+		*row = 8;
+		*col = 1;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief  补齐到`SPARSE_PAD`的倍数
+ * @param  size 大小
+ * @return 补齐后的大小
+ */
+static size_t pad(size_t size)
+{
+	return (size + SPARSE_PAD - 1) / SPARSE_PAD * SPARSE_PAD;
+}
+
+/**
+ * @brief  按平方和从小到大比较两个块，相同时按序号
+ * @param  a `[IN]``PruneBlock`
+ * @param  b `[IN]``PruneBlock`
+ * @return 比较结果
+ */
+static int prune_block_cmp(const void *a, const void *b)
+{
+	const PruneBlock *x = (const PruneBlock*)a;
+	const PruneBlock *y = (const PruneBlock*)b;
+	if (x->score != y->score)
+		return x->score < y->score ? -1 : 1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * @brief 由全连接层生成稀疏层，只保存含非零权重的块
+ * @param this   `[OUT]`稀疏层
+ * @param fc     `[IN]`全连接层
+ * @param R      块的行数
+ * @param C      块的列数
+ */
+static void sparse_layer_init(SparseLayer *this, FCLayer *fc,
+                              size_t R, size_t C)
+{
+	size_t block_rows = (fc->next_size + R - 1) / R;
+	size_t block_cols = (fc->size + C - 1) / C;
+	uint32_t *row_ptr = (uint32_t*)calloc(block_rows + 1, sizeof(uint32_t));
+	float *bias = (float*)malloc(sizeof(float) * (fc->next_size + 1));
+	if (!row_ptr || !bias)
+		goto fail;
+	memcpy(bias, fc->bias->val, sizeof(float) * fc->next_size);
+
+	/***** 统计非零块 *****/
+	size_t block_num = 0;
+	for (size_t br = 0; br < block_rows; br++) {
+		for (size_t bc = 0; bc < block_cols; bc++) {
+			bool nonzero = false;
+			for (size_t c = bc * C; c < (bc + 1) * C && c < fc->size; c++)
+				for (size_t r = br * R; r < (br + 1) * R
+				     && r < fc->next_size; r++)
+					nonzero |= fc->weight->val[c]->val[r] != 0.0;
+			block_num += nonzero;
+		}
+		row_ptr[br + 1] = block_num;
+	}
+
+	/***** 填充 *****/
+	uint32_t *col = (uint32_t*)malloc(sizeof(uint32_t) * (block_num + 1));
+	float *val = (float*)calloc(block_num * R * C + 1, sizeof(float));
+	if (!col || !val)
+		goto fail;
+	size_t p = 0;
+	for (size_t br = 0; br < block_rows; br++) {
+		for (size_t bc = 0; bc < block_cols; bc++) {
+			if (p == row_ptr[br + 1])
+				break;
+			bool nonzero = false;
+			for (size_t c = bc * C; c < (bc + 1) * C && c < fc->size; c++)
+				for (size_t r = br * R; r < (br + 1) * R
+				     && r < fc->next_size; r++)
+					nonzero |= fc->weight->val[c]->val[r] != 0.0;
+			if (!nonzero)
+				continue;
+			col[p] = bc;
+			for (size_t c = bc * C; c < (bc + 1) * C && c < fc->size; c++)
+				for (size_t r = br * R; r < (br + 1) * R
+				     && r < fc->next_size; r++)
+					val[p * R * C + (r - br * R) * C + (c - bc * C)]
+						= fc->weight->val[c]->val[r];
+			p++;
+		}
+	}
+
+	*this = (SparseLayer) {
+		.size = fc->size,
+		.next_size = fc->next_size,
+		.block_row = R,
+		.block_col = C,
+		.block_num = block_num,
+		.row_ptr = row_ptr,
+		.col = col,
+		.val = val,
+		.bias = bias,
+		.actf = fc->actf,
+	};
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 前向传播一层
+ *
+ * 输入与输出均按节点存储，补齐到`SPARSE_PAD`的倍数，补齐的部分为`0`。
+ *
+ * @param layer  `[IN]`稀疏层
+ * @param input  `[IN]`输入
+ * @param output `[OUT]`输出
+ * @param num    输入数量
+ */
+static void sparse_forward(SparseLayer *layer, const float *input,
+                           float *output, size_t num)
+{
+	SparseTask task = {
+		.layer = layer,
+		.input = input,
+		.output = output,
+		.num = num,
+	};
+	size_t block_rows = (layer->next_size + layer->block_row - 1)
+	                    / layer->block_row;
+	size_t cost = block_rows ? layer->block_num * layer->block_row
+	                           * layer->block_col * num / block_rows : 0;
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, block_rows, pool_grain(cost + num),
+	                   sparse_rows, &task);
+	size_t written = block_rows * layer->block_row;
+	memset(output + written * num, 0,
+	       sizeof(float) * (pad(layer->next_size) - written) * num);
+}
+
+/**
+ * @brief 前向传播第`[begin, end)`个块行，按块形状分派以便编译器展开
+ * @param arg   `[INOUT]``SparseTask`
+ * @param begin 起始块行
+ * @param end   终止块行（不含）
+ */
+static void sparse_rows(void *arg, size_t begin, size_t end)
+{
+	SparseTask *task = (SparseTask*)arg;
+	size_t R = task->layer->block_row;
+	size_t C = task->layer->block_col;
+	if (R == 1 && C == 1)
+		bsr_rows(task, begin, end, 1, 1);
+	else if (R == 4 && C == 4)
+		bsr_rows(task, begin, end, 4, 4);
+	else
+		bsr_rows(task, begin, end, 8, 1);
+}
+
+/**
+ * @brief 块稀疏矩阵与按节点存储的一批输入相乘，再加偏置并激活
+ *
+ * 块内每个权重在整批输入上复用，最内层循环连续访问内存。
+ * 超出`next_size`的行输出`0`。
+ *
+ * @param task  `[INOUT]`任务
+ * @param begin 起始块行
+ * @param end   终止块行（不含）
+ * @param R     块的行数
+ * @param C     块的列数
+ */
+static inline void bsr_rows(SparseTask *task, size_t begin, size_t end,
+                            size_t R, size_t C)
+{
+	SparseLayer *layer = task->layer;
+	size_t n = task->num;
+	for (size_t br = begin; br < end; br++) {
+		float *y = task->output + br * R * n;
+		for (size_t r = 0; r < R; r++) {
+			size_t row = br * R + r;
+			float b = row < layer->next_size ? layer->bias[row] : 0.0;
+			for (size_t k = 0; k < n; k++)
+				y[r * n + k] = b;
+		}
+		for (uint32_t p = layer->row_ptr[br]; p < layer->row_ptr[br + 1];
+		     p++) {
+			const float *v = layer->val + (size_t)p * R * C;
+			const float *x = task->input + (size_t)layer->col[p] * C * n;
+			for (size_t r = 0; r < R; r++) {
+				float *restrict yr = y + r * n;
+				for (size_t c = 0; c < C; c++) {
+					float w = v[r * C + c];
+					const float *restrict xc = x + c * n;
+					for (size_t k = 0; k < n; k++)
+						yr[k] += w * xc[k];
+				}
+			}
+		}
+		for (size_t r = 0; r < R; r++) {
+			float *yr = y + r * n;
+			if (br * R + r < layer->next_size)
+				for (size_t k = 0; k < n; k++)
+					yr[k] = layer->actf(yr[k]);
+			else
+				memset(yr, 0, sizeof(float) * n);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef SPARSE_H_
+#define SPARSE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vector.h"
+#include "mlp.h"
+
+typedef enum SparseFormat SparseFormat;
+typedef struct SparseLayer SparseLayer;
+typedef struct SparseNet SparseNet;
+
+/*
+ * 剪枝与稀疏推理。
+ *
+ * 先用`mlp_prune`将训练好的网络按权重大小剪枝，再由`new_sparse_net`
+ * 转换为只保存非零块的推理网络，例如：
+ *
+ *	MLPNet *pruned = net->fold(net);
+ *	mlp_prune(pruned, 0.8, SPARSE_BSR_8X1);
+ *	SparseNet *sparse = new_sparse_net(pruned, SPARSE_BSR_8X1);
+ *	sparse->predict_batch(sparse, input, num, res, NULL);
+ *
+ * 仅支持全部由全连接层组成的网络。
+ */
+
+/***** SparseFormat *****/
+
+/* 稀疏格式，块为“行 x 列”，行对应输出节点 */
+enum SparseFormat {
+	SPARSE_CSR,      /* 按行压缩，即 1x1 块 */
+	SPARSE_BSR_4X4,  /* 4x4 块 */
+	SPARSE_BSR_8X1,  /* 8x1 块，同一输入连续作用于相邻 8 个输出 */
+};
+
+/***** SparseLayer *****/
+
+struct SparseLayer {
+	size_t size;         /* 输入大小 */
+	size_t next_size;    /* 输出大小 */
+	size_t block_row;    /* 块的行数 */
+	size_t block_col;    /* 块的列数 */
+	size_t block_num;    /* 非零块数 */
+	uint32_t *row_ptr;   /* 各块行首个块的序号，共`块行数 + 1`个 */
+	uint32_t *col;       /* 各块的块列号 */
+	float *val;          /* 各块的值，块内按行存储 */
+	float *bias;         /* 偏置 */
+	float (*actf)(float x);  /* 激活函数 */
+};
+
+/***** SparseNet *****/
+
+struct SparseNet {
+	size_t size;          /* 层数 */
+	SparseLayer *layer;   /* 层 */
+	SparseFormat format;  /* 稀疏格式 */
+	size_t width;         /* 补齐后各层输入与输出大小的最大值 */
+
+	/**
+	 * @brief 销毁`SparseNet`
+	 */
+	void (*free)(SparseNet *this);
+
+	/**
+	 * @brief 批量推理，用法与`MLPNet::predict_batch`相同
+	 *
+	 * 每批输入转置为按节点存储，每个非零权重在整批输入上复用。
+	 * 可并发调用。
+	 *
+	 * @param input `[IN]`输入数组
+	 * @param num   输入数量，为`0`时不做任何事
+	 * @param res   `[OUT]`各输入的最大输出下标
+	 * @param prob  `[OUT]`各输入的输出层，传入`NULL`或元素为`NULL`以忽略
+	 */
+	void (*predict_batch)(SparseNet *this, Vector **input, size_t num,
+	                      size_t *res, Vector **prob);
+
+	/**
+	 * @brief  获取权重与偏置占用的内存，含索引
+	 * @return 字节数
+	 */
+	size_t (*bytes)(SparseNet *this);
+};
+
+/**
+ * @brief  按权重大小剪枝
+ *
+ * 各全连接层分别将权重按块分组（块的形状同`format`），依平方和从小到大
+ * 置零，直到置零的权重不少于该层的`sparsity`。
+ * 之后若继续训练，被置零的权重会重新变为非零。
+ *
+ * @param  net      `[INOUT]`网络
+ * @param  sparsity 目标稀疏度，取值于`[0, 1]`
+ * @param  format   剪枝的粒度
+ * @return 剪枝后全连接层权重中`0`的比例；`format`未知时返回`0`，不剪枝
+ */
+float mlp_prune(MLPNet *net, float sparsity, SparseFormat format);
+
+/**
+ * @brief  创建`SparseNet`
+ *
+ * 滑动归一化先经`fold`折叠，只保存含非零权重的块。
+ *
+ * @param  net    `[IN]`网络
+ * @param  format 稀疏格式
+ * @return `[OWN]``SparseNet`指针；含非全连接层或`format`未知时返回`NULL`
+ */
+SparseNet *new_sparse_net(MLPNet *net, SparseFormat format);
+
+#endif  /* SPARSE_H_ */
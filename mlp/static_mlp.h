@@ -0,0 +1,225 @@
+#ifndef STATIC_MLP_H_
+#define STATIC_MLP_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "rand.h"
+
+/*
+ * 编译期固定拓扑的网络。
+ *
+ * 层大小与激活函数均为编译期常量，生成的前向/反向传播没有函数指针，
+ * 循环边界均为常量，缓冲区全部位于结构体或栈上，可与`MLPNet`并用。
+ *
+ * 先用 X-macro 列出各层`L(x, 序号, 输入大小, 输出大小, 激活函数, 导函数)`，
+ * 序号须为从`0`开始连续的字面量，再用`STATIC_MLP`展开，例如：
+ *
+ *	#define MNIST_NET(L, x)                             \
+ *		L(x, 0, 784, 16, sigmoid, d_sigmoid)        \
+ *		L(x, 1, 16, 16, sigmoid, d_sigmoid)         \
+ *		L(x, 2, 16, 10, sigmoid, d_sigmoid)
+ *	STATIC_MLP(mnist, MNIST_NET, 3, d_mse)
+ *
+ * 将生成：
+ *	struct mnist_net   网络（参数与中间结果）
+ *	struct mnist_grad  梯度
+ *	void mnist_init_xavier(struct mnist_net *net);
+ *	const float *mnist_forward(struct mnist_net *net, const float *input);
+ *	void mnist_grad(struct mnist_net *net, const float *label,
+ *	                struct mnist_grad *grad);  累加到`grad`
+ *	void mnist_grad_clear(struct mnist_grad *grad);
+ *	void mnist_update(struct mnist_net *net, struct mnist_grad *grad,
+ *	                  float scalar);
+ *
+ * 其中损失函数的导函数形如`float dlossf(float out, float label)`。
+ * 权重按行存储，即`w<序号>[输出][输入]`。
+ */
+
+#define STATIC_MLP_MAX_DEPTH 16
+#define SMLP_LANE 8  /* 前向传播点积的累加路数 */
+
+/***** 工具宏 *****/
+
+#define SMLP_CAT_(a, b) a##b
+#define SMLP_CAT(a, b) SMLP_CAT_(a, b)
+
+/* 上一层的序号，第`0`层的上一层为`none` */
+#define SMLP_PREV_0 none
+#define SMLP_PREV_1 0
+#define SMLP_PREV_2 1
+#define SMLP_PREV_3 2
+#define SMLP_PREV_4 3
+#define SMLP_PREV_5 4
+#define SMLP_PREV_6 5
+#define SMLP_PREV_7 6
+#define SMLP_PREV_8 7
+#define SMLP_PREV_9 8
+#define SMLP_PREV_10 9
+#define SMLP_PREV_11 10
+#define SMLP_PREV_12 11
+#define SMLP_PREV_13 12
+#define SMLP_PREV_14 13
+#define SMLP_PREV_15 14
+#define SMLP_PREV_16 15
+#define SMLP_PREV(i) SMLP_CAT(SMLP_PREV_, i)
+
+/* 是否需要向上一层传递梯度 */
+#define SMLP_HAS_PREV(i) (SMLP_CAT(SMLP_HAS_PREV_, i))
+#define SMLP_HAS_PREV_0 0
+#define SMLP_HAS_PREV_1 1
+#define SMLP_HAS_PREV_2 1
+#define SMLP_HAS_PREV_3 1
+#define SMLP_HAS_PREV_4 1
+#define SMLP_HAS_PREV_5 1
+#define SMLP_HAS_PREV_6 1
+#define SMLP_HAS_PREV_7 1
+#define SMLP_HAS_PREV_8 1
+#define SMLP_HAS_PREV_9 1
+#define SMLP_HAS_PREV_10 1
+#define SMLP_HAS_PREV_11 1
+#define SMLP_HAS_PREV_12 1
+#define SMLP_HAS_PREV_13 1
+#define SMLP_HAS_PREV_14 1
+#define SMLP_HAS_PREV_15 1
+
+/***** 单层展开 *****/
+
+#define SMLP_NET_FIELDS(x, i, n_in, n_out, actf, dactf) \
+	float w##i[n_out][n_in];  /* 权重 */ \
+	float b##i[n_out];        /* 偏置 */ \
+	const float *in##i;       /* 输入 */ \
+	float pre##i[n_out];      /* 线性变换结果 */ \
+	float out##i[n_out];      /* 输出 */
+
+#define SMLP_GRAD_FIELDS(x, i, n_in, n_out, actf, dactf) \
+	float w##i[n_out][n_in]; \
+	float b##i[n_out];
+
+/* 点积分为`SMLP_LANE`路独立累加，无需重排浮点加法即可向量化 */
+#define SMLP_FORWARD_FUNC(x, i, n_in, n_out, actf, dactf) \
+static inline const float *x##_fwd_##i(struct x##_net *net, const float *input) \
+{ \
+	net->in##i = input; \
+	for (size_t r = 0; r < (n_out); r++) { \
+		float lane[SMLP_LANE] = {0}; \
+		size_t c = 0; \
+		for (; c + SMLP_LANE <= (n_in); c += SMLP_LANE) \
+			for (size_t l = 0; l < SMLP_LANE; l++) \
+				lane[l] += net->w##i[r][c + l] * input[c + l]; \
+		float sum = net->b##i[r]; \
+		for (; c < (n_in); c++) \
+			sum += net->w##i[r][c] * input[c]; \
+		for (size_t l = 0; l < SMLP_LANE; l++) \
+			sum += lane[l]; \
+		net->pre##i[r] = sum; \
+		net->out##i[r] = actf(sum); \
+	} \
+	return net->out##i; \
+}
+
+#define SMLP_BACKWARD_FUNC(x, i, n_in, n_out, actf, dactf) \
+static inline void x##_bwd_##i(struct x##_net *net, struct x##_grad *grad, \
+                               const float *out_grad) \
+{ \
+	float pre_grad[n_out]; \
+	for (size_t r = 0; r < (n_out); r++) { \
+		pre_grad[r] = out_grad[r] * dactf(net->pre##i[r]); \
+		grad->b##i[r] += pre_grad[r]; \
+		for (size_t c = 0; c < (n_in); c++) \
+			grad->w##i[r][c] += pre_grad[r] * net->in##i[c]; \
+	} \
+	if (SMLP_HAS_PREV(i)) { \
+		float node_grad[n_in]; \
+		memset(node_grad, 0, sizeof(node_grad)); \
+		for (size_t r = 0; r < (n_out); r++) \
+			for (size_t c = 0; c < (n_in); c++) \
+				node_grad[c] += net->w##i[r][c] * pre_grad[r]; \
+		SMLP_CAT(x##_bwd_, SMLP_PREV(i))(net, grad, node_grad); \
+	} \
+}
+
+#define SMLP_FORWARD_CALL(x, i, n_in, n_out, actf, dactf) \
+	input = x##_fwd_##i(net, input);
+
+#define SMLP_INIT_XAVIER(x, i, n_in, n_out, actf, dactf) \
+	{ \
+		float bound = sqrt(6.0 / ((n_in) + (n_out))); \
+		for (size_t r = 0; r < (n_out); r++) \
+			for (size_t c = 0; c < (n_in); c++) \
+				net->w##i[r][c] = rand_uniform(-bound, bound); \
+		memset(net->b##i, 0, sizeof(net->b##i)); \
+	}
+
+#define SMLP_UPDATE(x, i, n_in, n_out, actf, dactf) \
+	for (size_t r = 0; r < (n_out); r++) { \
+		net->b##i[r] -= scalar * grad->b##i[r]; \
+		for (size_t c = 0; c < (n_in); c++) \
+			net->w##i[r][c] -= scalar * grad->w##i[r][c]; \
+	}
+
+/***** 整体展开 *****/
+
+/**
+ * @brief 声明编译期固定拓扑的网络
+ * @param x      网络名，用作生成的类型与函数的前缀
+ * @param layers 层列表宏，形如`layers(L, x)`
+ * @param depth  层数，不超过`STATIC_MLP_MAX_DEPTH`
+ * @param dlossf 损失函数对单个输出的导函数
+ */
+#define STATIC_MLP(x, layers, depth, dlossf) \
+struct x##_net { \
+	layers(SMLP_NET_FIELDS, x) \
+}; \
+\
+struct x##_grad { \
+	layers(SMLP_GRAD_FIELDS, x) \
+}; \
+\
+layers(SMLP_FORWARD_FUNC, x) \
+\
+static inline void x##_bwd_none(struct x##_net *net, struct x##_grad *grad, \
+                                const float *out_grad) \
+{ \
+	(void)net; \
+	(void)grad; \
+	(void)out_grad; \
+} \
+\
+layers(SMLP_BACKWARD_FUNC, x) \
+\
+static inline void x##_init_xavier(struct x##_net *net) \
+{ \
+	layers(SMLP_INIT_XAVIER, x) \
+} \
+\
+static inline const float *x##_forward(struct x##_net *net, \
+                                       const float *input) \
+{ \
+	layers(SMLP_FORWARD_CALL, x) \
+	return input; \
+} \
+\
+static inline void x##_grad(struct x##_net *net, const float *label, \
+                            struct x##_grad *grad) \
+{ \
+	const float *out = net->SMLP_CAT(out, SMLP_PREV(depth)); \
+	float out_grad[sizeof(net->SMLP_CAT(out, SMLP_PREV(depth))) \
+	               / sizeof(float)]; \
+	for (size_t k = 0; k < sizeof(out_grad) / sizeof(float); k++) \
+		out_grad[k] = dlossf(out[k], label[k]); \
+	SMLP_CAT(x##_bwd_, SMLP_PREV(depth))(net, grad, out_grad); \
+} \
+\
+static inline void x##_grad_clear(struct x##_grad *grad) \
+{ \
+	memset(grad, 0, sizeof(*grad)); \
+} \
+\
+static inline void x##_update(struct x##_net *net, struct x##_grad *grad, \
+                              float scalar) \
+{ \
+	layers(SMLP_UPDATE, x) \
+}
+
+#endif  /* STATIC_MLP_H_ */
@@ -0,0 +1,16 @@
+#ifdef __unix__
+#define _POSIX_C_SOURCE 199309L  /* clock_gettime */
+#endif
+#include <time.h>
+#include "timer.h"
+
+double timer_now(void)
+{
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+	timespec_get(&ts, TIME_UTC);
+#endif
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,14 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+/**
+ * @brief  获取单调时钟的当前时间，用于计时
+ *
+ * 不受系统时间调整（如 NTP 校时）影响，两次调用之差不会为负。
+ * 没有单调时钟的平台退回到`timespec_get`。
+ *
+ * @return 自某一固定时刻起的秒数
+ */
+double timer_now(void);
+
+#endif  /* TIMER_H_ */
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "vector.h"
+#include "memory.h"
+#include "mlp.h"
+#include "rand.h"
+#include "pool.h"
+#include "comm.h"
+#include "trainer.h"
+#include "eval.h"
+#include "timer.h"
+
+/***** 声明 *****/
+/*** 外部 ***/
+
+Dataset *new_dataset(size_t size, Vector **input, Vector **label);
+static void dataset_free(Dataset *this);
+static MemStat dataset_memory(Dataset *this, bool sample);
+
+Trainer *new_trainer(MLPNet *net, size_t epoch, size_t batch_size,
+                     float rate);
+static void trainer_free(Trainer *this);
+static void trainer_train(Trainer *this, Dataset *data);
+static void trainer_restore_best(Trainer *this);
+
+/*** 内部 ***/
+
+#define HOGWILD_CHUNK 16  /* Hogwild! 模式下每次领取的样本数 */
+
+/* Hogwild! 模式训练一轮的参数 */
+typedef struct {
+	Trainer *trainer;     /* 训练器 */
+	Dataset *data;        /* 训练集 */
+	size_t *queue;        /* 样本顺序 */
+	MLPNet **net;         /* 各自的共享参数的网络 */
+	MLPGrad **grad;       /* 各自的单样本梯度 */
+	double *loss;         /* 各自本轮的损失之和 */
+	atomic_size_t next;   /* 下一个待领取的样本 */
+	atomic_bool abort;    /* 是否因非有限梯度而停止 */
+} HogwildTask;
+
+static HogwildTask *new_hogwild(Trainer *trainer, Dataset *data,
+                                size_t *queue);
+static void hogwild_free(HogwildTask *task);
+static bool hogwild_epoch(HogwildTask *task, double *loss);
+static void hogwild_rows(void *arg, size_t begin, size_t end);
+static bool hogwild_update(MLPNet *net, MLPGrad *grad, float rate);
+static double hogwild_pass(MLPNet *net, MLPGrad *grad, float rate,
+                           bool apply);
+static double axpy(float *param, const float *grad, size_t size, float rate,
+                   bool apply);
+static void shuffle(size_t *queue, size_t size);
+
+/***** 实现 *****/
+/*** 外部 ***/
+
+Dataset *new_dataset(size_t size, Vector **input, Vector **label)
+{
+	Dataset *this = (Dataset*)malloc(sizeof(Dataset));
+	if (!this)
+		goto fail;
+	*this = (Dataset) {
+		.size = size,
+		.input = input,
+		.label = label,
+
+		.free = dataset_free,
+		.memory = dataset_memory,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void dataset_free(Dataset *this)
+{
+	free(this);
+}
+
+static MemStat dataset_memory(Dataset *this, bool sample)
+{
+	MemStat stat = {0};
+	mem_track(&stat, &stat.object, this, sizeof(Dataset));
+	if (!sample)
+		return stat;
+	for (size_t i = 0; i < this->size; i++) {
+		mem_vector(&stat, &stat.data, this->input[i], false);
+		mem_vector(&stat, &stat.data, this->label[i], false);
+	}
+	return stat;
+}
+
+Trainer *new_trainer(MLPNet *net, size_t epoch, size_t batch_size,
+                     float rate)
+{
+	if (!batch_size)
+		return NULL;
+
+	float *this_best = (float*)malloc(sizeof(float) * net->param_size);
+	if (!this_best)
+		goto fail;
+	memcpy(this_best, net->param, sizeof(float) * net->param_size);
+
+	Trainer *this = (Trainer*)malloc(sizeof(Trainer));
+	if (!this)
+		goto fail;
+	*this = (Trainer) {
+		.net = net,
+		.epoch = epoch,
+		.batch_size = batch_size,
+		.rate = rate,
+		.val = NULL,
+		.val_interval = 1,
+		.patience = 0,
+		.report_interval = 1.0,
+		.snapshot = NULL,
+		.snapshot_interval = 100,
+		.comm = NULL,
+		.hogwild = 0,
+
+		.cur_epoch = 0,
+		.step = 0,
+		.loss = 0.0,
+		.best_acc = -1.0,
+		.best_epoch = 0,
+		.best = this_best,
+		.grad = new_mlp_grad(net),
+		.grad_tmp = new_mlp_grad(net),
+
+		.free = trainer_free,
+		.train = trainer_train,
+		.restore_best = trainer_restore_best,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void trainer_free(Trainer *this)
+{
+	free(this->best);
+	this->grad->free(this->grad);
+	this->grad_tmp->free(this->grad_tmp);
+	free(this);
+}
+
+static void trainer_train(Trainer *this, Dataset *data)
+{
+	MLPNet *net = this->net;
+	Comm *comm = this->comm;
+	size_t rank = comm ? comm->transport->rank : 0;
+	size_t procs = comm ? comm->transport->size : 1;
+	size_t *queue = (size_t*)calloc(data->size, sizeof(size_t));
+	if (!queue)
+		goto fail;
+	for (size_t i = 0; i < data->size; i++)
+		queue[i] = i;
+	HogwildTask *hog = this->hogwild && !comm
+	                   ? new_hogwild(this, data, queue) : NULL;
+	size_t batch_num = (data->size + this->batch_size - 1)
+	                   / this->batch_size;
+	size_t bad_num = 0;  /* 验证准确率连续未提升的次数 */
+	double last_report = timer_now();
+	if (comm)
+		comm->broadcast(comm, net->param, sizeof(float) * net->param_size);
+
+	for (size_t e = 1; e <= this->epoch; e++) {
+		shuffle(queue, data->size);
+		if (comm)
+			comm->broadcast(comm, queue, sizeof(size_t) * data->size);
+		double loss = 0.0;
+		size_t seen = 0;  /* 本进程已计算的样本数 */
+		if (hog) {
+			double start = timer_now();
+			bool ok = hogwild_epoch(hog, &loss);
+			seen = data->size;
+			this->step += data->size;
+			if (!ok) {
+				printf("[epoch %zu] non-finite gradient, training aborted\n",
+				       e);
+				goto done;
+			}
+			if (this->snapshot)
+				this->snapshot->take(this->snapshot, this->step);
+			if (this->report_interval > 0.0)
+				printf("[epoch %zu] loss: %f, %.0f samples/s\n", e,
+				       loss / seen,
+				       seen / (timer_now() - start));
+		}
+		for (size_t i = 0; !hog && i < batch_num; i++) {
+			size_t begin = i * this->batch_size;
+			size_t end = begin + this->batch_size < data->size
+			             ? begin + this->batch_size : data->size;
+			this->grad->clear(this->grad);
+			for (size_t j = begin + rank; j < end; j += procs) {
+				Vector *label = data->label[queue[j]];
+				bool last = j + procs >= end;
+				net->forward(net, data->input[queue[j]]);
+				if (comm && last)
+					comm->begin(comm, this->grad, this->grad_tmp);
+				net->grad(net, label, this->grad_tmp);
+				if (!comm || !last)
+					this->grad->add(this->grad, this->grad_tmp);
+				loss += net->lossf(net->output(net), label);
+				seen++;
+			}
+			if (comm) {
+				if (begin + rank >= end)  /* 本进程在这一批没有样本 */
+					comm->begin(comm, this->grad, NULL);
+				comm->wait(comm);
+			}
+			this->grad->scale(this->grad, 1.0 / (end - begin));
+			if (!net->update(net, this->grad, this->rate)
+			    && net->guard == MLP_GUARD_ABORT) {
+				printf("[epoch %zu] non-finite gradient, training aborted\n",
+				       e);
+				goto done;
+			}
+			this->step++;
+			if (this->snapshot && this->snapshot_interval
+			    && this->step % this->snapshot_interval == 0)
+				this->snapshot->take(this->snapshot, this->step);
+
+			if (this->report_interval > 0.0
+			    && timer_now() - last_report
+			       >= this->report_interval) {
+				printf("[epoch %zu] [%zu / %zu] loss: %f", e, i + 1,
+				       batch_num, seen ? loss / seen : 0.0);
+				if (comm)
+					printf(", comm: %.3f ms, %.1f MB/s",
+					       comm->last_comm_time * 1e3,
+					       comm->last_comm_time > 0.0
+					       ? comm->last_bytes / comm->last_comm_time / 1e6
+					       : 0.0);
+				printf("\n");
+				last_report = timer_now();
+			}
+		}
+		this->loss = seen ? loss / seen : 0.0;
+		this->cur_epoch = e;
+
+		if (!this->val || e % this->val_interval)
+			continue;
+		Metrics *metrics = evaluate(net, this->val, 1);
+		float acc = metrics->accuracy;
+		metrics->free(metrics);
+		if (this->report_interval > 0.0)
+			printf("[epoch %zu] loss: %f, val accuracy: %.2f%%\n", e,
+			       this->loss, acc * 100);
+		if (acc > this->best_acc) {
+			this->best_acc = acc;
+			this->best_epoch = e;
+			bad_num = 0;
+			memcpy(this->best, net->param,
+			       sizeof(float) * net->param_size);
+		} else if (this->patience && ++bad_num >= this->patience) {
+			break;
+		}
+	}
+done:
+	if (hog)
+		hogwild_free(hog);
+	if (this->snapshot)
+		this->snapshot->flush(this->snapshot);
+	free(queue);
+	return;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+static void trainer_restore_best(Trainer *this)
+{
+	if (!this->best_epoch)
+		return;
+	memcpy(this->net->param, this->best,
+	       sizeof(float) * this->net->param_size);
+}
+
+/*** 内部 ***/
+
+/**
+ * @brief  创建 Hogwild! 模式的任务，各网络共享`trainer->net`的参数
+ * @param  trainer `[IN]`训练器
+ * @param  data    `[IN]`训练集
+ * @param  queue   `[IN]`样本顺序，每轮打乱后使用
+ * @return `[OWN]`任务
+ */
+static HogwildTask *new_hogwild(Trainer *trainer, Dataset *data,
+                                size_t *queue)
+{
+	size_t num = trainer->hogwild;
+	HogwildTask *task = (HogwildTask*)malloc(sizeof(HogwildTask));
+	MLPNet **net = (MLPNet**)calloc(num, sizeof(MLPNet*));
+	MLPGrad **grad = (MLPGrad**)calloc(num, sizeof(MLPGrad*));
+	double *loss = (double*)calloc(num, sizeof(double));
+	if (!task || !net || !grad || !loss)
+		goto fail;
+	for (size_t i = 0; i < num; i++) {
+		net[i] = trainer->net->share(trainer->net);
+		grad[i] = new_mlp_grad(net[i]);
+	}
+	*task = (HogwildTask) {
+		.trainer = trainer,
+		.data = data,
+		.queue = queue,
+		.net = net,
+		.grad = grad,
+		.loss = loss,
+	};
+	atomic_init(&task->next, 0);
+	atomic_init(&task->abort, false);
+	return task;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
+/**
+ * @brief 销毁任务及其网络与梯度
+ * @param task `[OWN]`任务
+ */
+static void hogwild_free(HogwildTask *task)
+{
+	for (size_t i = 0; i < task->trainer->hogwild; i++) {
+		task->net[i]->free(task->net[i]);
+		task->grad[i]->free(task->grad[i]);
+	}
+	free(task->net);
+	free(task->grad);
+	free(task->loss);
+	free(task);
+}
+
+/**
+ * @brief  Hogwild! 模式训练一轮
+ *
+ * 各网络被裁剪与跳过的更新次数计入`trainer->net`。
+ *
+ * @param  task `[INOUT]`任务
+ * @param  loss `[OUT]`本轮的损失之和
+ * @return 正常结束返回`true`；因非有限梯度而停止时返回`false`
+ */
+static bool hogwild_epoch(HogwildTask *task, double *loss)
+{
+	MLPNet *net = task->trainer->net;
+	size_t num = task->trainer->hogwild;
+	atomic_store(&task->next, 0);
+	for (size_t i = 0; i < num; i++) {
+		task->loss[i] = 0.0;
+		task->net[i]->clip_num = 0;
+		task->net[i]->skip_num = 0;
+	}
+	Pool *pool = pool_global();
+	pool->parallel_for(pool, 0, num, 1, hogwild_rows, task);
+	*loss = 0.0;
+	for (size_t i = 0; i < num; i++) {
+		*loss += task->loss[i];
+		net->clip_num += task->net[i]->clip_num;
+		net->skip_num += task->net[i]->skip_num;
+	}
+	return !atomic_load(&task->abort);
+}
+
+/**
+ * @brief 线程池任务，第`begin`至`end`个网络依次领取样本训练，直至样本取完
+ * @param arg   `[INOUT]``HogwildTask`指针
+ * @param begin 网络起点
+ * @param end   网络终点（不含）
+ */
+static void hogwild_rows(void *arg, size_t begin, size_t end)
+{
+	HogwildTask *task = (HogwildTask*)arg;
+	Dataset *data = task->data;
+	float rate = task->trainer->rate;
+	for (size_t w = begin; w < end; w++) {
+		MLPNet *net = task->net[w];
+		MLPGrad *grad = task->grad[w];
+		for (;;) {
+			size_t j = atomic_fetch_add(&task->next, HOGWILD_CHUNK);
+			if (j >= data->size || atomic_load(&task->abort))
+				break;
+			size_t stop = j + HOGWILD_CHUNK < data->size
+			              ? j + HOGWILD_CHUNK : data->size;
+			for (; j < stop; j++) {
+				Vector *label = data->label[task->queue[j]];
+				net->forward(net, data->input[task->queue[j]]);
+				net->grad(net, label, grad);
+				task->loss[w] += net->lossf(net->output(net), label);
+				if (!hogwild_update(net, grad, rate)
+				    && net->guard == MLP_GUARD_ABORT)
+					atomic_store(&task->abort, true);
+			}
+		}
+	}
+}
+
+/**
+ * @brief  无锁地更新共享参数，裁剪与非有限值的处理同`MLPNet::update`
+ *
+ * 全连接层权重的梯度为输出梯度与输入之积，输入为`0`的列梯度恒为`0`，
+ * 因此只遍历输入非零的列，输入越稀疏，写入越少，与其他线程的冲突也越少。
+ * 其他线程可能同时读写同一参数，单个`float`的读写不会撕裂，至多丢失一次更新。
+ *
+ * @param  net  `[INOUT]`共享参数的网络，须刚对同一样本求过梯度
+ * @param  grad `[IN]`单样本梯度
+ * @param  rate 学习率
+ * @return 已更新返回`true`；梯度出现非有限值而跳过时返回`false`
+ */
+static bool hogwild_update(MLPNet *net, MLPGrad *grad, float rate)
+{
+	double norm2 = hogwild_pass(net, grad, 0.0, false);
+	if (!isfinite(norm2)) {
+		net->skip_num++;
+		return false;
+	}
+	if (net->clip_norm > 0.0
+	    && norm2 > (double)net->clip_norm * net->clip_norm) {
+		rate *= net->clip_norm / sqrt(norm2);
+		net->clip_num++;
+	}
+	hogwild_pass(net, grad, rate, true);
+	return true;
+}
+
+/**
+ * @brief  遍历可能非零的梯度，求平方和或更新参数
+ * @param  net   `[INOUT]`网络
+ * @param  grad  `[IN]`梯度
+ * @param  rate  学习率
+ * @param  apply 为`true`时更新参数，否则求平方和
+ * @return 平方和，更新参数时为`0`
+ */
+static double hogwild_pass(MLPNet *net, MLPGrad *grad, float rate,
+                           bool apply)
+{
+	double norm2 = 0.0;
+	for (size_t i = 0; i < net->size; i++) {
+		Layer *layer = net->layer[i];
+		FCLayer *fc = layer->fc;
+		GradRows *rows = grad->rows[i];
+		if (rows && rows->num != MLP_ROWS_ALL) {
+			size_t n = rows->row_size;
+			for (size_t k = 0; k < rows->num; k++) {
+				size_t offset = rows->offset + rows->row[k] * n;
+				norm2 += axpy(net->param + offset,
+				              grad->param + offset, n, rate, apply);
+			}
+			continue;
+		}
+		if (!fc) {
+			norm2 += axpy(net->param + layer->offset,
+			              grad->param + layer->offset, layer->param_size,
+			              rate, apply);
+			continue;
+		}
+		for (size_t c = 0; c < fc->size; c++)
+			if (fc->node->val[c] != 0.0)
+				norm2 += axpy(fc->weight->val[c]->val,
+				              grad->weight[i]->val[c]->val, fc->next_size,
+				              rate, apply);
+		norm2 += axpy(fc->bias->val, grad->bias[i]->val, fc->next_size,
+		              rate, apply);
+		if (fc->gamma) {
+			norm2 += axpy(fc->gamma->val, grad->gamma[i]->val,
+			              fc->next_size, rate, apply);
+			norm2 += axpy(fc->beta->val, grad->beta[i]->val, fc->next_size,
+			              rate, apply);
+		}
+	}
+	return norm2;
+}
+
+/**
+ * @brief  `param -= rate * grad`，或求`grad`的平方和
+ * @param  param `[INOUT]`参数
+ * @param  grad  `[IN]`梯度
+ * @param  size  长度
+ * @param  rate  学习率
+ * @param  apply 为`true`时更新参数，否则求平方和
+ * @return 平方和，更新参数时为`0`
+ */
+static double axpy(float *param, const float *grad, size_t size, float rate,
+                   bool apply)
+{
+	if (apply) {
+		for (size_t i = 0; i < size; i++)
+			param[i] -= rate * grad[i];
+		return 0.0;
+	}
+	double sum = 0.0;
+	for (size_t i = 0; i < size; i++)
+		sum += (double)grad[i] * grad[i];
+	return sum;
+}
+
+/**
+ * @brief 打乱顺序
+ * @param queue `[INOUT]`下标数组
+ * @param size  长度
+ */
+static void shuffle(size_t *queue, size_t size)
+{
+	for (size_t i = size; i-- > 1; ) {
+		size_t j = rand_below(i + 1);
+		size_t tmp = queue[i];
+		queue[i] = queue[j];
+		queue[j] = tmp;
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef TRAINER_H_
+#define TRAINER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "vector.h"
+#include "memory.h"
+#include "mlp.h"
+#include "snapshot.h"
+#include "comm.h"
+
+typedef struct Dataset Dataset;
+typedef struct Trainer Trainer;
+
+/***** Dataset *****/
+
+struct Dataset {
+	size_t size;     /* 样本数 */
+	Vector **input;  /* 输入 */
+	Vector **label;  /* 标签 */
+
+	/**
+	 * @brief 销毁`Dataset`，不销毁样本
+	 */
+	void (*free)(Dataset *this);
+
+	/**
+	 * @brief  统计内存占用
+	 * @param  sample 是否计入样本（各`Vector`），不含`input`与`label`数组
+	 * @return 合计
+	 */
+	MemStat (*memory)(Dataset *this, bool sample);
+};
+
+/**
+ * @brief  创建`Dataset`，仅引用样本，不拷贝
+ * @param  size  样本数
+ * @param  input `[IN]`输入
+ * @param  label `[IN]`标签
+ * @return `[OWN]``Dataset`指针
+ */
+Dataset *new_dataset(size_t size, Vector **input, Vector **label);
+
+/***** Trainer *****/
+
+struct Trainer {
+	MLPNet *net;             /* 网络 */
+	size_t epoch;            /* 最大轮数 */
+	size_t batch_size;       /* 批大小 */
+	float rate;              /* 学习率 */
+	Dataset *val;            /* 验证集，为`NULL`时不验证，默认`NULL` */
+	size_t val_interval;     /* 每隔几轮验证一次，默认`1` */
+	size_t patience;         /* 验证准确率连续几次未提升时停止，为`0`时不早停，默认`0` */
+	double report_interval;  /* 两次进度报告的最短间隔（秒），为`0`时不报告，默认`1` */
+	Snapshot *snapshot;      /* 快照，为`NULL`时不拍快照，默认`NULL` */
+	size_t snapshot_interval;  /* 每隔几批拍一次快照，默认`100` */
+	Comm *comm;              /* 数据并行的梯度同步，为`NULL`时单进程训练，默认`NULL` */
+	size_t hogwild;          /* Hogwild! 模式的并发网络数，为`0`时同步训练，默认`0` */
+
+	size_t cur_epoch;        /* 已完成的轮数 */
+	size_t step;             /* 已完成的批数，跨`train`累计 */
+	float loss;              /* 最近一轮的平均损失，数据并行时为本进程样本的 */
+	float best_acc;          /* 最佳验证准确率 */
+	size_t best_epoch;       /* 最佳验证准确率所在轮数 */
+	float *best;             /* 最佳验证准确率时的参数，布局同`MLPNet::param` */
+	MLPGrad *grad;           /* 批梯度 */
+	MLPGrad *grad_tmp;       /* 单样本梯度 */
+
+	/**
+	 * @brief 销毁`Trainer`，不销毁`net`与`val`
+	 */
+	void (*free)(Trainer *this);
+
+	/**
+	 * @brief 训练网络，每轮重新打乱样本顺序，最后一批可不足`batch_size`
+	 *
+	 * 梯度裁剪与非有限值的处理见`MLPNet::update`，
+	 * `net->guard`为`MLP_GUARD_ABORT`时遇到非有限梯度即停止。
+	 * 设置了`snapshot`时每`snapshot_interval`批在更新后拍一次快照，
+	 * 返回前等待快照写出。
+	 *
+	 * 设置了`comm`时，各进程须以相同的`data`、`batch_size`与`epoch`调用。
+	 * 开始时自第`0`个进程广播参数，每轮广播样本顺序；
+	 * 每批中第`rank`个进程只计算下标模进程数余`rank`的样本，
+	 * 最后一个样本的反向传播与梯度同步重叠，各进程的参数始终相同。
+	 * 滑动归一化的统计量由各进程各自维护。
+	 * 快照与验证通常只需在第`0`个进程设置。
+	 *
+	 * `hogwild`非零且未设置`comm`时，以`MLPNet::share`创建`hogwild`个共享参数的网络，
+	 * 在线程池中并发地逐样本求梯度并直接更新参数，不加锁、不分批。
+	 * 全连接层只更新输入非零的权重列，输入稀疏时各线程很少写到同一参数。
+	 * 此时`step`按样本计数，快照在每轮结束时拍下，进度每轮报告一次。
+	 *
+	 * @param data `[IN]`训练集
+	 */
+	void (*train)(Trainer *this, Dataset *data);
+
+	/**
+	 * @brief 将网络参数恢复为最佳验证准确率时的值，未验证过时不操作
+	 */
+	void (*restore_best)(Trainer *this);
+};
+
+/**
+ * @brief  创建`Trainer`
+ * @param  net        `[IN]`网络，须在`Trainer`销毁后再销毁
+ * @param  epoch      最大轮数
+ * @param  batch_size 批大小，不可为`0`
+ * @param  rate       学习率
+ * @return `[OWN]``Trainer`指针；`batch_size`为`0`时返回`NULL`
+ */
+Trainer *new_trainer(MLPNet *net, size_t epoch, size_t batch_size,
+                     float rate);
+
+#endif  /* TRAINER_H_ */
@@ -9,8 +9,11 @@
 /*** 外部 ***/
 
 Vector *new_vector(size_t size, float *val);
+Vector *new_vector_view(size_t size, float *val);
 static void vector_free(Vector *this);
+static void vector_view_free(Vector *this);
 static void vector_set(Vector *this, size_t size, float *val);
+static void vector_view_set(Vector *this, size_t size, float *val);
 static void vector_clear(Vector *this);
 static void vector_rand_uniform(Vector *this, float min, float max);
 static void vector_add(Vector *this, Vector *target);
@@ -69,12 +72,45 @@ fail:
 	exit(1);
 }
 
+Vector *new_vector_view(size_t size, float *val)
+{
+	Vector *this = (Vector*)malloc(sizeof(Vector));
+	if (!this)
+		goto fail;
+	*this = (Vector) {
+		.size = size,
+		.val = val,
+
+		.free = vector_view_free,
+		.set = vector_view_set,
+		.clear = vector_clear,
+		.rand_uniform = vector_rand_uniform,
+		.add = vector_add,
+		.sub = vector_sub,
+		.scale = vector_scale,
+		.map = vector_map,
+		.copy = vector_copy,
+		.has_negative = vector_has_negative,
+		.len = vector_len,
+		.print = vector_print,
+	};
+	return this;
+fail:
+	printf("Memory not enough!");
+	exit(1);
+}
+
 static void vector_free(Vector *this)
 {
 	free(this->val);
 	free(this);
 }
 
+static void vector_view_free(Vector *this)
+{
+	free(this);
+}
+
 static void vector_set(Vector *this, size_t size, float *val)
 {
 	if (this->size != size) {
@@ -91,6 +127,17 @@ fail:
 	exit(1);
 }
 
+static void vector_view_set(Vector *this, size_t size, float *val)
+{
+	if (this->size != size)
+		goto fail;
+	memcpy(this->val, val, sizeof(float) * size);
+	return;
+fail:
+	printf("Vector view size mismatch!");
+	exit(1);
+}
+
 static void vector_clear(Vector *this)
 {
 	memset(this->val, 0, sizeof(float) * this->size);
@@ -98,8 +145,7 @@ static void vector_clear(Vector *this)
 
 static void vector_rand_uniform(Vector *this, float min, float max)
 {
-	for (size_t i = 0; i < this->size; i++)
-		this->val[i] = rand_uniform(min, max);
+	rand_fill_uniform(this->val, this->size, min, max);
 }
 
 static void vector_add(Vector *this, Vector *target)
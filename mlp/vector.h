@@ -93,4 +93,16 @@ struct Vector {
  */
 Vector *new_vector(size_t size, float *val);
 
+/**
+ * @brief  创建引用外部存储的`Vector`
+ *
+ * 不拥有`val`，`free`只销毁`Vector`本身，`set`不可改变长度。
+ * 可直接修改`val`与`size`以指向另一段存储。
+ *
+ * @param  size 维度
+ * @param  val  `[IN]`值
+ * @return `[OWN]``Vector`指针
+ */
+Vector *new_vector_view(size_t size, float *val);
+
 #endif  /* VECTOR_H_ */